@@ -2,6 +2,7 @@
  * AudioFileSourceLoop
  * Read SD/SPIFFS/LittleFS file to be used by AudioGenerator
  * Reads file in a loop (for looped playback)
+ * AudioFileSourceBank: Sounds from a packed sound bank
  * 
  * Thomas Winischhofer (A10001986), 2023
  *
@@ -117,3 +118,221 @@ bool AudioFileSourceFSLoop::open(const char *filename)
 }
 
 #endif  // -----------------------------------------
+
+// Sound bank ----------------------------------------
+//
+// The bank is opened (or mapped) once and stays open; open() 
+// only selects a sound, and close() (called by the generator 
+// upon stop) only deselects it. Positions are relative to the 
+// start of the selected sound.
+
+AudioFileSourceBank::AudioFileSourceBank()
+{
+}
+
+AudioFileSourceBank::~AudioFileSourceBank()
+{
+    end();
+}
+
+bool AudioFileSourceBank::begin(const char *bankname)
+{
+    FCSBHeader hdr;
+    
+    end();
+
+    #ifdef USE_SPIFFS
+    f = SPIFFS.open(bankname, FILE_READ);
+    #else
+    f = LittleFS.open(bankname, FILE_READ);
+    #endif
+    if(!f)
+        return false;
+
+    if(f.read((uint8_t *)&hdr, sizeof(hdr)) != sizeof(hdr) || 
+       hdr.size != f.size()                                ||
+       !loadTable(hdr, f.size())) {
+        end();
+        return false;
+    }
+
+    return true;
+}
+
+bool AudioFileSourceBank::begin(const uint8_t *image, uint32_t imageSize)
+{
+    FCSBHeader hdr;
+
+    end();
+
+    if(imageSize < sizeof(hdr))
+        return false;
+        
+    memcpy(&hdr, image, sizeof(hdr));
+    base = image;
+    
+    if(!loadTable(hdr, imageSize)) {
+        end();
+        return false;
+    }
+
+    return true;
+}
+
+bool AudioFileSourceBank::loadTable(const FCSBHeader& hdr, uint32_t imageSize)
+{
+    uint32_t tsize;
+
+    if(memcmp(hdr.magic, FCSB_MAGIC, 4)          ||
+       hdr.version != FCSB_VERSION               ||
+       !hdr.count || hdr.count > FCSB_MAX_SOUNDS ||
+       hdr.size > imageSize)
+        return false;
+
+    tsize = hdr.count * sizeof(FCSBEntry);
+    if(sizeof(hdr) + tsize > hdr.size)
+        return false;
+    
+    if(!(sounds = (FCSBEntry *)malloc(tsize)))
+        return false;
+    
+    if(base) {
+        memcpy(sounds, base + sizeof(hdr), tsize);
+    } else if(f.read((uint8_t *)sounds, tsize) != tsize) {
+        return false;
+    }
+
+    for(int i = 0; i < hdr.count; i++) {
+        if(sounds[i].offset > hdr.size || 
+           sounds[i].length + FCSB_GUARD > hdr.size - sounds[i].offset)
+            return false;
+        sounds[i].name[sizeof(sounds[i].name) - 1] = 0;
+    }
+
+    numSounds = hdr.count;
+
+    return true;
+}
+
+void AudioFileSourceBank::end()
+{
+    active = false;
+    numSounds = 0;
+    free(sounds);
+    sounds = NULL;
+    base = NULL;
+    if(f) f.close();
+}
+
+int AudioFileSourceBank::find(const char *filename)
+{
+    if(*filename == '/') filename++;
+    
+    for(int i = 0; i < numSounds; i++) {
+        if(!strcmp(sounds[i].name, filename))
+            return i;
+    }
+    
+    return -1;
+}
+
+bool AudioFileSourceBank::select(int id)
+{
+    if(id < 0 || id >= numSounds)
+        return false;
+
+    sndStart = sounds[id].offset;
+    sndEnd = sndStart + sounds[id].length;
+    startPos = 0;
+    
+    return (active = setPos(sndStart));
+}
+
+bool AudioFileSourceBank::open(const char *filename)
+{
+    return select(find(filename));
+}
+
+uint32_t AudioFileSourceBank::curPos()
+{
+    return base ? memPos : f.position();
+}
+
+bool AudioFileSourceBank::setPos(uint32_t pos)
+{
+    if(!base) return f.seek(pos);
+    memPos = pos;
+    return true;
+}
+
+uint32_t AudioFileSourceBank::readRaw(uint8_t *data, uint32_t len)
+{
+    uint32_t pos = curPos();
+
+    if(pos >= sndEnd) return 0;
+    len = min(len, sndEnd - pos);
+    if(!base) return f.read(data, len);
+    memcpy(data, base + pos, len);
+    memPos += len;
+    return len;
+}
+
+uint32_t AudioFileSourceBank::read(void *data, uint32_t len)
+{
+    uint32_t glen;
+
+    if(!active) return 0;
+
+    glen = readRaw(reinterpret_cast<uint8_t*>(data), len);
+    if(!doPlayLoop || glen == len) return glen;
+    seek(startPos, SEEK_SET);
+    return glen + readRaw(reinterpret_cast<uint8_t*>(data) + glen, len - glen);
+}
+
+bool AudioFileSourceBank::seek(int32_t pos, int dir)
+{
+    if(!active) return false;
+    if(dir == SEEK_CUR)      pos += curPos() - sndStart;
+    else if(dir == SEEK_END) pos += sndEnd - sndStart;
+    else if(dir != SEEK_SET) return false;
+    if(pos < 0 || (uint32_t)pos > sndEnd - sndStart) return false;
+    return setPos(sndStart + pos);
+}
+
+bool AudioFileSourceBank::close()
+{
+    active = false;
+    return true;
+}
+
+bool AudioFileSourceBank::isOpen()
+{
+    return active;
+}
+
+uint32_t AudioFileSourceBank::getSize()
+{
+    if(!active) return 0;
+    return sndEnd - sndStart;
+}
+
+uint32_t AudioFileSourceBank::getPos()
+{
+    if(!active) return 0;
+    return curPos() - sndStart;
+}
+
+// Zero-copy access; only if bank is in memory. The guard bytes
+// following each sound allow the decoder to read past its end.
+const uint8_t *AudioFileSourceBank::getDirect(uint32_t *len)
+{
+    if(!active || !base) return NULL;
+    
+    if(memPos >= sndEnd && doPlayLoop) {
+        seek(startPos, SEEK_SET);
+    }
+    
+    *len = (memPos < sndEnd) ? sndEnd - memPos + FCSB_GUARD : 0;
+    
+    return base + memPos;
+}
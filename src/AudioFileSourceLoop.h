@@ -2,6 +2,7 @@
  * AudioFileSourceLoop
  * Read SD/SPIFFS/LittleFS file to be used by AudioGenerator
  * Reads file in a loop (for looped playback)
+ * AudioFileSourceBank: Sounds from a packed sound bank
  * 
  * Thomas Winischhofer (A10001986), 2023
  *
@@ -60,4 +61,71 @@ class AudioFileSourceFSLoop : public AudioFileSourceLoop
     virtual bool open(const char *filename) override;
 };
 
+/*
+ * Sound bank: One file holding all default sounds, built by
+ * tools/mkfcbank.py. MPEG data is stored without ID3 tags,
+ * starting with the first frame, followed by at least 
+ * FCSB_GUARD zero bytes. All numbers little endian.
+ * The bank is either read from a file, or accessed in memory 
+ * (memory-mapped flash partition; mmap()ed file on a host).
+ */
+#define FCSB_MAGIC      "FCSB"
+#define FCSB_VERSION    1
+#define FCSB_MAX_SOUNDS 32
+#define FCSB_IDX_STEP   32      // Frame index: Every 32nd frame
+#define FCSB_GUARD      8       // Zero bytes after each sound (decoder guard)
+
+struct FCSBHeader {
+    char     magic[4];
+    uint16_t version;
+    uint16_t count;             // Number of sounds
+    uint32_t size;              // Total size of bank
+    uint32_t reserved;
+};
+
+struct FCSBEntry {
+    char     name[16];          // File name without "/"
+    uint32_t offset;            // Start of MPEG data in bank
+    uint32_t length;            // Length of MPEG data
+    uint32_t idxOffset;         // Start of frame index in bank
+    uint16_t numFrames;
+    uint16_t idxCount;
+};
+
+class AudioFileSourceBank : public AudioFileSourceLoop
+{
+  public:
+    AudioFileSourceBank();
+    virtual ~AudioFileSourceBank() override;
+
+    bool begin(const char *bankname);
+    bool begin(const uint8_t *image, uint32_t imageSize);
+    void end();
+    int  find(const char *filename);
+    bool select(int id);
+    
+    virtual bool open(const char *filename) override;
+    virtual uint32_t read(void *data, uint32_t len) override;
+    virtual bool seek(int32_t pos, int dir) override;
+    virtual bool close() override;
+    virtual bool isOpen() override;
+    virtual uint32_t getSize() override;
+    virtual uint32_t getPos() override;
+    virtual const uint8_t *getDirect(uint32_t *len) override;
+
+  private:
+    bool     loadTable(const FCSBHeader& hdr, uint32_t imageSize);
+    uint32_t curPos();
+    bool     setPos(uint32_t pos);
+    uint32_t readRaw(uint8_t *data, uint32_t len);
+    
+    const uint8_t *base = NULL;
+    uint32_t  memPos = 0;
+    FCSBEntry *sounds = NULL;
+    int       numSounds = 0;
+    uint32_t  sndStart = 0;
+    uint32_t  sndEnd = 0;
+    bool      active = false;
+};
+
 #endif
@@ -35,8 +35,10 @@
 #include <Arduino.h>
 #include <SD.h>
 #include <FS.h>
+#include <esp_partition.h>
 
 #include "AudioFileSourceLoop.h"
+#include "input.h"
 
 #include "src/ESP8266Audio/AudioGeneratorMP3.h"
 #include "src/ESP8266Audio/AudioOutputI2S.h"
@@ -45,11 +47,16 @@
 #include "fc_settings.h"
 #include "fc_audio.h"
 #include "fc_wifi.h"
+#include "fc_shuffle.h"
 
 static AudioGeneratorMP3 *mp3;
 
 static AudioFileSourceFSLoop *myFS0L;
 static AudioFileSourceSDLoop *mySD0L;
+static AudioFileSourceBank   *myBank;
+static bool haveBank = false;
+static spi_flash_mmap_handle_t bankMapHandle;
+static bool bankMapped = false;
 
 static AudioOutputI2S *out;
 
@@ -59,23 +66,86 @@ bool audioMute = false;
 bool haveMusic = false;
 bool mpActive = false;
 static uint16_t maxMusic = 0;
-static uint16_t *playList = NULL;
 static int  mpCurrIdx = 0;
 static bool mpShuffle = false;
+static bool mpInitDone = false;
 
-static const float volTable[20] = {
-    0.00, 0.02, 0.04, 0.06,
-    0.08, 0.10, 0.13, 0.16,
-    0.19, 0.22, 0.26, 0.30,
-    0.35, 0.40, 0.50, 0.60,
-    0.70, 0.80, 0.90, 1.00
+// Shuffle: See fc_shuffle.h
+static uint16_t  mpSeed = 0;
+static FCShuffle mpSh;
+
+/*
+ * Resume: When stopped, the player remembers track and frame,
+ * and continues there when started again. The position (along
+ * with the shuffle seed, so that the shuffled order can be
+ * reproduced) is also checkpointed to the settings store every
+ * MP_CKPT_INT while playing, so playback resumes after a power 
+ * cycle, too. Selecting a track explicitly discards it.
+ */
+#define MP_CKPT_INT 60*1000
+static int      mpResTrack = -1;           // Track to resume, -1 if none
+static uint32_t mpResFrame = 0;
+static int32_t  mpSeekPending = -1;        // Frame to seek to once index is available
+static unsigned long mpCkptNow = 0;
+
+/*
+ * Music track index
+ * 
+ * For each track played, an index of its MPEG frames is built in
+ * the background and stored next to the track as "/musicX/.NNN.idx"
+ * (the renamer ignores dot-files). It holds the file offset of every 
+ * MPIDX_STEP'th frame, the number of frames and the sample rate. 
+ * This allows seeking to a given frame without decoding anything, 
+ * and tells the exact duration of the track. An index whose track 
+ * has changed in size is rebuilt. The header is written last, so 
+ * an incomplete index is never used.
+ */
+#define MPIDX_MAGIC      "FCMI"
+#define MPIDX_VERSION    1
+#define MPIDX_STEP       8
+#define MPIDX_BUFSIZE    2048
+#define MPIDX_DELAY      10         // ms between reads while building; keeps SD available for playback
+#define MPIDX_TASK_STACK 4096
+
+struct MPIdxHeader {
+    char     magic[4];
+    uint16_t version;
+    uint16_t step;
+    uint32_t fileSize;              // Size of track
+    uint32_t numFrames;
+    uint16_t sampleRate;
+    uint16_t frameSamples;          // Samples per frame
+    uint32_t idxCount;              // Number of offsets following header
+};
+
+static TaskHandle_t  mpIdxTask = NULL;
+static volatile uint32_t mpIdxReq = 0;     // Request: Seq << 16 | folder * 1000 + track
+static volatile uint32_t mpIdxBuilt = 0;   // Last request successfully built
+static uint16_t      mpIdxSeq = 0;
+static MPIdxHeader   mpIdx;                // Index header of current track
+static bool          mpIdxValid = false;
+static int           mpIdxTrack = -1;      // Folder * 1000 + track mpIdx belongs to
+static uint32_t      mpStartFrame = 0;     // Frame playback started at
+static uint32_t      mpSampleBase = 0;     // Samples output counter at start
+
+// Volume curve, Q15 gain (32768 = 1.0). Evenly spaced in dB from
+// -34dB (index 1) to 0dB (index 19); index 0 is mute.
+static const uint16_t volTable[20] = {
+        0,   654,   813,  1010,
+     1255,  1560,  1939,  2411,
+     2996,  3724,  4629,  5753,
+     7151,  8888, 11047, 13730,
+    17065, 21211, 26364, 32768
 };
+#define GAIN_ONE  32768
+#define GAIN_MIN  655     // 0.02 is the lowest audible gain
+#define GAIN_NM   9830    // Night mode: 0.3
 
 bool    useVKnob = false;
 uint8_t curSoftVol = DEFAULT_VOLUME; 
 
-static float   curVolFact = 1.0;
-static bool    dynVol     = true;
+static uint32_t curVolFact = GAIN_ONE;
+static bool     dynVol     = true;
 
 bool playingFlux = false;
 
@@ -84,16 +154,13 @@ static float    append_vol;
 static uint16_t append_flags;
 static bool     appendFile = false;
 
-static int sampleCnt = 0;
+static unsigned long volChkNow = 0;
+#define VOL_CHK_INT 20
 
-#define VOL_SMOOTH_SIZE 4
-static int rawVol[VOL_SMOOTH_SIZE];
-static int rawVolIdx = 0;
-static int anaReadCount = 0;
-static long prev_avg, prev_raw, prev_raw2;
+static uint32_t audioUnderruns = 0;
+static bool     audioPrimed = false;
 
-// Resolution for pot, 9-12 allowed
-#define POT_RESOLUTION 9
+static FCPot volPot(VOLUME_PIN);
 
 unsigned long renNow1;
 const char *tcdrdone = "/TCD_DONE.TXT";   // leave "TCD", SD is interchangable this way
@@ -103,36 +170,43 @@ static bool mp_checkForFile(int num);
 static void mp_nextprev(bool forcePlay, bool next);
 static bool mp_play_int(bool force);
 static void mp_buildFileName(char *fnbuf, int num);
+static void mp_trackStarted(int num);
+static bool mpidx_check();
+static void mp_initShuffle();
+static int  mp_idxToTrack(int idx);
+static int  mp_trackToIdx(int track);
+static void mp_checkpoint();
+static void mp_loop();
 static bool mp_renameFilesInDir(bool isSetup);
+static void mp_initLazy();
+static bool mp_checkInit();
 static void mpren_quickSort(char **a, int s, int e);
 
 static int skipID3(char *buf);
 
-static float getRawVolume();
-static float getVolume();
+static uint32_t getRawVolume();
+static uint32_t getVolume();
 
 /*
  * audio_setup()
  */
 void audio_setup()
 {
-    bool waitShown = false;
-    
     #ifdef FC_DBG
     audioLogger = &Serial;
     #endif
 
-    useVKnob = (atoi(settings.useVknob) > 0);
+    useVKnob = (settingsVal.useVknob > 0);
 
-    // Set resolution for volume pot
-    analogReadResolution(POT_RESOLUTION);
-    analogSetWidth(POT_RESOLUTION);
+    volPot.begin();
 
     out = new AudioOutputI2S(0, 0, 32, 0);
     out->SetOutputModeMono(true);
     out->SetPinout(I2S_BCLK_PIN, I2S_LRCLK_PIN, I2S_DIN_PIN);
 
     mp3  = new AudioGeneratorMP3();
+    // Output is mono anyway; have the decoder synthesize only one channel
+    mp3->SetMonoMix(true);
 
     myFS0L = new AudioFileSourceFSLoop();
 
@@ -140,42 +214,115 @@ void audio_setup()
         mySD0L = new AudioFileSourceSDLoop();
     }
 
+    // Default sounds from packed sound bank, if installed: Either
+    // memory-mapped from sound partition, or from file on flash FS
+    myBank = new AudioFileSourceBank();
+    {
+        const esp_partition_t *sndPart = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, 
+                                              ESP_PARTITION_SUBTYPE_ANY, SND_PART_NAME);
+        const void *bankMap;
+        if(sndPart && esp_partition_mmap(sndPart, 0, sndPart->size, SPI_FLASH_MMAP_DATA, 
+                                         &bankMap, &bankMapHandle) == ESP_OK) {
+            if((haveBank = myBank->begin((const uint8_t *)bankMap, sndPart->size))) {
+                bankMapped = true;
+            } else {
+                // No (valid) bank in partition; free the MMU pages
+                spi_flash_munmap(bankMapHandle);
+            }
+        }
+    }
+    if(!haveBank && haveFS) {
+        haveBank = myBank->begin(SND_BANK_NAME);
+    }
+    #ifdef FC_DBG
+    Serial.printf("Audio: Sound bank %s\n", haveBank ? (bankMapped ? "in partition" : "in flash FS") : "not present");
+    #endif
+
     loadCurVolume();
 
     loadMusFoldNum();
-    mpShuffle = (settings.shuffle[0] != '0');
+    mpShuffle = (settingsVal.shuffle > 0);
 
-    // MusicPlayer init
-    if(haveSD) {
-        // Show "wait" if mp_init will take some noticable time
-        if(mp_checkForFolder(musFolderNum) == -1) {
-            showWaitSequence();
-            waitShown = true;
-        }
+    // MusicPlayer: Scan is deferred until first use
+    mp_initLazy();
+
+    audioInitDone = true;
+}
+
+/*
+ * Music player initialization
+ *
+ * At boot, haveMusic is derived from the folder summary (number
+ * of the last file, or "no music") saved along with the folder
+ * number; if there is no summary, or it says "no music", only the
+ * folder status is checked (in case the user has added files).
+ * The actual scan (including renaming if required) and shuffle
+ * setup take place through mp_checkInit() upon first use.
+ */
+static void mp_initLazy()
+{
+    int sum;
+    
+    haveMusic = mpInitDone = false;
+    mpIdxTrack = -1;
+    mpIdxValid = false;
+
+    mpCurrIdx = 0;
+
+    if(!haveSD)
+        return;
+
+    if((sum = loadMusFoldSum()) >= 0) {
+        haveMusic = true;
+    } else {
+        sum = mp_checkForFolder(musFolderNum);
+        haveMusic = (sum == 1 || sum == -1);
     }
-    mp_init(true);
-    if(waitShown) {
+
+    #ifdef FC_DBG
+    Serial.printf("MusicPlayer: Folder %d: %s music (lazy)\n", musFolderNum, haveMusic ? "Have" : "No");
+    #endif
+}
+
+static bool mp_checkInit()
+{
+    if(mpInitDone || !haveMusic)
+        return haveMusic;
+
+    if(mp_checkForFolder(musFolderNum) == -1) {
+        int timeout = 400;
+        mp_stop();
+        stopAudio();
+        showWaitSequence();
+        play_file("/renaming.mp3", PA_INTRMUS|PA_ALLOWSD|PA_HALFRT);
+        while(!checkAudioDone() && timeout--) {
+            mydelay(10, false);
+        }
+        mp_init(false);
         endWaitSequence();
+    } else {
+        mp_init(false);
     }
 
-    audioInitDone = true;
+    return haveMusic;
 }
 
 void mp_init(bool isSetup)
 {
     char fnbuf[20];
+    int sum;
     
     haveMusic = false;
-
-    if(playList) {
-        free(playList);
-        playList = NULL;
-    }
+    mpInitDone = true;
+    mpIdxTrack = -1;
+    mpIdxValid = false;
 
     mpCurrIdx = 0;
     
     if(haveSD) {
-        int i, j;
+        int track;
+        uint32_t frame;
+        uint16_t seed;
 
         #ifdef FC_DBG
         Serial.println("MusicPlayer: Checking for music files");
@@ -183,35 +330,46 @@ void mp_init(bool isSetup)
 
         mp_renameFilesInDir(isSetup);
 
+        sum = loadMusFoldSum();
+
         mp_buildFileName(fnbuf, 0);
         if(SD.exists(fnbuf)) {
             haveMusic = true;
 
-            maxMusic = mp_findMaxNum();
+            // Summary still correct? Otherwise do binary search.
+            if(sum >= 0 && mp_checkForFile(sum) && !mp_checkForFile(sum + 1)) {
+                maxMusic = sum;
+            } else {
+                maxMusic = mp_findMaxNum();
+                saveMusFoldSum(maxMusic);
+            }
             #ifdef FC_DBG
             Serial.printf("MusicPlayer: last file num %d\n", maxMusic);
             #endif
 
-            playList = (uint16_t *)malloc((maxMusic + 1) * 2);
-
-            if(!playList) {
+            // Init shuffle; if there is a position to resume,
+            // use the seed it was saved with
+            mpSeed = 0;
+            mpResTrack = -1;
+            if(loadMusPos(track, frame, seed) && track <= maxMusic) {
+                mpSeed = seed;
+                mpResTrack = track;
+                mpResFrame = frame;
+            }
+            mp_initShuffle();
 
-                haveMusic = false;
+            if(mpResTrack >= 0) {
+                mpCurrIdx = mp_trackToIdx(mpResTrack);
                 #ifdef FC_DBG
-                Serial.println("MusicPlayer: Failed to allocate PlayList");
+                Serial.printf("MusicPlayer: Resuming track %d at frame %d\n", mpResTrack, mpResFrame);
                 #endif
-
-            } else {
-
-                // Init play list
-                mp_makeShuffle(mpShuffle);
-                
             }
 
         } else {
             #ifdef FC_DBG
             Serial.printf("MusicPlayer: Failed to open %s\n", fnbuf);
             #endif
+            if(sum != -1) saveMusFoldSum(-1);
         }
     }
 }
@@ -252,37 +410,54 @@ static int mp_findMaxNum()
 
 void mp_makeShuffle(bool enable)
 {
-    int numMsx = maxMusic + 1;
-
     mpShuffle = enable;
+    mpSeed = 0;
+    mpResTrack = -1;
 
-    if(!haveMusic) return;
-    
-    for(int i = 0; i < numMsx; i++) {
-        playList[i] = i;
+    // If not initialized yet, mp_init() takes care of this
+    if(!haveMusic || !mpInitDone) return;
+
+    mp_initShuffle();
+}
+
+// Derive Feistel keys from mpSeed (new seed if none)
+static void mp_initShuffle()
+{
+    if(!mpShuffle || maxMusic < 2) {
+        shuffleOff(&mpSh);
+        return;
     }
-    
-    if(enable && numMsx > 2) {
-        for(int i = 0; i < numMsx; i++) {
-            int ti = esp_random() % numMsx;
-            uint16_t t = playList[ti];
-            playList[ti] = playList[i];
-            playList[i] = t;
-        }
-        #ifdef FC_DBG
-        for(int i = 0; i <= maxMusic; i++) {
-            Serial.printf("%d ", playList[i]);
-            if((i+1) % 16 == 0 || i == maxMusic) Serial.printf("\n");
-        }
-        #endif
+
+    while(!mpSeed) {
+        mpSeed = esp_random();
     }
+
+    shuffleInit(&mpSh, mpSeed, maxMusic);
+
+    #ifdef FC_DBG
+    Serial.printf("MusicPlayer: Shuffle seed %d, %d bits\n", mpSeed, mpSh.bits * 2);
+    #endif
+}
+
+// Play list position -> track number
+static int mp_idxToTrack(int idx)
+{
+    return shuffleIdxToTrack(&mpSh, idx);
+}
+
+// Track number -> play list position
+static int mp_trackToIdx(int track)
+{
+    return shuffleTrackToIdx(&mpSh, track);
 }
 
 void mp_play(bool forcePlay)
 {
-    int oldIdx = mpCurrIdx;
+    int oldIdx;
 
-    if(!haveMusic) return;
+    if(!mp_checkInit()) return;
+
+    oldIdx = mpCurrIdx;
     
     do {
         if(mp_play_int(forcePlay)) {
@@ -299,6 +474,9 @@ bool mp_stop()
     bool ret = mpActive;
     
     if(mpActive) {
+        mpResTrack = mp_idxToTrack(mpCurrIdx);
+        mpResFrame = (mpSeekPending >= 0) ? mpSeekPending : mp_getCurrentFrame();
+        saveMusPos(mpResTrack, mpResFrame, mpShuffle ? mpSeed : 0);
         mp3->stop();
         mpActive = false;
     }
@@ -318,9 +496,12 @@ void mp_prev(bool forcePlay)
 
 static void mp_nextprev(bool forcePlay, bool next)
 {
-    int oldIdx = mpCurrIdx;
+    int oldIdx;
+
+    if(!mp_checkInit()) return;
 
-    if(!haveMusic) return;
+    mpResTrack = -1;
+    oldIdx = mpCurrIdx;
     
     do {
         if(next) {
@@ -337,35 +518,40 @@ static void mp_nextprev(bool forcePlay, bool next)
     } while(oldIdx != mpCurrIdx);
 }
 
+// Number of song currently playing, -1 if none
+int mp_getCurrentSong()
+{
+    if(!haveMusic || !mpInitDone || !mpActive) return -1;
+
+    return mp_idxToTrack(mpCurrIdx);
+}
+
 int mp_gotonum(int num, bool forcePlay)
 {
-    if(!haveMusic) return 0;
+    if(!mp_checkInit()) return 0;
 
     if(num < 0) num = 0;
     else if(num > maxMusic) num = maxMusic;
 
-    if(mpShuffle) {
-        for(int i = 0; i <= maxMusic; i++) {
-            if(playList[i] == num) {
-                mpCurrIdx = i;
-                break;
-            }
-        }
-    } else 
-        mpCurrIdx = num;
+    mpResTrack = -1;
+
+    mpCurrIdx = mp_trackToIdx(num);
 
     mp_play(forcePlay);
 
-    return playList[mpCurrIdx];
+    return mp_idxToTrack(mpCurrIdx);
 }
 
 static bool mp_play_int(bool force)
 {
     char fnbuf[20];
 
-    mp_buildFileName(fnbuf, playList[mpCurrIdx]);
+    mp_buildFileName(fnbuf, mp_idxToTrack(mpCurrIdx));
     if(SD.exists(fnbuf)) {
-        if(force) play_file(fnbuf, PA_INTRMUS|PA_ALLOWSD|PA_DYNVOL, 1.0);
+        if(force) {
+            play_file(fnbuf, PA_INTRMUS|PA_ALLOWSD|PA_DYNVOL, 1.0);
+            mp_trackStarted(mp_idxToTrack(mpCurrIdx));
+        }
         return true;
     }
     return false;
@@ -376,6 +562,328 @@ static void mp_buildFileName(char *fnbuf, int num)
     sprintf(fnbuf, "/music%1d/%03d.mp3", musFolderNum, num);
 }
 
+static void mpidx_buildName(char *fnbuf, int folder, int num)
+{
+    sprintf(fnbuf, "/music%1d/.%03d.idx", folder, num);
+}
+
+// Length of MPEG layer III frame with header h, 0 if no valid header
+static int mpidx_frameLen(const uint8_t *h, uint16_t *rate, uint16_t *spf)
+{
+    static const uint16_t brV1[16] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 };
+    static const uint16_t brV2[16] = { 0,  8, 16, 24, 32, 40, 48, 56,  64,  80,  96, 112, 128, 144, 160, 0 };
+    static const uint16_t srTab[4] = { 44100, 48000, 32000, 0 };
+    int ver, br, sr;
+
+    if(h[0] != 0xff || (h[1] & 0xe0) != 0xe0)
+        return 0;
+
+    ver = (h[1] >> 3) & 3;      // 3 = MPEG1, 2 = MPEG2, 0 = MPEG2.5
+    if(ver == 1 || ((h[1] >> 1) & 3) != 1)
+        return 0;
+
+    br = (ver == 3) ? brV1[h[2] >> 4] : brV2[h[2] >> 4];
+    sr = srTab[(h[2] >> 2) & 3];
+    if(!br || !sr)
+        return 0;
+    if(ver != 3) sr >>= (ver == 2) ? 1 : 2;
+
+    *rate = sr;
+    *spf = (ver == 3) ? 1152 : 576;
+
+    return ((ver == 3) ? 144000 : 72000) * br / sr + ((h[2] >> 1) & 1);
+}
+
+static bool mpidx_build(uint32_t req)
+{
+    int folder = (req & 0xffff) / 1000;
+    int num = (req & 0xffff) % 1000;
+    char fnbuf[24];
+    MPIdxHeader hdr;
+    File f, idx;
+    uint8_t *buf;
+    uint32_t pos, bufPos = 0, fsize, frames = 0;
+    uint32_t bufLen;
+    uint16_t rate = 0, spf = 0, r, s;
+    int fl = 0;
+    bool ret = false;
+
+    sprintf(fnbuf, "/music%1d/%03d.mp3", folder, num);
+    if(!(f = SD.open(fnbuf, FILE_READ)))
+        return false;
+    fsize = f.size();
+
+    mpidx_buildName(fnbuf, folder, num);
+    if(!(buf = (uint8_t *)malloc(MPIDX_BUFSIZE)) || !(idx = SD.open(fnbuf, FILE_WRITE))) {
+        free(buf);
+        f.close();
+        return false;
+    }
+
+    // Header placeholder; written when done
+    memset(&hdr, 0, sizeof(hdr));
+    idx.write((uint8_t *)&hdr, sizeof(hdr));
+
+    bufLen = f.read(buf, MPIDX_BUFSIZE);
+    pos = (bufLen >= 10) ? skipID3((char *)buf) : 0;
+
+    while(pos + 4 <= fsize && mpIdxReq == req) {
+        if(pos < bufPos || pos + 4 > bufPos + bufLen) {
+            vTaskDelay(pdMS_TO_TICKS(MPIDX_DELAY));
+            bufPos = pos;
+            f.seek(pos);
+            if((bufLen = f.read(buf, MPIDX_BUFSIZE)) < 4)
+                break;
+        }
+        fl = mpidx_frameLen(buf + (pos - bufPos), &r, &s);
+        if(!frames) {
+            // Looking for first frame: Must be followed by another
+            if(!fl || (pos + fl + 4 <= bufPos + bufLen && 
+                       !mpidx_frameLen(buf + (pos + fl - bufPos), &r, &s))) {
+                pos++;
+                continue;
+            }
+            mpidx_frameLen(buf + (pos - bufPos), &rate, &spf);
+        } else if(!fl) {
+            // End of frame chain (eg ID3v1 tag)
+            break;
+        }
+        if(!(frames % MPIDX_STEP)) {
+            if(idx.write((uint8_t *)&pos, 4) != 4)
+                break;
+        }
+        frames++;
+        pos += fl;
+    }
+
+    if(frames && mpIdxReq == req && (pos + 4 > fsize || !fl)) {
+        memcpy(hdr.magic, MPIDX_MAGIC, 4);
+        hdr.version = MPIDX_VERSION;
+        hdr.step = MPIDX_STEP;
+        hdr.fileSize = fsize;
+        hdr.numFrames = frames;
+        hdr.sampleRate = rate;
+        hdr.frameSamples = spf;
+        hdr.idxCount = (frames + MPIDX_STEP - 1) / MPIDX_STEP;
+        ret = idx.seek(0) && (idx.write((uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr));
+    }
+
+    idx.close();
+    f.close();
+    free(buf);
+
+    if(!ret) {
+        SD.remove(fnbuf);
+    }
+
+    #ifdef FC_DBG
+    Serial.printf("MusicPlayer: Index for %s %s (%d frames)\n", fnbuf, ret ? "built" : "failed", frames);
+    #endif
+
+    return ret;
+}
+
+static void mpidx_task(void *param)
+{
+    uint32_t req, done = 0;
+
+    for(;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while((req = mpIdxReq) != done) {
+            if(mpidx_build(req)) {
+                mpIdxBuilt = req;
+            }
+            done = req;
+        }
+    }
+}
+
+static void mpidx_request(int track)
+{
+    if(!mpIdxTask) {
+        if(xTaskCreatePinnedToCore(mpidx_task, "fcMPIdx", MPIDX_TASK_STACK, NULL, 1, &mpIdxTask, 0) != pdPASS) {
+            mpIdxTask = NULL;
+            return;
+        }
+    }
+
+    mpIdxReq = ((uint32_t)++mpIdxSeq << 16) | track;
+    xTaskNotifyGive(mpIdxTask);
+}
+
+static bool mpidx_load(int track)
+{
+    char fnbuf[24];
+    File f;
+    uint32_t fsize = 0;
+    bool ret = false;
+
+    sprintf(fnbuf, "/music%1d/%03d.mp3", track / 1000, track % 1000);
+    if((f = SD.open(fnbuf, FILE_READ))) {
+        fsize = f.size();
+        f.close();
+    }
+
+    mpidx_buildName(fnbuf, track / 1000, track % 1000);
+    if(fsize && (f = SD.open(fnbuf, FILE_READ))) {
+        if(f.read((uint8_t *)&mpIdx, sizeof(mpIdx)) == sizeof(mpIdx)      &&
+           !memcmp(mpIdx.magic, MPIDX_MAGIC, 4)                           &&
+           mpIdx.version == MPIDX_VERSION && mpIdx.step == MPIDX_STEP     &&
+           mpIdx.fileSize == fsize && mpIdx.numFrames && mpIdx.sampleRate &&
+           mpIdx.idxCount == (mpIdx.numFrames + MPIDX_STEP - 1) / MPIDX_STEP) {
+            ret = true;
+        }
+        f.close();
+    }
+
+    return ret;
+}
+
+// Load index of current track if built meanwhile
+static bool mpidx_check()
+{
+    if(!mpIdxValid && mpIdxTrack >= 0 && (mpIdxBuilt & 0xffff) == mpIdxTrack) {
+        mpIdxBuilt = 0;
+        mpIdxValid = mpidx_load(mpIdxTrack);
+    }
+    return mpIdxValid;
+}
+
+// File offset of frame, using the index of the current track
+static bool mpidx_framePos(uint32_t frame, uint32_t& pos)
+{
+    char fnbuf[24];
+    File f;
+    uint8_t h[4];
+    uint16_t r, s;
+    int fl;
+
+    mpidx_buildName(fnbuf, mpIdxTrack / 1000, mpIdxTrack % 1000);
+    if(!(f = SD.open(fnbuf, FILE_READ)))
+        return false;
+    f.seek(sizeof(MPIdxHeader) + (frame / MPIDX_STEP) * 4);
+    fl = f.read((uint8_t *)&pos, 4);
+    f.close();
+    if(fl != 4)
+        return false;
+
+    // Walk remaining frames from indexed one
+    if((frame %= MPIDX_STEP)) {
+        mp_buildFileName(fnbuf, mpIdxTrack % 1000);
+        if(!(f = SD.open(fnbuf, FILE_READ)))
+            return false;
+        while(frame--) {
+            f.seek(pos);
+            if(f.read(h, 4) != 4 || !(fl = mpidx_frameLen(h, &r, &s))) {
+                f.close();
+                return false;
+            }
+            pos += fl;
+        }
+        f.close();
+    }
+
+    return true;
+}
+
+static void mp_trackStarted(int num)
+{
+    mpIdxTrack = musFolderNum * 1000 + num;
+    mpStartFrame = 0;
+    mpSampleBase = out->GetSamplesOut();
+    
+    if(!(mpIdxValid = mpidx_load(mpIdxTrack))) {
+        mpidx_request(mpIdxTrack);
+    }
+
+    // Seek is done from mp_loop(), once we are playing
+    // and the index is available
+    mpSeekPending = (num == mpResTrack && mpResFrame) ? mpResFrame : -1;
+    mpResTrack = -1;
+    mpCkptNow = millis();
+}
+
+static void mp_checkpoint()
+{
+    int frame = (mpSeekPending >= 0) ? mpSeekPending : mp_getCurrentFrame();
+
+    if(frame >= 0) {
+        saveMusPos(mp_idxToTrack(mpCurrIdx), frame, mpShuffle ? mpSeed : 0);
+    }
+    mpCkptNow = millis();
+}
+
+// Called from audio_loop() while music is playing
+static void mp_loop()
+{
+    if(mpSeekPending >= 0 && mpidx_check()) {
+        mp_seekFrame(mpSeekPending);
+        mpSeekPending = -1;
+    }
+
+    if(millis() - mpCkptNow >= MP_CKPT_INT) {
+        mp_checkpoint();
+    }
+}
+
+// Current frame of current track, -1 if not playing
+int mp_getCurrentFrame()
+{
+    if(mp_getCurrentSong() < 0) return -1;
+
+    return mpStartFrame + (out->GetSamplesOut() - mpSampleBase) / 
+                          ((mpidx_check() && mpIdx.frameSamples) ? mpIdx.frameSamples : 1152);
+}
+
+// Duration of current track in seconds, -1 if unknown/not playing
+int mp_getCurrentDuration()
+{
+    if(mp_getCurrentSong() < 0 || !mpidx_check()) return -1;
+
+    return ((uint64_t)mpIdx.numFrames * mpIdx.frameSamples + mpIdx.sampleRate / 2) / mpIdx.sampleRate;
+}
+
+// Seek to frame in current track; requires the track's index
+bool mp_seekFrame(uint32_t frame)
+{
+    uint32_t pos;
+
+    if(mp_getCurrentSong() < 0 || !mp3->isRunning() || !mpidx_check())
+        return false;
+
+    if(frame >= mpIdx.numFrames)
+        frame = mpIdx.numFrames - 1;
+
+    if(!mpidx_framePos(frame, pos) || !mySD0L->seek(pos, SEEK_SET))
+        return false;
+
+    // Discard what the decoder has buffered
+    mp3->desync();
+
+    mpStartFrame = frame;
+    mpSampleBase = out->GetSamplesOut();
+
+    #ifdef FC_DBG
+    Serial.printf("MusicPlayer: Seeked to frame %d (pos %d)\n", frame, pos);
+    #endif
+
+    return true;
+}
+
+// Skip forward/backward in current track
+bool mp_skip(int seconds)
+{
+    int frame = mp_getCurrentFrame();
+
+    if(frame < 0 || !mpidx_check())
+        return false;
+
+    frame += seconds * (int)mpIdx.sampleRate / (int)mpIdx.frameSamples;
+
+    return mp_seekFrame(frame < 0 ? 0 : frame);
+}
+
 int mp_checkForFolder(int num)
 {
     char fnbuf[32];
@@ -786,6 +1294,10 @@ void append_flux()
  */
 void audio_loop()
 {   
+    if(useVKnob) {
+        volPot.scan();
+    }
+
     if(mp3->isRunning()) {
         if(!mp3->loop()) {
             mp3->stop();
@@ -794,12 +1306,24 @@ void audio_loop()
             } else if(mpActive) {
                 mp_next(true);
             }
+            return;
+        } 
+        // The DMA reports running dry through the driver's event
+        // queue. Events from before playback started (the DMA
+        // runs dry while idle) are discarded.
+        if(audioPrimed) {
+            audioUnderruns += out->GetUnderruns();
         } else {
-            sampleCnt++;
-            if(sampleCnt > 1) {
-                if(dynVol) out->SetGain(getVolume());
-                sampleCnt = 0;
-            }
+            out->GetUnderruns();
+            audioPrimed = true;
+        }
+        if(mpActive) {
+            mp_loop();
+        }
+        if(dynVol && (millis() - volChkNow >= VOL_CHK_INT)) {
+            // Output ramps towards new gain, so no need to check more often
+            out->SetGainQ15(getVolume());
+            volChkNow = millis();
         }
     } else if(appendFile) {
         play_file(append_audio_file, append_flags, append_vol);
@@ -867,12 +1391,17 @@ void play_file(const char *audio_file, uint16_t flags, float volumeFactor)
         mp3->stop();
     }
 
-    curVolFact = volumeFactor;
+    curVolFact = (uint32_t)(volumeFactor * GAIN_ONE);
     dynVol     = (flags & PA_DYNVOL) ? true : false;
 
     playingFlux = (flags & PA_ISFLUX) ? true : false;
     
-    out->SetGain(getVolume());
+    out->SetGainQ15(getVolume(), true);
+    volChkNow = millis();
+    audioPrimed = false;
+
+    // Low-priority effects need no full bandwidth; spare the CPU
+    mp3->SetHalfRate((flags & PA_HALFRT) ? true : false);
 
     buf[0] = 0;
 
@@ -888,6 +1417,15 @@ void play_file(const char *audio_file, uint16_t flags, float volumeFactor)
         #ifdef FC_DBG
         Serial.println(F("Playing from SD"));
         #endif
+    } else if(haveBank && myBank->open(audio_file)) {
+        // Bank data has no ID3 tags, no need to skip
+        myBank->setPlayLoop((flags & PA_LOOP));
+
+        mp3->begin(myBank, out);
+
+        #ifdef FC_DBG
+        Serial.println(F("Playing from sound bank"));
+        #endif
     }
     #ifdef USE_SPIFFS
       else if(haveFS && SPIFFS.exists(audio_file) && myFS0L->open(audio_file))
@@ -929,74 +1467,30 @@ void dec_vol()
     curSoftVol--;
 }
 
-// Returns value for volume based on the position of the pot
-// Since the values vary we do some noise reduction
-static float getRawVolume()
+// Returns Q15 gain based on the position of the pot
+static uint32_t getRawVolume()
 {
-    float vol_val;
-    long avg = 0, avg1 = 0, avg2 = 0;
-    long raw;
-
-    raw = analogRead(VOLUME_PIN);
-
-    if(anaReadCount > 1) {
-      
-        rawVol[rawVolIdx] = raw;
-
-        if(anaReadCount < VOL_SMOOTH_SIZE) {
-        
-            avg = 0;
-            for(int i = rawVolIdx; i > rawVolIdx - anaReadCount; i--) {
-                avg += rawVol[i & (VOL_SMOOTH_SIZE-1)];
-            }
-            avg /= anaReadCount;
-            anaReadCount++;
-
-        } else {
-
-            for(int i = rawVolIdx; i > rawVolIdx - anaReadCount; i--) {
-                if(i & 1) { 
-                    avg1 += rawVol[i & (VOL_SMOOTH_SIZE-1)];
-                } else {
-                    avg2 += rawVol[i & (VOL_SMOOTH_SIZE-1)];
-                }
-            }
-            avg1 = round((float)avg1 / (float)(VOL_SMOOTH_SIZE/2));
-            avg2 = round((float)avg2 / (float)(VOL_SMOOTH_SIZE/2));
-            avg = (abs(avg1-prev_avg) < abs(avg2-prev_avg)) ? avg1 : avg2;
-
-            /*
-            Serial.printf("%d %d %d %d\n", raw, avg1, avg2, avg);
-            */
-            
-            prev_avg = avg;
-        }
-        
+    uint32_t vol_val, pos, idx;
+    uint16_t avg = volPot.value();
+
+    // Interpolate along volume curve
+    pos = avg * 19;
+    idx = pos / POT_MAX;
+    if(idx >= 19) {
+        vol_val = volTable[19];
     } else {
-      
-        anaReadCount++;
-        rawVol[rawVolIdx] = avg = prev_avg = prev_raw = prev_raw2 = raw;
-        
+        vol_val = volTable[idx] +
+                  (volTable[idx+1] - volTable[idx]) * (pos % POT_MAX) / POT_MAX;
     }
 
-    rawVolIdx++;
-    rawVolIdx &= (VOL_SMOOTH_SIZE-1);
-
-    vol_val = (float)avg / (float)((1<<POT_RESOLUTION)-1);
-
-    if((raw + prev_raw + prev_raw2 > 0) && vol_val < 0.01) vol_val = 0.01;
-
-    prev_raw2 = prev_raw;
-    prev_raw = raw;
-
-    //Serial.println(vol_val);
+    if(avg && vol_val < GAIN_MIN/2) vol_val = GAIN_MIN/2;
 
     return vol_val;
 }
 
-static float getVolume()
+static uint32_t getVolume()
 {
-    float vol_val;
+    uint32_t vol_val;
 
     if(useVKnob) {
         vol_val = getRawVolume();
@@ -1005,19 +1499,35 @@ static float getVolume()
     }
 
     // If user muted, return 0
-    if(vol_val == 0.0) return vol_val;
+    if(!vol_val) return vol_val;
 
-    vol_val *= curVolFact;
+    vol_val = (vol_val * curVolFact) >> 15;
 
-    if(fluxNM) vol_val *= 0.3;
+    if(fluxNM) vol_val = (vol_val * GAIN_NM) >> 15;
       
     // Do not totally mute
-    // 0.02 is the lowest audible gain
-    if(vol_val < 0.02) vol_val = 0.02;
+    if(vol_val < GAIN_MIN) vol_val = GAIN_MIN;
 
     return vol_val;
 }
 
+/*
+ * Close sound bank (before it is replaced by the installer)
+ */
+void audio_closeBank()
+{
+    if(haveBank && mp3->isRunning()) {
+        mp3->stop();
+    }
+    myBank->end();
+    haveBank = false;
+
+    if(bankMapped) {
+        spi_flash_munmap(bankMapHandle);
+        bankMapped = false;
+    }
+}
+
 bool checkAudioDone()
 {
     if(mp3->isRunning()) return false;
@@ -1037,3 +1547,17 @@ bool append_pending()
 {
     return appendFile;
 }
+
+// Volume setting (knob or soft) in percent
+int getVolumePercent()
+{
+    if(useVKnob) {
+        return volPot.value() * 100 / POT_MAX;
+    }
+    return curSoftVol * 100 / 19;
+}
+
+uint32_t audio_getUnderruns()
+{
+    return audioUnderruns;
+}
@@ -51,6 +51,9 @@ void append_file(const char *audio_file, uint16_t flags, float volumeFactor = 1.
 bool checkAudioDone();
 void stopAudio();
 bool append_pending();
+int  getVolumePercent();
+uint32_t audio_getUnderruns();
+void audio_closeBank();
 
 void play_flux();
 void append_flux();
@@ -64,16 +67,29 @@ bool mp_stop();
 void mp_next(bool forcePlay = false);
 void mp_prev(bool forcePlay = false);
 int  mp_gotonum(int num, bool force = false);
+int  mp_getCurrentSong();
+int  mp_getCurrentFrame();
+int  mp_getCurrentDuration();
+bool mp_seekFrame(uint32_t frame);
+bool mp_skip(int seconds);
 void mp_makeShuffle(bool enable);
 int  mp_checkForFolder(int num);
 
 // Default volume (index)
 #define DEFAULT_VOLUME 6
 
+// Music player: Seconds to skip on MP_FWD/MP_REW
+#define MP_SKIP_SECS 10
+
+// Packed sound bank (sound partition or flash FS)
+#define SND_PART_NAME "fcsnd"
+#define SND_BANK_NAME "/fcsnd.bin"
+
 #define PA_LOOP    0x0001
 #define PA_INTRMUS 0x0002
 #define PA_ALLOWSD 0x0004
 #define PA_DYNVOL  0x0008
 #define PA_ISFLUX  0x0010
+#define PA_HALFRT  0x0020   // Synthesize at half sample rate (spoken digits etc)
 
 #endif
@@ -0,0 +1,71 @@
+/*
+ * -------------------------------------------------------------------
+ * CircuitSetup.us Flux Capacitor
+ * (C) 2023 Thomas Winischhofer (A10001986)
+ * https://github.com/realA10001986/Flux-Capacitor
+ * http://fc.backtothefutu.re
+ *
+ * BTTF network packet format
+ *
+ * -------------------------------------------------------------------
+ * License: MIT
+ * 
+ * Permission is hereby granted, free of charge, to any person 
+ * obtaining a copy of this software and associated documentation 
+ * files (the "Software"), to deal in the Software without restriction, 
+ * including without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell copies of the 
+ * Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY 
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "fc_bttfn.h"
+
+const uint8_t BTTFUDPHD[4] = { 'B', 'T', 'T', 'F' };
+
+uint8_t BTTFNChecksum(const BTTFNPacket *pkt)
+{
+    const uint8_t *buf = (const uint8_t *)pkt;
+    uint8_t a = 0;
+    
+    for(int i = 4; i < BTTF_PACKET_SIZE - 1; i++) {
+        a += buf[i] ^ 0x55;
+    }
+    
+    return a;
+}
+
+// Copy packet to pkt, return true if valid
+bool BTTFNValidate(const uint8_t *buf, size_t len, BTTFNPacket *pkt)
+{
+    if(len < BTTF_PACKET_SIZE)
+        return false;
+
+    // Cheap checks first
+    if(memcmp(buf, BTTFUDPHD, 4))
+        return false;
+
+    memcpy((void *)pkt, buf, BTTF_PACKET_SIZE);
+
+    if(pkt->ver != (BTTFN_VERSION | BTTFN_VER_NOT) &&
+       pkt->ver != (BTTFN_VERSION | BTTFN_VER_RESP))
+        return false;
+
+    if(pkt->csum != BTTFNChecksum(pkt))
+        return false;
+
+    return true;
+}
@@ -0,0 +1,114 @@
+/*
+ * -------------------------------------------------------------------
+ * CircuitSetup.us Flux Capacitor
+ * (C) 2023 Thomas Winischhofer (A10001986)
+ * https://github.com/realA10001986/Flux-Capacitor
+ * http://fc.backtothefutu.re
+ *
+ * BTTF network packet format
+ *
+ * -------------------------------------------------------------------
+ * License: MIT
+ * 
+ * Permission is hereby granted, free of charge, to any person 
+ * obtaining a copy of this software and associated documentation 
+ * files (the "Software"), to deal in the Software without restriction, 
+ * including without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell copies of the 
+ * Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY 
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _FC_BTTFN_H
+#define _FC_BTTFN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BTTFN_VERSION              1
+#define BTTF_PACKET_SIZE          48
+#define BTTF_DEFAULT_LOCAL_PORT 1338
+#define BTTFN_NOT_PREPARE  1
+#define BTTFN_NOT_TT       2
+#define BTTFN_NOT_REENTRY  3
+#define BTTFN_NOT_ABORT_TT 4
+#define BTTFN_NOT_ALARM    5
+#define BTTFN_NOT_REFILL   6
+#define BTTFN_NOT_FLUX_CMD 7
+#define BTTFN_NOT_SID_CMD  8
+#define BTTFN_NOT_PCG_CMD  9
+#define BTTFN_TYPE_ANY     0    // Any, unknown or no device
+#define BTTFN_TYPE_FLUX    1    // Flux Capacitor
+#define BTTFN_TYPE_SID     2    // SID
+#define BTTFN_TYPE_PCG     3    // Plutonium chamber gauge panel
+#define BTTFN_VER_NOT      0x40   // ver: Notification from TCD
+#define BTTFN_VER_RESP     0x80   // ver: Response from TCD
+#define BTTFN_REQ_SPD      0x02   // req/resp: GPS speed
+#define BTTFN_REQ_STATUS   0x10   // req/resp: NM/FPO status
+#define BTTFN_REQ_IP       0x20   // req/resp: IP of device type
+#define BTTFN_STA_NM       0x01   // status: Night mode
+#define BTTFN_STA_FPO      0x02   // status: Fake power off
+
+// Packet layout. Multi-byte values are little endian and
+// stored as byte arrays; use bttfnGet16/32() to read them.
+typedef struct __attribute__((packed)) {
+    uint8_t hdr[4];               //  0 "BTTF"
+    uint8_t ver;                  //  4 Version | BTTFN_VER_xxx
+    uint8_t req;                  //  5 Req/resp flags, or notification
+    uint8_t id[4];                //  6 Request ID, or notification payload
+    union {
+        struct __attribute__((packed)) {
+            char    hostName[13]; // 10 0-terminated
+            uint8_t devType;      // 23
+            uint8_t ipType;       // 24 Device type for BTTFN_REQ_IP
+            uint8_t res[22];
+        } rq;
+        struct __attribute__((packed)) {
+            uint8_t dateTime[8];  // 10
+            uint8_t gpsSpeed[2];  // 18
+            uint8_t res1[6];
+            uint8_t status;       // 26 BTTFN_STA_xxx
+            uint8_t ip[4];        // 27
+            uint8_t res2[16];
+        } rs;
+    };
+    uint8_t csum;                 // 47
+} BTTFNPacket;
+
+static_assert(sizeof(BTTFNPacket) == BTTF_PACKET_SIZE, "BTTFNPacket size mismatch");
+static_assert(offsetof(BTTFNPacket, rq.devType) == 23, "BTTFNPacket layout mismatch");
+static_assert(offsetof(BTTFNPacket, rs.gpsSpeed) == 18, "BTTFNPacket layout mismatch");
+static_assert(offsetof(BTTFNPacket, rs.status) == 26, "BTTFNPacket layout mismatch");
+
+static inline uint16_t bttfnGet16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t bttfnGet32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void bttfnPut32(uint8_t *p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+extern const uint8_t BTTFUDPHD[4];
+
+uint8_t BTTFNChecksum(const BTTFNPacket *pkt);
+bool    BTTFNValidate(const uint8_t *buf, size_t len, BTTFNPacket *pkt);
+
+#endif
@@ -37,6 +37,12 @@
 // Uncomment for HomeAssistant MQTT protocol support
 #define FC_HAVEMQTT
 
+// Uncomment for HTTP API (state, metrics and commands via
+// http://hostname:API_PORT/api/...); must be enabled in the
+// Config Portal, too.
+#define FC_HAVEAPI
+#define API_PORT 8080
+
 // --- end of config options
 
 /*************************************************************************
@@ -34,6 +34,7 @@
 
 #include <Arduino.h>
 #include <WiFi.h>
+#include <AsyncUDP.h>
 #include "fcdisplay.h"
 #include "input.h"
 
@@ -41,6 +42,7 @@
 #include "fc_settings.h"
 #include "fc_audio.h"
 #include "fc_wifi.h"
+#include "fc_bttfn.h"
 
 unsigned long powerupMillis = 0;
 
@@ -56,14 +58,7 @@ unsigned long powerupMillis = 0;
 
 // Speed pot
 static bool useSKnob = false;
-static unsigned long startSpdPot = 0;
-#define SPD_SMOOTH_SIZE 4
-static int rawSpd[SPD_SMOOTH_SIZE];
-static int rawSpdIdx = 0;
-static int anaReadCount = 0;
-static long prev_avg, prev_raw, prev_raw2;
-// Resolution for speed pot, 9-12 allowed
-#define POT_RESOLUTION 9
+static FCPot spdPot(SPEED_PIN);
 #define POT_GRAN       45
 static const uint16_t potSpeeds[POT_GRAN] = {
       1,   2,   3,   4,   5,   6,   7,   8,   9,  10,
@@ -107,6 +102,7 @@ bool networkReentry    = false;
 bool networkAbort      = false;
 bool networkAlarm      = false;
 uint16_t networkLead   = ETTO_LEAD;
+unsigned long networkLeadNow = 0;
 
 static bool useGPSS     = false;
 static bool usingGPSS   = false;
@@ -119,6 +115,7 @@ bool        fluxNM = false;
 static bool useFPO = false;
 static bool tcdFPO = false;
 static bool wait4FPOn = true;
+static bool bootWaitWiFi = false;
 
 static bool skipttblanim = false;
 
@@ -193,6 +190,7 @@ static bool          ssActive = false;
 
 static bool          nmOld = false;
 static bool          fpoOld = false;
+static bool          fpoMusic = false;      // Music was playing at fake power off
 bool                 FPBUnitIsOn = true;
 
 /*
@@ -245,28 +243,37 @@ static bool          IRLearnBlink = false;
 uint16_t lastIRspeed = FC_SPD_IDLE;
 
 // BTTF network
-#define BTTFN_VERSION              1
-#define BTTF_PACKET_SIZE          48
-#define BTTF_DEFAULT_LOCAL_PORT 1338
-#define BTTFN_NOT_PREPARE  1
-#define BTTFN_NOT_TT       2
-#define BTTFN_NOT_REENTRY  3
-#define BTTFN_NOT_ABORT_TT 4
-#define BTTFN_NOT_ALARM    5
-#define BTTFN_NOT_REFILL   6
-#define BTTFN_NOT_FLUX_CMD 7
-#define BTTFN_NOT_SID_CMD  8
-#define BTTFN_NOT_PCG_CMD  9
-#define BTTFN_TYPE_ANY     0    // Any, unknown or no device
-#define BTTFN_TYPE_FLUX    1    // Flux Capacitor
-#define BTTFN_TYPE_SID     2    // SID
-#define BTTFN_TYPE_PCG     3    // Plutonium chamber gauge panel
-static const uint8_t BTTFUDPHD[4] = { 'B', 'T', 'T', 'F' };
 static bool          useBTTFN = false;
-static WiFiUDP       bttfUDP;
-static UDP*          fcUDP;
-static byte          BTTFUDPBuf[BTTF_PACKET_SIZE];
+static AsyncUDP      bttfUDP;
+static IPAddress     bttfnTcdIP;
+static BTTFNPacket   BTTFUDPPkt;
+// Receive queue: Filled by AsyncUDP task, emptied by bttfn_loop()
+#define BTTFN_RXQ_SIZE 8    // Must be power of 2
+static struct {
+    BTTFNPacket   pkt;
+    unsigned long rxNow;    // Arrival time
+} BTTFNRxQ[BTTFN_RXQ_SIZE];
+static uint8_t       BTTFNRxHead = 0;   // Written by UDP task only
+static uint8_t       BTTFNRxTail = 0;   // Written by main loop only
+// Round trip time estimate (RFC 6298 style), for telemetry,
+// and minimum over the last samples, used to estimate how
+// long notifications took to reach us
+#define BTTFN_RTT_WIN 16
+static bool          BTTFNHaveRTT = false;
+static int32_t       BTTFNsrtt8 = 0;    // Smoothed RTT, ms * 8
+static int32_t       BTTFNrttvar4 = 0;  // RTT variation, ms * 4
+static uint16_t      BTTFNrttWin[BTTFN_RTT_WIN];
+static uint8_t       BTTFNrttIdx = 0;
+static uint8_t       BTTFNrttCnt = 0;
+static uint16_t      BTTFNminRTT = 0;
 static unsigned long BTTFNUpdateNow = 0;
+// Status poll interval: Backs off while nothing changes,
+// tightens during TT. Status changes are not pushed, so
+// BTTFN_POLL_INT_MAX bounds how late NM/FPO are noticed.
+#define BTTFN_POLL_INT_TT   500
+#define BTTFN_POLL_INT     1100
+#define BTTFN_POLL_INT_MAX 2200
+static unsigned long BTTFNPollInt = BTTFN_POLL_INT;
 static unsigned long BTFNTSAge = 0;
 static unsigned long BTTFNTSRQAge = 0;
 static bool          BTTFNPacketDue = false;
@@ -279,6 +286,36 @@ static bool          BTTFNBootTO = false;
 static int      iCmdIdx = 0;
 static int      oCmdIdx = 0;
 static uint32_t commandQueue[16] = { 0 };
+static bool     commandIsUser[16];    // From MQTT/API, see queueCommand()
+static portMUX_TYPE cmdMux = portMUX_INITIALIZER_UNLOCKED;   // Producers: main, BTTFN (UDP task), API task
+
+// Commands not reachable by IR (which has max 6 digits)
+#define FCCMD_INT_BASE  1000000
+#define FCCMD_TT        (FCCMD_INT_BASE + 1)
+#define FCCMD_MP_PLAY   (FCCMD_INT_BASE + 2)
+#define FCCMD_MP_STOP   (FCCMD_INT_BASE + 3)
+#define FCCMD_MP_FWD    (FCCMD_INT_BASE + 4)
+#define FCCMD_MP_REW    (FCCMD_INT_BASE + 5)
+
+// Command registry: Named commands and their codes, as 
+// executed by handleRemoteCommand() for IR, BTTFN and MQTT 
+// alike. Must be kept sorted by name (binary search)!
+static const FCCmdName cmdNames[] = {
+    { "FLUX_30",        22 },             // *22
+    { "FLUX_60",        23 },             // *23
+    { "FLUX_OFF",       20 },             // *20
+    { "FLUX_ON",        21 },             // *21
+    { "MP_FWD",         FCCMD_MP_FWD },
+    { "MP_NEXT",        8 },              // key 8
+    { "MP_PLAY",        FCCMD_MP_PLAY },
+    { "MP_PREV",        2 },              // key 2
+    { "MP_REW",         FCCMD_MP_REW },
+    { "MP_SHUFFLE_OFF", 222 },            // *222
+    { "MP_SHUFFLE_ON",  555 },            // *555
+    { "MP_STOP",        FCCMD_MP_STOP },
+    { "TIMETRAVEL",     FCCMD_TT }
+};
+#define NUM_CMD_NAMES (sizeof(cmdNames) / sizeof(cmdNames[0]))
 
 // Forward declarations ------
 
@@ -288,14 +325,15 @@ static void handleIRinput();
 static void handleIRKey(int command);
 static void handleRemoteCommand();
 static bool execute(bool isIR);
+static void executeInt(uint32_t command);
 static void startIRfeedback();
 static void endIRfeedback();
 
-static uint16_t getRawSpeed();
 static void     setPotSpeed();
 
 static void timeTravel(bool TCDtriggered, uint16_t P0Dur);
 
+static void setupTTKey();
 static void ttkeyScan();
 static void TTKeyPressed();
 static void TTKeyHeld();
@@ -309,9 +347,34 @@ static bool contFlux();
 static void waitAudioDone(bool withIR);
 
 static void bttfn_setup();
+static void bttfn_restart();
 static void BTTFNCheckPacket();
 static bool BTTFNTriggerUpdate();
 static void BTTFNSendPacket();
+static void BTTFNOnPacket(AsyncUDPPacket& packet);
+static void BTTFNHandlePacket(const BTTFNPacket *pkt, unsigned long rxNow);
+static void BTTFNUpdateRTT(unsigned long rtt);
+static unsigned long BTTFNDelay();
+static void BTTFNNotPrepare(const BTTFNPacket *pkt, unsigned long rxNow);
+static void BTTFNNotTT(const BTTFNPacket *pkt, unsigned long rxNow);
+static void BTTFNNotReentry(const BTTFNPacket *pkt, unsigned long rxNow);
+static void BTTFNNotAbort(const BTTFNPacket *pkt, unsigned long rxNow);
+static void BTTFNNotAlarm(const BTTFNPacket *pkt, unsigned long rxNow);
+static void BTTFNNotFluxCmd(const BTTFNPacket *pkt, unsigned long rxNow);
+
+// Notification handlers, indexed by notification type
+static void (* const BTTFNNotHandlers[])(const BTTFNPacket *pkt, unsigned long rxNow) = {
+    NULL,                 // 0
+    BTTFNNotPrepare,      // BTTFN_NOT_PREPARE
+    BTTFNNotTT,           // BTTFN_NOT_TT
+    BTTFNNotReentry,      // BTTFN_NOT_REENTRY
+    BTTFNNotAbort,        // BTTFN_NOT_ABORT_TT
+    BTTFNNotAlarm,        // BTTFN_NOT_ALARM
+    NULL,                 // BTTFN_NOT_REFILL
+    BTTFNNotFluxCmd       // BTTFN_NOT_FLUX_CMD
+                          // SID_CMD, PCG_CMD not for us
+};
+#define BTTFN_NUM_HANDLERS (sizeof(BTTFNNotHandlers) / sizeof(BTTFNNotHandlers[0]))
 
 void main_boot()
 {
@@ -339,21 +402,20 @@ void main_setup()
     loadIRLock();
 
     // Set up options to play/mute sounds
-    playFLUX = atoi(settings.playFLUXsnd);
-    playTTsounds = (atoi(settings.playTTsnds) > 0);
+    playFLUX = settingsVal.playFLUXsnd;
+    playTTsounds = (settingsVal.playTTsnds > 0);
 
     // Other options
-    ssDelay = ssOrigDelay = atoi(settings.ssTimer) * 60 * 1000;    
-    useGPSS = (atoi(settings.useGPSS) > 0);
-    useNM = (atoi(settings.useNM) > 0);
-    useFPO = (atoi(settings.useFPO) > 0);
-    wait4FPOn = (atoi(settings.wait4FPOn) > 0);
+    ssDelay = ssOrigDelay = settingsVal.ssTimer * 60 * 1000;    
+    useGPSS = (settingsVal.useGPSS > 0);
+    useNM = (settingsVal.useNM > 0);
+    useFPO = (settingsVal.useFPO > 0);
+    wait4FPOn = (settingsVal.wait4FPOn > 0);
     
-    skipttblanim = (atoi(settings.skipTTBLAnim) > 0);
+    skipttblanim = (settingsVal.skipTTBLAnim > 0);
 
     // Option to disable supplied default IR remote
-    if((atoi(settings.disDIR) > 0)) 
-        maxIRctrls--;
+    maxIRctrls = (settingsVal.disDIR > 0) ? NUM_REM_TYPES - 1 : NUM_REM_TYPES;
 
     // Initialize flux sound modes
     if(playFLUX >= 3) {
@@ -362,14 +424,8 @@ void main_setup()
     } else if(playFLUX == 2) 
         fluxTimeout = FLUXM2_SECS*1000;
     
-    // Start the Config Portal. A WiFiScan does not
-    // disturb anything at this point.
-    if(WiFi.status() == WL_CONNECTED) {
-        wifiStartCP();
-    }
-
     // Swap "box light" <> "GPIO14"
-    PLforBL = (atoi(settings.usePLforBL) > 0);
+    PLforBL = (settingsVal.usePLforBL > 0);
     // As long as we "abuse" the GPIO14 for the IR feedback,
     // swap it for box light as well
     #if IR_FB_PIN == GPIO_14
@@ -378,8 +434,8 @@ void main_setup()
 
     // Determine if Time Circuits Display is connected
     // via wire, and is source of GPIO tt trigger
-    TCDconnected = (atoi(settings.TCDpresent) > 0);
-    noETTOLead = (atoi(settings.noETTOLead) > 0);
+    TCDconnected = (settingsVal.TCDpresent > 0);
+    noETTOLead = (settingsVal.noETTOLead > 0);
 
     // Init IR feedback LED
     pinMode(IRFeedBackPin, OUTPUT);
@@ -393,28 +449,13 @@ void main_setup()
 
     // Set up TT button / TCD trigger
     TTKey.attachPress(TTKeyPressed);
-    if(!TCDconnected) {
-        // If we have a physical button, we need
-        // reasonable values for debounce and press
-        TTKey.setDebounceTicks(TT_DEBOUNCE);
-        TTKey.setPressTicks(TT_PRESS_TIME);
-        TTKey.setLongPressTicks(TT_HOLD_TIME);
-        TTKey.attachLongPressStart(TTKeyHeld);
-    } else {
-        // If the TCD is connected, we can go more to the edge
-        TTKey.setDebounceTicks(5);
-        TTKey.setPressTicks(50);
-        TTKey.setLongPressTicks(100000);
-        // Long press ignored when TCD is connected
-        // IRLearning only possible if TCD is not connected!
-    }
+    setupTTKey();
 
     // Power-up use of speed pot
-    useSKnob = (atoi(settings.useSknob) > 0);
+    useSKnob = (settingsVal.useSknob > 0);
     
-    // Set resolution for speed pot
-    analogReadResolution(POT_RESOLUTION);
-    analogSetWidth(POT_RESOLUTION);
+    // Speed pot
+    spdPot.begin();
 
     // Invoke audio file installer if SD content qualifies
     #ifdef FC_DBG
@@ -457,9 +498,14 @@ void main_setup()
     bttfn_setup();
 
     // If "Follow TCD fake power" is set,
-    // stay silent and dark
+    // stay silent and dark. If WiFi is still
+    // connecting, assume it will succeed; 
+    // main_loop() boots the FC if not.
 
-    if(useBTTFN && useFPO && wait4FPOn && (WiFi.status() == WL_CONNECTED)) {
+    if(useBTTFN && useFPO && wait4FPOn && 
+       (wifiSetupDone ? (WiFi.status() == WL_CONNECTED) : wifiHaveSTAConf)) {
+
+        bootWaitWiFi = !wifiSetupDone;
 
         FPBUnitIsOn = false;
         tcdFPO = fpoOld = true;
@@ -484,9 +530,12 @@ void main_setup()
     
         // Set minimum box light level
         boxLED.setDC(mbllArray[minBLL]);
+
+        Serial.printf("Boot: First light after %lums\n", millis() - powerupMillis);
     
         // Play startup
         play_file("/startup.mp3", PA_INTRMUS|PA_ALLOWSD, 1.0);
+        Serial.printf("Boot: Startup sound after %lums\n", millis() - powerupMillis);
         if(playFLUX) {
             append_flux();
         }
@@ -499,6 +548,7 @@ void main_setup()
         ssRestartTimer();
 
     }
+
     
     #ifdef FC_DBG
     Serial.println(F("main_setup() done"));
@@ -513,6 +563,15 @@ void main_loop()
 {
     unsigned long now = millis();
 
+    // If we waited for fake power on while WiFi was still
+    // connecting at boot, and WiFi failed, boot up now
+    if(bootWaitWiFi && wifiSetupDone) {
+        bootWaitWiFi = false;
+        if(WiFi.status() != WL_CONNECTED) {
+            tcdFPO = false;
+        }
+    }
+
     // Follow TCD fake power
     if(useFPO && (tcdFPO != fpoOld)) {
         if(tcdFPO) {
@@ -524,7 +583,7 @@ void main_loop()
             }
             TTrunning = false;
             
-            mp_stop();
+            fpoMusic = mp_stop();
             stopAudio();
             fluxTimer = false;
 
@@ -552,7 +611,7 @@ void main_loop()
 
             // Play startup
             play_file("/startup.mp3", PA_INTRMUS|PA_ALLOWSD, 1.0);
-            if(playFLUX) {
+            if(playFLUX && !fpoMusic) {
                 append_flux();
             }
             fcLEDs.SpecialSignal(FCSEQ_STARTUP);
@@ -561,6 +620,13 @@ void main_loop()
                  mydelay(20, false);
             }
 
+            // Resume music where it was stopped at power off
+            if(fpoMusic) {
+                waitAudioDone(false);
+                mp_play();
+                fpoMusic = false;
+            }
+
             isTTKeyHeld = isTTKeyPressed = false;
             networkTimeTravel = false;
 
@@ -636,8 +702,9 @@ void main_loop()
     }
     
     // Poll speed pot
-    if(FPBUnitIsOn) {
-        if(useSKnob && !usingGPSS) {
+    if(useSKnob) {
+        spdPot.scan();
+        if(FPBUnitIsOn && !usingGPSS) {
             setPotSpeed();
         }
     }
@@ -674,9 +741,15 @@ void main_loop()
     
         // Check for BTTFN/MQTT-induced TT
         if(networkTimeTravel) {
+            uint16_t lead = networkLead;
             networkTimeTravel = false;
             ssEnd(false);  // let TT() take care of restarting sound
-            timeTravel(networkTCDTT, networkLead);
+            // Deduct time passed since the notification arrived
+            if(networkTCDTT && lead) {
+                unsigned long elapsed = millis() - networkLeadNow;
+                lead = (elapsed < lead) ? lead - elapsed : 1;
+            }
+            timeTravel(networkTCDTT, lead);
         }
     }
 
@@ -1065,7 +1138,7 @@ void main_loop()
 
     if(networkAlarm && !TTrunning && !IRLearning) {
         networkAlarm = false;
-        if(atoi(settings.playALsnd) > 0) {
+        if(settingsVal.playALsnd > 0) {
             play_file("/alarm.mp3", PA_INTRMUS|PA_ALLOWSD|PA_DYNVOL, 1.0);
             if(FPBUnitIsOn && !ssActive) {
                 if(playFLUX == 1) {
@@ -1077,6 +1150,93 @@ void main_loop()
     }
 }
 
+/*
+ * Bring settings changed in the Config Portal into effect.
+ * "changed" holds the SA_xxx classes of the changed settings.
+ * Returns false if a reboot is required after all.
+ */
+bool main_applySettings(uint32_t changed)
+{
+    if(changed & SA_FLUX) {
+        int temp = settingsVal.playFLUXsnd;
+        if(temp < 0) temp = 0;
+        if(temp > 3) temp = 3;
+        if(FPBUnitIsOn) {
+            setFluxMode(temp);
+        } else {
+            playFLUX = temp;
+            fluxTimeout = (temp == 2) ? FLUXM2_SECS*1000 : FLUXM3_SECS*1000;
+        }
+    }
+
+    if(changed & SA_MAIN) {
+
+        bool temp;
+
+        // Unit stays dark if "follow fake power" is
+        // switched off while fake-powered-off
+        if(useFPO && !FPBUnitIsOn && !(settingsVal.useFPO > 0))
+            return false;
+        useFPO = (settingsVal.useFPO > 0);
+
+        playTTsounds = (settingsVal.playTTsnds > 0);
+        skipttblanim = (settingsVal.skipTTBLAnim > 0);
+        noETTOLead = (settingsVal.noETTOLead > 0);
+
+        maxIRctrls = (settingsVal.disDIR > 0) ? NUM_REM_TYPES - 1 : NUM_REM_TYPES;
+
+        useVKnob = (settingsVal.useVknob > 0);
+
+        temp = (settingsVal.useSknob > 0);
+        if(temp != useSKnob) {
+            useSKnob = temp;
+            if(!useSKnob && !usingGPSS) {
+                fcLEDs.setSpeed(lastIRspeed);
+            }
+        }
+
+        useGPSS = (settingsVal.useGPSS > 0);
+        if(!useGPSS && usingGPSS) {
+            usingGPSS = false;
+            lastGPSspeed = -2;
+            if(!useSKnob) {
+                fcLEDs.setSpeed(lastIRspeed);
+            }
+        }
+
+        temp = (settingsVal.TCDpresent > 0);
+        if(temp != TCDconnected) {
+            TCDconnected = temp;
+            if(TCDconnected && IRLearning) {
+                endIRLearn(true);
+            }
+            isTTKeyHeld = isTTKeyPressed = false;
+            setupTTKey();
+        }
+
+        ssOrigDelay = settingsVal.ssTimer * 60 * 1000;
+
+        // Leave night mode if no longer following the TCD;
+        // otherwise main_loop() picks up the TCD's NM state
+        useNM = (settingsVal.useNM > 0);
+        if(!useNM && nmOld) {
+            ssEnd();
+            fluxNM = false;
+            nmOld = false;
+        }
+        if(!fluxNM) {
+            ssDelay = ssOrigDelay;
+        }
+        ssRestartTimer();
+    }
+
+    if(changed & SA_BTTFN) {
+        bttfn_restart();
+    }
+
+    return true;
+}
+
 /*
  * Time travel
  */
@@ -1472,6 +1632,7 @@ static void handleIRKey(int key)
 static void handleRemoteCommand()
 {
     uint32_t command = commandQueue[oCmdIdx];
+    bool isUser = commandIsUser[oCmdIdx];
 
     if(!command)
         return;
@@ -1480,14 +1641,22 @@ static void handleRemoteCommand()
     oCmdIdx++;
     oCmdIdx &= 0x0f;
 
-    if(ssActive) {
-        ssEnd();
+    // MQTT/API commands do not count as key presses
+    if(!isUser) {
+        if(ssActive) {
+            ssEnd();
+        }
+        ssRestartTimer();
+        lastKeyPressed = millis();
     }
-    ssRestartTimer();
-    lastKeyPressed = millis();
 
     // Some translation
-    if(command < 10) {
+    if(command >= FCCMD_INT_BASE) {
+
+        executeInt(command);
+        return;
+        
+    } else if(command < 10) {
       
         // <10 are translated to direct-key-actions.
         switch(command) {
@@ -1543,6 +1712,38 @@ static void handleRemoteCommand()
     execute(false);
 }
 
+static void executeInt(uint32_t command)
+{
+    switch(command) {
+    case FCCMD_TT:
+        // Treated like button, not like TT from TCD
+        if(!TTrunning && !IRLearning) {
+            networkTimeTravel = true;
+            networkTCDTT = false;
+        }
+        break;
+    case FCCMD_MP_PLAY:
+        if(haveMusic && !TTrunning) {
+            mp_play();
+        }
+        break;
+    case FCCMD_MP_STOP:
+        if(haveMusic && mpActive) {
+            mp_stop();
+            if(playFLUX) {
+                play_flux();
+            }
+        }
+        break;
+    case FCCMD_MP_FWD:
+    case FCCMD_MP_REW:
+        if(haveMusic && mpActive) {
+            mp_skip((command == FCCMD_MP_FWD) ? MP_SKIP_SECS : -MP_SKIP_SECS);
+        }
+        break;
+    }
+}
+
 static bool execute(bool isIR)
 {
     bool doBadInp = false;
@@ -1660,13 +1861,13 @@ static bool execute(bool isIR)
                     wifi_getIP(a, b, c, d);
                     sprintf(ipbuf, "%d.%d.%d.%d", a, b, c, d);
                     numfname[1] = ipbuf[0];
-                    play_file(numfname, PA_INTRMUS|PA_ALLOWSD);
+                    play_file(numfname, PA_INTRMUS|PA_ALLOWSD|PA_HALFRT);
                     for(int i = 1; i < strlen(ipbuf); i++) {
                         if(ipbuf[i] == '.') {
-                            append_file("/dot.mp3", PA_INTRMUS|PA_ALLOWSD);
+                            append_file("/dot.mp3", PA_INTRMUS|PA_ALLOWSD|PA_HALFRT);
                         } else {
                             numfname[1] = ipbuf[i];
-                            append_file(numfname, PA_INTRMUS|PA_ALLOWSD);
+                            append_file(numfname, PA_INTRMUS|PA_ALLOWSD|PA_HALFRT);
                         }
                         while(append_pending()) {
                             mydelay(10, false);
@@ -1697,7 +1898,7 @@ static bool execute(bool isIR)
                             if(mp_checkForFolder(musFolderNum) == -1) {
                                 showWaitSequence();
                                 waitShown = true;
-                                play_file("/renaming.mp3", PA_INTRMUS|PA_ALLOWSD);
+                                play_file("/renaming.mp3", PA_INTRMUS|PA_ALLOWSD|PA_HALFRT);
                                 waitAudioDone(false);
                             }
                             saveMusFoldNum();
@@ -1750,6 +1951,7 @@ static bool execute(bool isIR)
                 endIRfeedback();
                 mp_stop();
                 stopAudio();
+                settings_flush();
                 delay(50);
                 esp_restart();
             }
@@ -1791,77 +1993,16 @@ static bool execute(bool isIR)
  * Speed pot
  */
 
-static uint16_t getRawSpeed()
-{
-    long avg = 0, avg1 = 0, avg2 = 0;
-    long raw;
-
-    raw = analogRead(SPEED_PIN);
-
-    //Serial.printf("raw %d\n", raw);
-
-    if(anaReadCount > 1) {
-      
-        rawSpd[rawSpdIdx] = raw;
-
-        if(anaReadCount < SPD_SMOOTH_SIZE) {
-        
-            avg = 0;
-            for(int i = rawSpdIdx; i > rawSpdIdx - anaReadCount; i--) {
-                avg += rawSpd[i & (SPD_SMOOTH_SIZE-1)];
-            }
-            avg /= anaReadCount;
-            anaReadCount++;
-
-        } else {
-
-            for(int i = rawSpdIdx; i > rawSpdIdx - anaReadCount; i--) {
-                if(i & 1) { 
-                    avg1 += rawSpd[i & (SPD_SMOOTH_SIZE-1)];
-                } else {
-                    avg2 += rawSpd[i & (SPD_SMOOTH_SIZE-1)];
-                }
-            }
-            avg1 = round((float)avg1 / (float)(SPD_SMOOTH_SIZE/2));
-            avg2 = round((float)avg2 / (float)(SPD_SMOOTH_SIZE/2));
-            avg = (abs(avg1-prev_avg) < abs(avg2-prev_avg)) ? avg1 : avg2;
-            
-            prev_avg = avg;
-        }
-        
-    } else {
-      
-        anaReadCount++;
-        rawSpd[rawSpdIdx] = avg = prev_avg = prev_raw = prev_raw2 = raw;
-        
-    }
-
-    rawSpdIdx++;
-    rawSpdIdx &= (SPD_SMOOTH_SIZE-1);
-
-    prev_raw2 = prev_raw;
-    prev_raw = raw;
-
-    return (uint16_t)avg;
-} 
-
 static void setPotSpeed()
 {
-    unsigned long now = millis();
-    
     if(TTrunning || IRLearning)
         return;
 
-    if(!startSpdPot || (now - startSpdPot > 200)) {
-
-        uint16_t spd = getRawSpeed() / (((1 << POT_RESOLUTION) - 1) / POT_GRAN);
-        if(spd > POT_GRAN - 1) spd = POT_GRAN - 1;
-        spd = potSpeeds[spd];
-        if(fcLEDs.getSpeed() != spd) {
-            fcLEDs.setSpeed(spd);
-        }
-        
-        startSpdPot = now;
+    uint16_t spd = spdPot.value() / (POT_MAX / POT_GRAN);
+    if(spd > POT_GRAN - 1) spd = POT_GRAN - 1;
+    spd = potSpeeds[spd];
+    if(fcLEDs.getSpeed() != spd) {
+        fcLEDs.setSpeed(spd);
     }
 }
 
@@ -1884,6 +2025,20 @@ void showCopyError()
     fcLEDs.SpecialSignal(FCSEQ_ERRCOPY);
 }
 
+uint16_t getFluxSpeed()
+{
+    return fcLEDs.getSpeed();
+}
+
+// 0 = no TT, 1-3 = TT phase 0-2
+int getTTPhase()
+{
+    if(!TTrunning) return 0;
+    if(TTP0) return 1;
+    if(TTP1) return 2;
+    return 3;
+}
+
 void allOff()
 {
     fcLEDs.off();
@@ -1905,6 +2060,26 @@ void copyIRarray(uint32_t *irkeys, int index)
     }
 }
 
+static void setupTTKey()
+{
+    if(!TCDconnected) {
+        // If we have a physical button, we need
+        // reasonable values for debounce and press
+        TTKey.setDebounceTicks(TT_DEBOUNCE);
+        TTKey.setPressTicks(TT_PRESS_TIME);
+        TTKey.setLongPressTicks(TT_HOLD_TIME);
+        TTKey.attachLongPressStart(TTKeyHeld);
+    } else {
+        // If the TCD is connected, we can go more to the edge
+        TTKey.setDebounceTicks(5);
+        TTKey.setPressTicks(50);
+        TTKey.setLongPressTicks(100000);
+        // Long press ignored when TCD is connected
+        // IRLearning only possible if TCD is not connected!
+        TTKey.attachLongPressStart(NULL);
+    }
+}
+
 static void ttkeyScan()
 {
     TTKey.scan();  // scan the tt button
@@ -2082,13 +2257,82 @@ void mydelay(unsigned long mydel, bool withIR)
  * BTTF network communication
  */
 
-static void addCmdQueue(uint32_t command)
+static void addCmdQueue(uint32_t command, bool isUser)
 {
     if(!command) return;
 
+    portENTER_CRITICAL(&cmdMux);
     commandQueue[iCmdIdx] = command;
+    commandIsUser[iCmdIdx] = isUser;
     iCmdIdx++;
     iCmdIdx &= 0x0f;
+    portEXIT_CRITICAL(&cmdMux);
+}
+
+/*
+ * Queue a user command from MQTT or the HTTP API. Those are
+ * not taken during TT, IR learning or while fake-powered off;
+ * returns false if the command was refused.
+ */
+bool queueCommand(uint32_t command)
+{
+    if(TTrunning || IRLearning || !FPBUnitIsOn)
+        return false;
+
+    addCmdQueue(command, true);
+
+    return true;
+}
+
+/*
+ * Look up name (len chars, not necessarily 0-terminated) 
+ * in a table sorted by name. Only the leading token (up to
+ * white space or end of string) is considered. If it is not
+ * found, it is cut back at its last '_' and looked up again,
+ * so that names followed by appended data (as in 
+ * "TIMETRAVEL_4800_6600") still match, like the previous 
+ * prefix match did. Returns the entry's code, or 0 if not 
+ * found.
+ */
+static uint32_t findCmdNameExact(const FCCmdName *tbl, int num, const char *name, unsigned int len)
+{
+    int lo = 0, hi = num - 1, mid, r;
+
+    while(lo <= hi) {
+        mid = (lo + hi) >> 1;
+        if(!(r = strncmp(tbl[mid].name, name, len))) {
+            if(!tbl[mid].name[len]) return tbl[mid].code;
+            r = 1;
+        }
+        if(r < 0) lo = mid + 1;
+        else      hi = mid - 1;
+    }
+
+    return 0;
+}
+
+uint32_t findCmdName(const FCCmdName *tbl, int num, const char *name, unsigned int len)
+{
+    unsigned int i;
+    uint32_t code;
+
+    for(i = 0; i < len; i++) {
+        if(name[i] <= ' ') break;
+    }
+    len = i;
+
+    while(len) {
+        if((code = findCmdNameExact(tbl, num, name, len)))
+            return code;
+        while(--len && name[len] != '_') { }
+    }
+
+    return 0;
+}
+
+uint32_t getCmdByName(const char *name, unsigned int len)
+{
+    return findCmdName(cmdNames, NUM_CMD_NAMES, name, len);
 }
 
 static void bttfn_setup()
@@ -2096,13 +2340,38 @@ static void bttfn_setup()
     useBTTFN = false;
 
     if(isIp(settings.tcdIP)) {
-        fcUDP = &bttfUDP;
-        fcUDP->begin(BTTF_DEFAULT_LOCAL_PORT);
-        BTTFNfailCount = 0;
-        useBTTFN = true;
+        bttfnTcdIP.fromString(settings.tcdIP);
+        if(bttfUDP.listen(BTTF_DEFAULT_LOCAL_PORT)) {
+            bttfUDP.onPacket(BTTFNOnPacket);
+            BTTFNfailCount = 0;
+            useBTTFN = true;
+        }
     }
 }
 
+// Re-read TCD IP; forget everything learned from the old TCD
+static void bttfn_restart()
+{
+    if(useBTTFN) {
+        useBTTFN = false;
+        bttfUDP.close();
+    }
+    BTTFNRxTail = BTTFNRxHead;
+
+    tcdNM = false;
+    tcdFPO = false;
+    gpsSpeed = -1;
+    lastBTTFNpacket = 0;
+    BTTFNBootTO = true;
+    BTTFNHaveRTT = false;
+    BTTFNrttCnt = BTTFNrttIdx = 0;
+    BTTFNPacketDue = false;
+    BTTFNUpdateNow = 0;
+    BTTFNPollInt = BTTFN_POLL_INT;
+
+    bttfn_setup();
+}
+
 void bttfn_loop()
 {
     if(!useBTTFN)
@@ -2115,108 +2384,119 @@ void bttfn_loop()
         if(!BTTFNWiFiUp && (WiFi.status() == WL_CONNECTED)) {
             BTTFNUpdateNow = 0;
         }
-        if((!BTTFNUpdateNow) || (millis() - BTTFNUpdateNow > 1100)) {
+        if((!BTTFNUpdateNow) || (millis() - BTTFNUpdateNow > BTTFNPollInt)) {
             BTTFNTriggerUpdate();
         }
     }
 }
 
-// Check for pending packet and parse it
+// Called in AsyncUDP task context: Only validate and queue the
+// packet along with its arrival time; bttfn_loop() does the rest.
+static void BTTFNOnPacket(AsyncUDPPacket& packet)
+{
+    unsigned long rxNow = millis();
+    uint8_t head = BTTFNRxHead;
+    uint8_t next = (head + 1) & (BTTFN_RXQ_SIZE - 1);
+
+    // Queue full: Drop packet
+    if(next == __atomic_load_n(&BTTFNRxTail, __ATOMIC_ACQUIRE))
+        return;
+
+    if(!BTTFNValidate(packet.data(), packet.length(), &BTTFNRxQ[head].pkt))
+        return;
+        
+    BTTFNRxQ[head].rxNow = rxNow;
+
+    __atomic_store_n(&BTTFNRxHead, next, __ATOMIC_RELEASE);
+}
+
+// Process queued packets, check for timeout
 static void BTTFNCheckPacket()
 {
-    unsigned long mymillis = millis();
+    uint8_t tail = BTTFNRxTail;
     
-    int psize = fcUDP->parsePacket();
-    if(!psize) {
-        if(BTTFNPacketDue) {
-            if((mymillis - BTTFNTSRQAge) > 700) {
-                // Packet timed out
-                BTTFNPacketDue = false;
-                // Immediately trigger new request for
-                // the first 10 timeouts, after that
-                // the new request is only triggered
-                // in greater intervals via bttfn_loop().
-                if(BTTFNfailCount < 10) {
-                    BTTFNfailCount++;
-                    BTTFNUpdateNow = 0;
-                }
+    while(tail != __atomic_load_n(&BTTFNRxHead, __ATOMIC_ACQUIRE)) {
+        BTTFNHandlePacket(&BTTFNRxQ[tail].pkt, BTTFNRxQ[tail].rxNow);
+        tail = (tail + 1) & (BTTFN_RXQ_SIZE - 1);
+        __atomic_store_n(&BTTFNRxTail, tail, __ATOMIC_RELEASE);
+    }
+    
+    if(BTTFNPacketDue) {
+        if((millis() - BTTFNTSRQAge) > 700) {
+            // Packet timed out
+            BTTFNPacketDue = false;
+            BTTFNPollInt = BTTFN_POLL_INT;
+            // Immediately trigger new request for
+            // the first 10 timeouts, after that
+            // the new request is only triggered
+            // in greater intervals via bttfn_loop().
+            if(BTTFNfailCount < 10) {
+                BTTFNfailCount++;
+                BTTFNUpdateNow = 0;
             }
         }
-        return;
     }
+}
+
+static void BTTFNUpdateRTT(unsigned long rtt)
+{
+    int32_t err;
     
-    fcUDP->read(BTTFUDPBuf, BTTF_PACKET_SIZE);
+    if(rtt > 700) return;
 
-    // Basic validity check
-    if(memcmp(BTTFUDPBuf, BTTFUDPHD, 4))
-        return;
+    if(!BTTFNHaveRTT) {
+        BTTFNsrtt8 = rtt << 3;
+        BTTFNrttvar4 = rtt << 1;
+        BTTFNHaveRTT = true;
+    } else {
+        err = (int32_t)rtt - (BTTFNsrtt8 >> 3);
+        BTTFNsrtt8 += err;
+        if(err < 0) err = -err;
+        BTTFNrttvar4 += err - (BTTFNrttvar4 >> 2);
+    }
 
-    uint8_t a = 0;
-    for(int i = 4; i < BTTF_PACKET_SIZE - 1; i++) {
-        a += BTTFUDPBuf[i] ^ 0x55;
+    BTTFNrttWin[BTTFNrttIdx] = rtt;
+    BTTFNrttIdx = (BTTFNrttIdx + 1) % BTTFN_RTT_WIN;
+    if(BTTFNrttCnt < BTTFN_RTT_WIN) BTTFNrttCnt++;
+    BTTFNminRTT = BTTFNrttWin[0];
+    for(int i = 1; i < BTTFNrttCnt; i++) {
+        if(BTTFNrttWin[i] < BTTFNminRTT) BTTFNminRTT = BTTFNrttWin[i];
     }
-    if(BTTFUDPBuf[BTTF_PACKET_SIZE - 1] != a)
-        return;
+}
+
+// Estimated one-way delay TCD -> FC in ms
+// A poll's RTT includes the time until the TCD's loop gets
+// around to answer, while notifications are sent at once.
+// Half the minimum RTT is therefore closest to the transit
+// time; the smoothed RTT would over-correct.
+static unsigned long BTTFNDelay()
+{
+    return BTTFNHaveRTT ? (BTTFNminRTT >> 1) : 0;
+}
+
+bool bttfn_getRTT(uint16_t *srtt, uint16_t *rttvar, uint16_t *rttmin)
+{
+    *srtt = BTTFNsrtt8 >> 3;
+    *rttvar = BTTFNrttvar4 >> 2;
+    *rttmin = BTTFNminRTT;
+    return BTTFNHaveRTT;
+}
 
-    if(BTTFUDPBuf[4] == (BTTFN_VERSION | 0x40)) {
+static void BTTFNHandlePacket(const BTTFNPacket *pkt, unsigned long rxNow)
+{
+    if(pkt->ver == (BTTFN_VERSION | BTTFN_VER_NOT)) {
 
         // A notification from the TCD
 
-        switch(BTTFUDPBuf[5]) {
-        case BTTFN_NOT_PREPARE:
-            // Prepare for TT. Comes at some undefined point,
-            // an undefined time before the actual tt, and
-            // may not come at all.
-            // We disable our Screen Saver and start the flux
-            // sound (if to be played)
-            // We don't ignore this if TCD is connected by wire,
-            // because this signal does not come via wire.
-            prepareTT();
-            break;
-        case BTTFN_NOT_TT:
-            // Trigger Time Travel (if not running already)
-            // Ignore command if TCD is connected by wire
-            if(!TCDconnected && !TTrunning && !IRLearning) {
-                networkTimeTravel = true;
-                networkTCDTT = true;
-                networkReentry = false;
-                networkAbort = false;
-                networkLead = BTTFUDPBuf[6] | (BTTFUDPBuf[7] << 8);
-            }
-            break;
-        case BTTFN_NOT_REENTRY:
-            // Start re-entry (if TT currently running)
-            // Ignore command if TCD is connected by wire
-            if(!TCDconnected && TTrunning && networkTCDTT) {
-                networkReentry = true;
-            }
-            break;
-        case BTTFN_NOT_ABORT_TT:
-            // Abort TT (if TT currently running)
-            // Ignore command if TCD is connected by wire
-            if(!TCDconnected && TTrunning && networkTCDTT) {
-                networkAbort = true;
-            }
-            break;
-        case BTTFN_NOT_ALARM:
-            networkAlarm = true;
-            // Eval this at our convenience
-            break;
-        case BTTFN_NOT_FLUX_CMD:
-            addCmdQueue( BTTFUDPBuf[6] | (BTTFUDPBuf[7] << 8) |
-                        (BTTFUDPBuf[8] | (BTTFUDPBuf[9] << 8)) << 16);
-            break;
+        if(pkt->req < BTTFN_NUM_HANDLERS && BTTFNNotHandlers[pkt->req]) {
+            BTTFNNotHandlers[pkt->req](pkt, rxNow);
         }
       
     } else {
 
         // (Possibly) a response packet
     
-        if(*((uint32_t *)(BTTFUDPBuf + 6)) != BTTFUDPID)
-            return;
-    
-        // Response marker missing or wrong version, bail
-        if(BTTFUDPBuf[4] != (BTTFN_VERSION | 0x80))
+        if(bttfnGet32(pkt->id) != BTTFUDPID)
             return;
 
         BTTFNfailCount = 0;
@@ -2224,27 +2504,111 @@ static void BTTFNCheckPacket()
         // If it's our expected packet, no other is due for now
         BTTFNPacketDue = false;
 
-        if(BTTFUDPBuf[5] & 0x02) {
-            gpsSpeed = (int16_t)(BTTFUDPBuf[18] | (BTTFUDPBuf[19] << 8));
+        // Our request ID is our millis() at send time
+        BTTFNUpdateRTT(rxNow - BTTFUDPID);
+
+        int16_t oldGPSS = gpsSpeed;
+        bool oldNM = tcdNM, oldFPO = tcdFPO;
+
+        if(pkt->req & BTTFN_REQ_SPD) {
+            gpsSpeed = (int16_t)bttfnGet16(pkt->rs.gpsSpeed);
         }
-        if(BTTFUDPBuf[5] & 0x10) {
-            tcdNM  = (BTTFUDPBuf[26] & 0x01) ? true : false;
-            tcdFPO = (BTTFUDPBuf[26] & 0x02) ? true : false;   // 1 means fake power off
+        if(pkt->req & BTTFN_REQ_STATUS) {
+            tcdNM  = (pkt->rs.status & BTTFN_STA_NM) ? true : false;
+            tcdFPO = (pkt->rs.status & BTTFN_STA_FPO) ? true : false;   // 1 means fake power off
         } else {
             tcdNM = false;
             tcdFPO = false;
         }
 
-        lastBTTFNpacket = mymillis;
+        // Adapt poll interval: No backoff while GPS speed
+        // is shown, otherwise grow by 1.5 while unchanged
+        if(TTrunning) {
+            BTTFNPollInt = BTTFN_POLL_INT_TT;
+        } else if((tcdNM != oldNM) || (tcdFPO != oldFPO) || (gpsSpeed != oldGPSS) ||
+                  (useGPSS && gpsSpeed >= 0) || BTTFNPollInt < BTTFN_POLL_INT) {
+            BTTFNPollInt = BTTFN_POLL_INT;
+        } else if(BTTFNPollInt < BTTFN_POLL_INT_MAX) {
+            BTTFNPollInt += BTTFNPollInt >> 1;
+            if(BTTFNPollInt > BTTFN_POLL_INT_MAX) BTTFNPollInt = BTTFN_POLL_INT_MAX;
+        }
+
+        lastBTTFNpacket = rxNow;
 
         // Eval SID IP from TCD
-        //if(BTTFUDPBuf[5] & 0x20) {
+        //if(pkt->req & BTTFN_REQ_IP) {
         //    Serial.printf("SID IP from TCD %d.%d.%d.%d\n", 
-        //        BTTFUDPBuf[27], BTTFUDPBuf[28], BTTFUDPBuf[29], BTTFUDPBuf[30]);
+        //        pkt->rs.ip[0], pkt->rs.ip[1], pkt->rs.ip[2], pkt->rs.ip[3]);
         //}
     }
 }
 
+/*
+ * BTTFN notification handlers
+ */
+
+static void BTTFNNotPrepare(const BTTFNPacket *pkt, unsigned long rxNow)
+{
+    // Prepare for TT. Comes at some undefined point,
+    // an undefined time before the actual tt, and
+    // may not come at all.
+    // We disable our Screen Saver and start the flux
+    // sound (if to be played)
+    // We don't ignore this if TCD is connected by wire,
+    // because this signal does not come via wire.
+    prepareTT();
+    BTTFNPollInt = BTTFN_POLL_INT_TT;
+}
+
+static void BTTFNNotTT(const BTTFNPacket *pkt, unsigned long rxNow)
+{
+    // Trigger Time Travel (if not running already)
+    // Ignore command if TCD is connected by wire
+    if(!TCDconnected && !TTrunning && !IRLearning) {
+        networkTimeTravel = true;
+        networkTCDTT = true;
+        networkReentry = false;
+        networkAbort = false;
+        networkLead = bttfnGet16(pkt->id);
+        BTTFNPollInt = BTTFN_POLL_INT_TT;
+        // Lead counts from when the TCD sent the packet
+        networkLeadNow = rxNow - BTTFNDelay();
+        #ifdef FC_DBG
+        Serial.printf("BTTFN: TT, lead %d, est. delay %d (rtt %d, var %d, min %d)\n",
+            networkLead, (int)BTTFNDelay(), (int)(BTTFNsrtt8 >> 3), (int)(BTTFNrttvar4 >> 2), BTTFNminRTT);
+        #endif
+    }
+}
+
+static void BTTFNNotReentry(const BTTFNPacket *pkt, unsigned long rxNow)
+{
+    // Start re-entry (if TT currently running)
+    // Ignore command if TCD is connected by wire
+    if(!TCDconnected && TTrunning && networkTCDTT) {
+        networkReentry = true;
+    }
+}
+
+static void BTTFNNotAbort(const BTTFNPacket *pkt, unsigned long rxNow)
+{
+    // Abort TT (if TT currently running)
+    // Ignore command if TCD is connected by wire
+    if(!TCDconnected && TTrunning && networkTCDTT) {
+        networkAbort = true;
+    }
+}
+
+static void BTTFNNotAlarm(const BTTFNPacket *pkt, unsigned long rxNow)
+{
+    networkAlarm = true;
+    // Eval this at our convenience
+}
+
+static void BTTFNNotFluxCmd(const BTTFNPacket *pkt, unsigned long rxNow)
+{
+    addCmdQueue(bttfnGet32(pkt->id), false);
+}
+
 // Send a new data request
 static bool BTTFNTriggerUpdate()
 {
@@ -2270,33 +2634,28 @@ static bool BTTFNTriggerUpdate()
 
 static void BTTFNSendPacket()
 {   
-    memset(BTTFUDPBuf, 0, BTTF_PACKET_SIZE);
+    memset(&BTTFUDPPkt, 0, BTTF_PACKET_SIZE);
 
     // ID
-    memcpy(BTTFUDPBuf, BTTFUDPHD, 4);
+    memcpy(BTTFUDPPkt.hdr, BTTFUDPHD, 4);
 
     // Serial
-    *((uint32_t *)(BTTFUDPBuf + 6)) = BTTFUDPID = (uint32_t)millis();
+    BTTFUDPID = (uint32_t)millis();
+    bttfnPut32(BTTFUDPPkt.id, BTTFUDPID);
 
     // Tell the TCD about our hostname (0-term., 13 bytes total)
-    strncpy((char *)BTTFUDPBuf + 10, settings.hostName, 12);
-    BTTFUDPBuf[10+12] = 0;
+    strncpy(BTTFUDPPkt.rq.hostName, settings.hostName, 12);
+    BTTFUDPPkt.rq.hostName[12] = 0;
 
-    BTTFUDPBuf[10+13] = BTTFN_TYPE_FLUX;
+    BTTFUDPPkt.rq.devType = BTTFN_TYPE_FLUX;
 
-    BTTFUDPBuf[4] = BTTFN_VERSION;  // Version
-    BTTFUDPBuf[5] = 0x12;           // Request status and GPS speed
+    BTTFUDPPkt.ver = BTTFN_VERSION;                        // Version
+    BTTFUDPPkt.req = BTTFN_REQ_SPD | BTTFN_REQ_STATUS;     // Request status and GPS speed
 
-    //BTTFUDPBuf[5] |= 0x20;             // Query SID IP from TCD
-    //BTTFUDPBuf[24] = BTTFN_TYPE_SID;
+    //BTTFUDPPkt.req |= BTTFN_REQ_IP;        // Query SID IP from TCD
+    //BTTFUDPPkt.rq.ipType = BTTFN_TYPE_SID;
 
-    uint8_t a = 0;
-    for(int i = 4; i < BTTF_PACKET_SIZE - 1; i++) {
-        a += BTTFUDPBuf[i] ^ 0x55;
-    }
-    BTTFUDPBuf[BTTF_PACKET_SIZE - 1] = a;
+    BTTFUDPPkt.csum = BTTFNChecksum(&BTTFUDPPkt);
     
-    fcUDP->beginPacket(settings.tcdIP, BTTF_DEFAULT_LOCAL_PORT);
-    fcUDP->write(BTTFUDPBuf, BTTF_PACKET_SIZE);
-    fcUDP->endPacket();
+    bttfUDP.writeTo((uint8_t *)&BTTFUDPPkt, BTTF_PACKET_SIZE, bttfnTcdIP, BTTF_DEFAULT_LOCAL_PORT);
 }
@@ -64,16 +64,21 @@ extern bool networkReentry;
 extern bool networkAbort;
 extern bool networkAlarm;
 extern uint16_t networkLead;
+extern unsigned long networkLeadNow;
 
 void main_boot();
 void main_setup();
 void main_loop();
+bool main_applySettings(uint32_t changed);
 
 void showWaitSequence();
 void endWaitSequence();
 void showCopyError();
 void allOff();
 
+uint16_t getFluxSpeed();
+int  getTTPhase();
+
 void populateIRarray(uint32_t *irkeys, int index);
 void copyIRarray(uint32_t *irkeys, int index);
 
@@ -84,6 +89,16 @@ void mydelay(unsigned long mydel, bool withIR);
 
 void prepareTT();
 
+typedef struct {
+    const char *name;
+    uint32_t   code;
+} FCCmdName;
+
+uint32_t findCmdName(const FCCmdName *tbl, int num, const char *name, unsigned int len);
+uint32_t getCmdByName(const char *name, unsigned int len);
+bool     queueCommand(uint32_t command);
+
 void bttfn_loop();
+bool bttfn_getRTT(uint16_t *srtt, uint16_t *rttvar, uint16_t *rttmin);
 
 #endif
@@ -35,6 +35,8 @@
 #include <ArduinoJson.h>  // https://github.com/bblanchon/ArduinoJson
 #include <SD.h>
 #include <SPI.h>
+#include <rom/crc.h>
+#include <esp_partition.h>
 #include <FS.h>
 #ifdef USE_SPIFFS
 #include <SPIFFS.h>
@@ -43,14 +45,11 @@
 #include <LittleFS.h>
 #endif
 
+#include "AudioFileSourceLoop.h"
 #include "fc_settings.h"
 #include "fc_audio.h"
 #include "fc_main.h"
 
-// Size of main config JSON
-// Needs to be adapted when config grows
-#define JSON_SIZE 1600
-
 /* If SPIFFS/LittleFS is mounted */
 bool haveFS = false;
 
@@ -111,6 +110,60 @@ static const char *irUCfgName = "/fcirkeys.txt";    // IR keys (user-created) (S
 static const char *irCfgName  = "/fcirkeys.json";   // IR keys (system-created) (flash/SD)
 static const char *irlCfgName = "/fcirlcfg.json";   // IR lock (flash/SD)
 static const char *ipaCfgName = "/fcipat.json";     // Idle pattern (SD only)
+static const char *stoCfgName   = "/fcstate.bin";   // Secondary settings store (flash/SD)
+static const char *stoSDCfgName = "/fcsdstate.bin"; // Idle pattern, music folder store (SD only)
+static const char *stoTmpName   = "/fcstate.tmp";   // Temp files for store compaction
+static const char *stoSDTmpName = "/fcsdstate.tmp"; // (both stores may be on SD)
+
+#define STORE_MAGIC    "FCS"
+#define STORE_VERSION  1
+#define STORE_HDR_SIZE 4
+#define STORE_REC_SIZE 4
+#define STORE_MAX_SIZE (STORE_HDR_SIZE + 64 * STORE_REC_SIZE)
+
+// Store ids. Ids < ST_NUM_SEC are in store 0, the others in store 1.
+#define ST_VOLUME   0
+#define ST_SPEED    1
+#define ST_BLL      2
+#define ST_IRLOCK   3
+#define ST_NUM_SEC  4
+#define ST_IDLEPAT  4
+#define ST_MUSFOLD  5
+#define ST_MUSSUM   6
+#define ST_MPTRACK  7
+#define ST_MPFRMLO  8
+#define ST_MPFRMHI  9
+#define ST_MPSEED   10
+#define ST_NUM      11
+
+static const struct {
+    int16_t lo, hi;
+} stRange[ST_NUM] = {
+    { 0, 19 },                    // ST_VOLUME
+    { FC_SPD_MAX, FC_SPD_MIN },   // ST_SPEED
+    { 0, 4 },                     // ST_BLL
+    { 0, 1 },                     // ST_IRLOCK
+    { 0, 9 },                     // ST_IDLEPAT
+    { 0, 9 },                     // ST_MUSFOLD
+    { -2, 999 },                  // ST_MUSSUM
+    { -1, 999 },                  // ST_MPTRACK
+    { -32768, 32767 },            // ST_MPFRMLO
+    { 0, 255 },                   // ST_MPFRMHI
+    { -32768, 32767 }             // ST_MPSEED
+};
+
+static int16_t  stVals[ST_NUM];
+static bool     stValid[ST_NUM] = { false };
+static uint16_t stFileSize[2] = { 0, 0 };
+
+#define ST_GATHER_MS   250
+#define ST_TASK_STACK  4096
+
+static TaskHandle_t      stTask = NULL;
+static SemaphoreHandle_t stMutex = NULL;
+static portMUX_TYPE      stMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t          stDirty = 0;
+static int16_t           stPend[ST_NUM];
 
 static const char *jsonNames[NUM_IR_KEYS] = {
         "key0", "key1", "key2", "key3", "key4", 
@@ -134,14 +187,14 @@ static bool checkValidNumParmF(char *text, float lowerLim, float upperLim, float
 
 static bool loadIRKeys();
 
-static void open_and_copy(const char *fn, int& haveErr);
-static bool filecopy(File source, File dest);
 static bool check_if_default_audio_present();
 
-static void formatFlashFS();
-
 static bool CopyIPParm(const char *json, char *text, uint8_t psize);
 
+static bool openCfgFileRead(const char *fn, File& f, bool SDonly = false);
+static void stLoadStore(int store);
+static void stStartWriter();
+
 /*
  * settings_setup()
  * 
@@ -212,7 +265,7 @@ void settings_setup()
 
     haveSD = false;
 
-    uint32_t sdfreq = (settings.sdFreq[0] == '0') ? 16000000 : 4000000;
+    uint32_t sdfreq = (settingsVal.sdFreq == 0) ? 16000000 : 4000000;
     #ifdef FC_DBG
     Serial.printf("%s: SD/SPI frequency %dMHz\n", funcName, sdfreq / 1000000);
     #endif
@@ -280,7 +333,12 @@ void settings_setup()
     }
 
     // Determine if secondary settings are to be stored on SD
-    configOnSD = (haveSD && ((settings.CfgOnSD[0] != '0') || FlashROMode));
+    configOnSD = (haveSD && (settingsVal.CfgOnSD || FlashROMode));
+
+    // Load secondary settings
+    stLoadStore(0);
+    stLoadStore(1);
+    stStartWriter();
 
     // Load user-config's and learned IR keys
     loadIRKeys();
@@ -291,105 +349,391 @@ void settings_setup()
     }
 }
 
-static bool read_settings(File configFile)
+/*
+ * Main config file
+ *
+ * The file is a flat JSON object of strings. It is read with a small
+ * streaming tokenizer directly into struct Settings (and, for numbers,
+ * struct SettingsVal) as described by cfgFields[]; no JSON document is
+ * built. The order of cfgFields[] is the order in which write_settings()
+ * writes the file.
+ */
+
+#define CFG_NUM 0
+#define CFG_STR 1
+
+struct CfgField {
+    const char *name;
+    uint16_t    sOff;       // Offset in struct Settings
+    uint8_t     sSize;      // Size of string in struct Settings
+    uint8_t     type;
+    uint16_t    vOff;       // Offset in struct SettingsVal (CFG_NUM)
+    int16_t     lo, hi, def;
+    uint16_t    apply;      // SA_xxx: How to apply a change
+};
+
+#define CFG_N(n, l, h, d, a) { #n, offsetof(Settings, n), sizeof(Settings::n), CFG_NUM, offsetof(SettingsVal, n), l, h, d, a }
+#define CFG_S(n, a)          { #n, offsetof(Settings, n), sizeof(Settings::n), CFG_STR, 0, 0, 0, 0, a }
+
+static constexpr CfgField cfgFields[] = {
+    CFG_N(playFLUXsnd, 0, 3, DEF_PLAY_FLUX_SND, SA_FLUX),
+    CFG_N(ssTimer, 0, 999, DEF_SS_TIMER, SA_MAIN),
+
+    CFG_N(usePLforBL, 0, 1, DEF_BLEDSWAP, SA_REBOOT),
+    CFG_N(useVknob, 0, 1, DEF_VKNOB, SA_MAIN),
+    CFG_N(useSknob, 0, 1, DEF_SKNOB, SA_MAIN),
+    CFG_N(disDIR, 0, 1, DEF_DISDIR, SA_MAIN),
+
+    CFG_S(hostName, SA_REBOOT),
+    CFG_S(systemID, SA_REBOOT),
+    CFG_S(appw, SA_REBOOT),
+    CFG_N(wifiConRetries, 1, 10, DEF_WIFI_RETRY, SA_WIFI),
+    CFG_N(wifiConTimeout, 7, 25, DEF_WIFI_TIMEOUT, SA_WIFI),
+
+    CFG_N(TCDpresent, 0, 1, DEF_TCD_PRES, SA_MAIN),
+    CFG_N(noETTOLead, 0, 1, DEF_NO_ETTO_LEAD, SA_MAIN),
+
+    CFG_S(tcdIP, SA_BTTFN),
+    //CFG_N(wait4TCD, 0, 1, DEF_WAIT_FOR_TCD, 0),
+    CFG_N(useGPSS, 0, 1, DEF_USE_GPSS, SA_MAIN),
+    CFG_N(useNM, 0, 1, DEF_USE_NM, SA_MAIN),
+    CFG_N(useFPO, 0, 1, DEF_USE_FPO, SA_MAIN),
+    //CFG_N(wait4FPOn, 0, 1, DEF_WAIT_FPO, 0),
+
+    CFG_N(playTTsnds, 0, 1, DEF_PLAY_TT_SND, SA_MAIN),
+    CFG_N(skipTTBLAnim, 0, 1, DEF_STTBL_ANIM, SA_MAIN),
+    CFG_N(playALsnd, 0, 1, DEF_PLAY_ALM_SND, 0),
+
+    #ifdef FC_HAVEMQTT
+    CFG_N(useMQTT, 0, 1, 0, SA_MQTT),
+    CFG_N(pubMQTT, 0, 1, 0, SA_MQTT),
+    CFG_S(mqttServer, SA_MQTT),
+    CFG_S(mqttUser, SA_MQTT),
+    #endif
+
+    #ifdef FC_HAVEAPI
+    CFG_N(useAPI, 0, 1, 0, SA_API),
+    #endif
+
+    CFG_N(shuffle, 0, 1, DEF_SHUFFLE, 0),
+
+    CFG_N(CfgOnSD, 0, 1, DEF_CFG_ON_SD, SA_REBOOT),
+    //CFG_N(sdFreq, 0, 1, DEF_SD_FREQ, SA_REBOOT),
+};
+
+#define CFG_NUM_FIELDS (int)(sizeof(cfgFields) / sizeof(cfgFields[0]))
+
+static_assert(CFG_NUM_FIELDS <= 32, "cfgFields: Too many fields for seen-mask");
+
+#define CFG_RBUF_SIZE  64
+#define CFG_MAX_KEY    32
+#define CFG_MAX_VAL    (128 + 2)    // Largest string in struct Settings + slack
+
+struct CfgReader {
+    File    *f;
+    uint8_t buf[CFG_RBUF_SIZE];
+    int     len;
+    int     pos;
+};
+
+static int cfgGetc(CfgReader& r)
 {
-    const char *funcName = "read_settings";
-    bool wd = false;
-    size_t jsonSize = 0;
-    //StaticJsonDocument<JSON_SIZE> json;
-    DynamicJsonDocument json(JSON_SIZE);
+    if(r.pos >= r.len) {
+        r.len = r.f->read(r.buf, CFG_RBUF_SIZE);
+        r.pos = 0;
+        if(r.len <= 0) {
+            r.len = 0;
+            return -1;
+        }
+    }
+    return r.buf[r.pos++];
+}
+
+static int cfgGetcNWS(CfgReader& r)
+{
+    int c;
     
-    DeserializationError error = deserializeJson(json, configFile);
+    do {
+        c = cfgGetc(r);
+    } while(c == ' ' || c == '\t' || c == '\r' || c == '\n');
+
+    return c;
+}
+
+static int cfgHex(int c)
+{
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Read string after opening quote; excess characters are dropped
+static bool cfgReadString(CfgReader& r, char *s, int size)
+{
+    int c, i = 0, n, h;
+    uint32_t u;
+    char t[4];
 
-    jsonSize = json.memoryUsage();
-    if(jsonSize > JSON_SIZE) {
-        Serial.printf("%s: ERROR: Config file too large (%d vs %d), memory corrupted, awaiting doom.\n", funcName, jsonSize, JSON_SIZE);
+    for(;;) {
+        if((c = cfgGetc(r)) < 0)
+            return false;
+        if(c == '"')
+            break;
+        n = 1;
+        t[0] = c;
+        if(c == '\\') {
+            switch((c = cfgGetc(r))) {
+            case 'b': t[0] = '\b'; break;
+            case 'f': t[0] = '\f'; break;
+            case 'n': t[0] = '\n'; break;
+            case 'r': t[0] = '\r'; break;
+            case 't': t[0] = '\t'; break;
+            case '"': 
+            case '\\':
+            case '/': t[0] = c;    break;
+            case 'u':
+                u = 0;
+                for(int j = 0; j < 4; j++) {
+                    if((h = cfgHex(cfgGetc(r))) < 0)
+                        return false;
+                    u = (u << 4) | h;
+                }
+                if(u < 0x80) {
+                    t[0] = u;
+                } else if(u < 0x800) {
+                    t[0] = 0xc0 | (u >> 6);
+                    t[1] = 0x80 | (u & 0x3f);
+                    n = 2;
+                } else {
+                    t[0] = 0xe0 | (u >> 12);
+                    t[1] = 0x80 | ((u >> 6) & 0x3f);
+                    t[2] = 0x80 | (u & 0x3f);
+                    n = 3;
+                }
+                break;
+            default:
+                return false;
+            }
+        }
+        if(i + n < size) {
+            memcpy(s + i, t, n);
+            i += n;
+        }
     }
     
-    #ifdef FC_DBG
-    if(jsonSize > JSON_SIZE - 256) {
-          Serial.printf("%s: WARNING: JSON_SIZE needs to be adapted **************\n", funcName);
+    s[i] = 0;
+    
+    return true;
+}
+
+// Skip a nested object or array (not used by us)
+static bool cfgSkipNested(CfgReader& r)
+{
+    int c, depth = 1;
+    char dummy[2];
+
+    while(depth) {
+        if((c = cfgGetc(r)) < 0)
+            return false;
+        if(c == '{' || c == '[') depth++;
+        else if(c == '}' || c == ']') depth--;
+        else if(c == '"') {
+            if(!cfgReadString(r, dummy, sizeof(dummy)))
+                return false;
+        }
     }
-    Serial.printf("%s: Size of document: %d (JSON_SIZE %d)\n", funcName, jsonSize, JSON_SIZE);
-    serializeJson(json, Serial);
-    Serial.println(F(" "));
-    #endif
 
-    if(!error) {
-
-        wd |= CopyCheckValidNumParm(json["playFLUXsnd"], settings.playFLUXsnd, sizeof(settings.playFLUXsnd), 0, 3, DEF_PLAY_FLUX_SND);
-        wd |= CopyCheckValidNumParm(json["ssTimer"], settings.ssTimer, sizeof(settings.ssTimer), 0, 999, DEF_SS_TIMER);
-
-        wd |= CopyCheckValidNumParm(json["usePLforBL"], settings.usePLforBL, sizeof(settings.usePLforBL), 0, 1, DEF_BLEDSWAP);
-        wd |= CopyCheckValidNumParm(json["useVknob"], settings.useVknob, sizeof(settings.useVknob), 0, 1, DEF_VKNOB);
-        wd |= CopyCheckValidNumParm(json["useSknob"], settings.useSknob, sizeof(settings.useSknob), 0, 1, DEF_SKNOB);
-        wd |= CopyCheckValidNumParm(json["disDIR"], settings.disDIR, sizeof(settings.disDIR), 0, 1, DEF_DISDIR);
-
-        if(json["hostName"]) {
-            memset(settings.hostName, 0, sizeof(settings.hostName));
-            strncpy(settings.hostName, json["hostName"], sizeof(settings.hostName) - 1);
-        } else wd = true;
-        if(json["systemID"]) {
-            memset(settings.systemID, 0, sizeof(settings.systemID));
-            strncpy(settings.systemID, json["systemID"], sizeof(settings.systemID) - 1);
-        } else wd = true;
-
-        if(json["appw"]) {
-            memset(settings.appw, 0, sizeof(settings.appw));
-            strncpy(settings.appw, json["appw"], sizeof(settings.appw) - 1);
-        } else wd = true;
-        
-        wd |= CopyCheckValidNumParm(json["wifiConRetries"], settings.wifiConRetries, sizeof(settings.wifiConRetries), 1, 10, DEF_WIFI_RETRY);
-        wd |= CopyCheckValidNumParm(json["wifiConTimeout"], settings.wifiConTimeout, sizeof(settings.wifiConTimeout), 7, 25, DEF_WIFI_TIMEOUT);
-
-        wd |= CopyCheckValidNumParm(json["TCDpresent"], settings.TCDpresent, sizeof(settings.TCDpresent), 0, 1, DEF_TCD_PRES);
-        wd |= CopyCheckValidNumParm(json["noETTOLead"], settings.noETTOLead, sizeof(settings.noETTOLead), 0, 1, DEF_NO_ETTO_LEAD);
-
-        if(json["tcdIP"]) {
-            memset(settings.tcdIP, 0, sizeof(settings.tcdIP));
-            strncpy(settings.tcdIP, json["tcdIP"], sizeof(settings.tcdIP) - 1);
-        } else wd = true;
-        //wd |= CopyCheckValidNumParm(json["wait4TCD"], settings.wait4TCD, sizeof(settings.wait4TCD), 0, 1, DEF_WAIT_FOR_TCD);
-        wd |= CopyCheckValidNumParm(json["useGPSS"], settings.useGPSS, sizeof(settings.useGPSS), 0, 1, DEF_USE_GPSS);
-        wd |= CopyCheckValidNumParm(json["useNM"], settings.useNM, sizeof(settings.useNM), 0, 1, DEF_USE_NM);
-        wd |= CopyCheckValidNumParm(json["useFPO"], settings.useFPO, sizeof(settings.useFPO), 0, 1, DEF_USE_FPO);
-        //wd |= CopyCheckValidNumParm(json["wait4FPOn"], settings.wait4FPOn, sizeof(settings.wait4FPOn), 0, 1, DEF_WAIT_FPO);
-
-        wd |= CopyCheckValidNumParm(json["playTTsnds"], settings.playTTsnds, sizeof(settings.playTTsnds), 0, 1, DEF_PLAY_TT_SND);
-        wd |= CopyCheckValidNumParm(json["skipTTBLAnim"], settings.skipTTBLAnim, sizeof(settings.skipTTBLAnim), 0, 1, DEF_STTBL_ANIM);
-        wd |= CopyCheckValidNumParm(json["playALsnd"], settings.playALsnd, sizeof(settings.playALsnd), 0, 1, DEF_PLAY_ALM_SND);
-
-        #ifdef FC_HAVEMQTT
-        wd |= CopyCheckValidNumParm(json["useMQTT"], settings.useMQTT, sizeof(settings.useMQTT), 0, 1, 0);
-        if(json["mqttServer"]) {
-            memset(settings.mqttServer, 0, sizeof(settings.mqttServer));
-            strncpy(settings.mqttServer, json["mqttServer"], sizeof(settings.mqttServer) - 1);
-        } else wd = true;
-        if(json["mqttUser"]) {
-            memset(settings.mqttUser, 0, sizeof(settings.mqttUser));
-            strncpy(settings.mqttUser, json["mqttUser"], sizeof(settings.mqttUser) - 1);
-        } else wd = true;
+    return true;
+}
+
+static int cfgFindField(const char *key)
+{
+    for(int i = 0; i < CFG_NUM_FIELDS; i++) {
+        if(!strcmp(cfgFields[i].name, key))
+            return i;
+    }
+    return -1;
+}
+
+static bool cfgStoreField(int idx, const char *val)
+{
+    const CfgField& fd = cfgFields[idx];
+    char *s = (char *)&settings + fd.sOff;
+    bool ret = false;
+
+    memset(s, 0, fd.sSize);
+    strncpy(s, val, fd.sSize - 1);
+
+    if(fd.type == CFG_NUM) {
+        ret = checkValidNumParm(s, fd.lo, fd.hi, fd.def);
+        *(int16_t *)((char *)&settingsVal + fd.vOff) = atoi(s);
+    }
+
+    return ret;
+}
+
+/*
+ * Parse config file. Returns true if the file needs to be
+ * re-written (syntax error, missing or bad values)
+ */
+static bool read_settings(File configFile)
+{
+    const char *funcName = "read_settings";
+    CfgReader r = { &configFile, { 0 }, 0, 0 };
+    char key[CFG_MAX_KEY];
+    char val[CFG_MAX_VAL];
+    uint32_t seen = 0;
+    bool wd = false, isStr;
+    int c, i, idx;
+
+    if(cfgGetcNWS(r) != '{')
+        return true;
+
+    c = cfgGetcNWS(r);
+
+    while(c != '}') {
+
+        // Key
+        if(c != '"' || !cfgReadString(r, key, sizeof(key)) || cfgGetcNWS(r) != ':') {
+            Serial.printf("%s: Syntax error\n", funcName);
+            return true;
+        }
+
+        // Value
+        isStr = false;
+        c = cfgGetcNWS(r);
+        if(c == '"') {
+            if(!cfgReadString(r, val, sizeof(val)))
+                return true;
+            isStr = true;
+            c = cfgGetcNWS(r);
+        } else if(c == '{' || c == '[') {
+            if(!cfgSkipNested(r))
+                return true;
+            val[0] = 0;
+            c = cfgGetcNWS(r);
+        } else {
+            // Literal (number, true, false, null)
+            for(i = 0; c >= 0 && c != ',' && c != '}' && c > ' '; c = cfgGetc(r)) {
+                if(i < CFG_MAX_VAL - 1) val[i++] = c;
+            }
+            val[i] = 0;
+            if(c <= ' ') c = cfgGetcNWS(r);
+        }
+
+        #ifdef FC_DBG
+        Serial.printf("%s: %s = %s\n", funcName, key, val);
         #endif
 
-        wd |= CopyCheckValidNumParm(json["shuffle"], settings.shuffle, sizeof(settings.shuffle), 0, 1, DEF_SHUFFLE);
-        
-        wd |= CopyCheckValidNumParm(json["CfgOnSD"], settings.CfgOnSD, sizeof(settings.CfgOnSD), 0, 1, DEF_CFG_ON_SD);
-        //wd |= CopyCheckValidNumParm(json["sdFreq"], settings.sdFreq, sizeof(settings.sdFreq), 0, 1, DEF_SD_FREQ);
+        // Store. Strings as strings, numbers also as literals.
+        if((idx = cfgFindField(key)) >= 0) {
+            if(isStr || (cfgFields[idx].type == CFG_NUM && val[0] >= '0' && val[0] <= '9')) {
+                wd |= cfgStoreField(idx, val);
+                seen |= (1 << idx);
+            }
+        }
 
-    } else {
+        if(c == ',') {
+            c = cfgGetcNWS(r);
+        } else if(c != '}') {
+            Serial.printf("%s: Syntax error\n", funcName);
+            return true;
+        }
+    }
 
+    // Missing fields: Write new file (containing defaults for these)
+    if(seen != (uint32_t)((1ULL << CFG_NUM_FIELDS) - 1)) {
         wd = true;
-
     }
 
     return wd;
 }
 
+/*
+ * Update typed copies of numerical settings from strings.
+ * Needed after strings were changed by other means than
+ * read_settings(), ie through the Config Portal.
+ */
+void settings_updateVals()
+{
+    for(int i = 0; i < CFG_NUM_FIELDS; i++) {
+        const CfgField& fd = cfgFields[i];
+        if(fd.type == CFG_NUM) {
+            *(int16_t *)((char *)&settingsVal + fd.vOff) = atoi((char *)&settings + fd.sOff);
+        }
+    }
+}
+
+/*
+ * Compare settings against a copy taken before the
+ * Config Portal changed them, return SA_xxx classes
+ * of all changed settings.
+ */
+uint32_t settings_changed(const Settings& old)
+{
+    uint32_t changed = 0;
+
+    for(int i = 0; i < CFG_NUM_FIELDS; i++) {
+        const CfgField& fd = cfgFields[i];
+        if(strcmp((char *)&settings + fd.sOff, (const char *)&old + fd.sOff)) {
+            changed |= fd.apply;
+        }
+    }
+
+    return changed;
+}
+
+#define CFG_WBUF_SIZE 128
+
+struct CfgWriter {
+    File    *f;
+    uint8_t buf[CFG_WBUF_SIZE];
+    int     len;
+    bool    err;
+};
+
+static void cfgFlush(CfgWriter& w)
+{
+    if(w.len) {
+        if(w.f->write(w.buf, w.len) != w.len) w.err = true;
+        #ifdef FC_DBG
+        Serial.write(w.buf, w.len);
+        #endif
+        w.len = 0;
+    }
+}
+
+static void cfgPutc(CfgWriter& w, char c)
+{
+    if(w.len == CFG_WBUF_SIZE) cfgFlush(w);
+    w.buf[w.len++] = c;
+}
+
+static void cfgPutString(CfgWriter& w, const char *s)
+{
+    cfgPutc(w, '"');
+    for( ; *s; s++) {
+        unsigned char c = *s;
+        if(c == '"' || c == '\\') {
+            cfgPutc(w, '\\');
+            cfgPutc(w, c);
+        } else if(c < 0x20) {
+            char t[8];
+            sprintf(t, "\\u%04x", c);
+            for(char *p = t; *p; p++) cfgPutc(w, *p);
+        } else {
+            cfgPutc(w, c);
+        }
+    }
+    cfgPutc(w, '"');
+}
+
 void write_settings()
 {
     const char *funcName = "write_settings";
-    DynamicJsonDocument json(JSON_SIZE);
-    //StaticJsonDocument<JSON_SIZE> json;
+
+    settings_updateVals();
 
     if(!haveFS && !FlashROMode) {
         Serial.printf("%s: %s\n", funcName, fsNoAvail);
@@ -400,57 +744,32 @@ void write_settings()
     Serial.printf("%s: Writing config file\n", funcName);
     #endif
 
-    json["playFLUXsnd"] = settings.playFLUXsnd;
-    json["ssTimer"] = settings.ssTimer;
-
-    json["usePLforBL"] = settings.usePLforBL;
-    json["useVknob"] = settings.useVknob;
-    json["useSknob"] = settings.useSknob;
-    json["disDIR"] = settings.disDIR;
-
-    json["hostName"] = settings.hostName;
-    json["systemID"] = settings.systemID;
-    json["appw"] = settings.appw;
-    json["wifiConRetries"] = settings.wifiConRetries;
-    json["wifiConTimeout"] = settings.wifiConTimeout;
-
-    json["TCDpresent"] = settings.TCDpresent;
-    json["noETTOLead"] = settings.noETTOLead;
-    
-    json["tcdIP"] = settings.tcdIP;
-    //json["wait4TCD"] = settings.wait4TCD;
-    json["useGPSS"] = settings.useGPSS;
-    json["useNM"] = settings.useNM;
-    json["useFPO"] = settings.useFPO;
-    //json["wait4FPOn"] = settings.wait4FPOn;
-
-    json["playTTsnds"] = settings.playTTsnds;
-    json["skipTTBLAnim"] = settings.skipTTBLAnim;
-    json["playALsnd"] = settings.playALsnd;
-
-    #ifdef FC_HAVEMQTT
-    json["useMQTT"] = settings.useMQTT;
-    json["mqttServer"] = settings.mqttServer;
-    json["mqttUser"] = settings.mqttUser;
-    #endif
-
-    json["shuffle"] = settings.shuffle;
-    
-    json["CfgOnSD"] = settings.CfgOnSD;
-    //json["sdFreq"] = settings.sdFreq;
-
     File configFile = FlashROMode ? SD.open(cfgName, FILE_WRITE) : SPIFFS.open(cfgName, FILE_WRITE);
 
     if(configFile) {
 
+        CfgWriter w = { &configFile, { 0 }, 0, false };
+
+        cfgPutc(w, '{');
+        for(int i = 0; i < CFG_NUM_FIELDS; i++) {
+            if(i) cfgPutc(w, ',');
+            cfgPutString(w, cfgFields[i].name);
+            cfgPutc(w, ':');
+            cfgPutString(w, (char *)&settings + cfgFields[i].sOff);
+        }
+        cfgPutc(w, '}');
+        cfgFlush(w);
+
         #ifdef FC_DBG
-        serializeJson(json, Serial);
         Serial.println(F(" "));
         #endif
         
-        serializeJson(json, configFile);
         configFile.close();
 
+        if(w.err) {
+            Serial.printf("%s: Write error\n", funcName);
+        }
+
     } else {
 
         Serial.printf("%s: %s\n", funcName, failFileWrite);
@@ -553,7 +872,7 @@ static bool checkValidNumParmF(char *text, float lowerLim, float upperLim, float
     return false;
 }
 
-static bool openCfgFileRead(const char *fn, File& f, bool SDonly = false)
+static bool openCfgFileRead(const char *fn, File& f, bool SDonly)
 {
     bool haveConfigFile = false;
     
@@ -585,187 +904,461 @@ static bool openCfgFileWrite(const char *fn, File& f, bool SDonly = false)
 }
 
 /*
- *  Load/save the Volume
+ * Secondary settings store
+ *
+ * Volume, speed, minimum box light level, IR lock, idle pattern
+ * and music folder number live in a binary journal rather than
+ * one JSON file each. A store file consists of a header (magic,
+ * version) followed by 4-byte records (id, 16-bit value, CRC8).
+ * Saving a value appends one record; once the file reaches
+ * STORE_MAX_SIZE, it is compacted, ie rewritten with one record
+ * per value. Loading replays all records, the last one for an
+ * id wins. A damaged (eg torn) record ends the replay and causes
+ * compaction.
+ * Store 0 is on flash or SD (as per configOnSD), store 1 (idle
+ * pattern, music folder, music player position) is on SD only.
+ * If a store file does not exist, values are migrated from the
+ * old JSON files once. These are left alone for older firmware.
  */
 
-bool loadCurVolume()
+static uint8_t stCRC8(const uint8_t *d, int len)
 {
-    const char *funcName = "loadCurVolume";
-    char temp[6];
-    File configFile;
+    uint8_t crc = 0xff;
 
-    if(!haveFS && !configOnSD) {
-        Serial.printf("%s: %s\n", funcName, fsNoAvail);
-        return false;
+    while(len--) {
+        crc ^= *d++;
+        for(int i = 0; i < 8; i++) {
+            crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+        }
     }
 
-    #ifdef FC_DBG
-    Serial.printf("%s: Loading from %s\n", funcName, configOnSD ? "SD" : "flash FS");
-    #endif
+    return crc;
+}
 
-    if(openCfgFileRead(volCfgName, configFile)) {
-        StaticJsonDocument<512> json;
-        if(!deserializeJson(json, configFile)) {
-            if(!CopyCheckValidNumParm(json["volume"], temp, sizeof(temp), 0, 19, DEFAULT_VOLUME)) {
-                curSoftVol = atoi(temp);
-            }
-        } 
-        configFile.close();
-    }
+static bool stAvail(int store)
+{
+    return store ? haveSD : (haveFS || configOnSD);
+}
 
-    // Do not write a default file, use pre-set value
+static fs::FS& stFS(int store)
+{
+    if(store || configOnSD) return SD;
+    return SPIFFS;
+}
 
-    prevSavedVol = curSoftVol;
+static const char *stName(int store)
+{
+    return store ? stoSDCfgName : stoCfgName;
+}
 
-    return true;
+static const char *stTmpName(int store)
+{
+    return store ? stoSDTmpName : stoTmpName;
 }
 
-void saveCurVolume(bool useCache)
+static bool stCheckRange(int id, int val)
 {
-    const char *funcName = "saveCurVolume";
-    char buf[6];
-    File configFile;
-    StaticJsonDocument<512> json;
+    return (val >= stRange[id].lo && val <= stRange[id].hi);
+}
 
-    if(useCache && (prevSavedVol == curSoftVol)) {
-        #ifdef FC_DBG
-        Serial.printf("%s: Prev. saved vol identical, not writing\n", funcName);
-        #endif
-        return;
+static bool stWriteStore(int store)
+{
+    uint8_t buf[STORE_HDR_SIZE + ST_NUM * STORE_REC_SIZE];
+    int16_t vals[ST_NUM];
+    bool valid[ST_NUM];
+    int i, len = STORE_HDR_SIZE;
+    bool ret;
+    File f;
+
+    if(!stAvail(store))
+        return false;
+
+    fs::FS& fs = stFS(store);
+
+    memcpy(buf, STORE_MAGIC, 3);
+    buf[3] = STORE_VERSION;
+
+    portENTER_CRITICAL(&stMux);
+    memcpy(vals, stVals, sizeof(vals));
+    memcpy(valid, stValid, sizeof(valid));
+    portEXIT_CRITICAL(&stMux);
+
+    for(i = store ? ST_NUM_SEC : 0; i < (store ? ST_NUM : ST_NUM_SEC); i++) {
+        if(valid[i]) {
+            buf[len]     = i;
+            buf[len + 1] = vals[i] & 0xff;
+            buf[len + 2] = vals[i] >> 8;
+            buf[len + 3] = stCRC8(buf + len, 3);
+            len += STORE_REC_SIZE;
+        }
     }
 
-    if(!haveFS && !configOnSD) {
-        Serial.printf("%s: %s\n", funcName, fsNoAvail);
-        return;
+    // Write new file, then replace old one
+    if(!(f = fs.open(stTmpName(store), FILE_WRITE))) {
+        Serial.printf("stWriteStore: %s\n", failFileWrite);
+        return false;
     }
+    ret = (f.write(buf, len) == len);
+    f.close();
 
-    #ifdef FC_DBG
-    Serial.printf("%s: Writing to %s\n", funcName, configOnSD ? "SD" : "flash FS");
-    #endif
+    if(ret) {
+        fs.remove(stName(store));
+        ret = fs.rename(stTmpName(store), stName(store));
+    }
 
-    sprintf(buf, "%d", curSoftVol);
-    json["volume"] = (char *)buf;
+    stFileSize[store] = ret ? len : 0;
 
     #ifdef FC_DBG
-    serializeJson(json, Serial);
-    Serial.println(F(" "));
+    Serial.printf("stWriteStore: Store %d compacted to %d bytes (%s)\n", store, len, ret ? "ok" : "failed");
     #endif
 
-    if(openCfgFileWrite(volCfgName, configFile)) {
-        serializeJson(json, configFile);
-        configFile.close();
-        prevSavedVol = curSoftVol;
-    } else {
-        Serial.printf("%s: %s\n", funcName, failFileWrite);
-    }
+    return ret;
 }
 
-/*
- *  Load/save the Speed
- */
-
-bool loadCurSpeed()
+static void stMigrate(const char *fn, const char *key, int id)
 {
-    const char *funcName = "loadCurSpeed";
-    char temp[6];
     File configFile;
+    char temp[6];
 
-    if(!haveFS && !configOnSD) {
-        Serial.printf("%s: %s\n", funcName, fsNoAvail);
-        return false;
-    }
-
-    #ifdef FC_DBG
-    Serial.printf("%s: Loading from %s\n", funcName, configOnSD ? "SD" : "flash FS");
-    #endif
-
-    if(openCfgFileRead(spdCfgName, configFile)) {
+    if(openCfgFileRead(fn, configFile, (id >= ST_NUM_SEC))) {
         StaticJsonDocument<512> json;
         if(!deserializeJson(json, configFile)) {
-            if(!CopyCheckValidNumParm(json["speed"], temp, sizeof(temp), FC_SPD_MAX, FC_SPD_MIN, FC_SPD_IDLE)) {
-                lastIRspeed = atoi(temp);
+            if(!CopyCheckValidNumParm(json[key], temp, sizeof(temp), stRange[id].lo, stRange[id].hi, stRange[id].lo)) {
+                stVals[id] = atoi(temp);
+                stValid[id] = true;
             }
-        } 
+        }
         configFile.close();
     }
+}
 
-    // Do not write a default file, use pre-set value
+static void stLoadStore(int store)
+{
+    uint8_t buf[STORE_MAX_SIZE];
+    const char *fn = stName(store);
+    bool bad = false, foreign = false;
+    int i, len, id, val;
+    File f;
 
-    prevSavedSpd = lastIRspeed;
+    if(!stAvail(store))
+        return;
 
-    return true;
-}
+    fs::FS& fs = stFS(store);
 
-void saveCurSpeed(bool useCache)
-{
-    const char *funcName = "saveCurSpeed";
-    char buf[6];
-    File configFile;
-    StaticJsonDocument<512> json;
+    // Power loss between remove and rename in stWriteStore()
+    if(!fs.exists(fn) && fs.exists(stTmpName(store))) {
+        fs.rename(stTmpName(store), fn);
+    }
 
-    if(useCache && (prevSavedSpd == lastIRspeed)) {
+    if(!fs.exists(fn) || !(f = fs.open(fn, "r"))) {
         #ifdef FC_DBG
-        Serial.printf("%s: Prev. saved spd identical, not writing\n", funcName);
+        Serial.printf("stLoadStore: Migrating store %d from JSON files\n", store);
         #endif
+        if(!store) {
+            stMigrate(volCfgName, "volume", ST_VOLUME);
+            stMigrate(spdCfgName, "speed", ST_SPEED);
+            stMigrate(bllCfgName, "mbll", ST_BLL);
+            stMigrate(irlCfgName, "lock", ST_IRLOCK);
+        } else {
+            stMigrate(ipaCfgName, "pattern", ST_IDLEPAT);
+            stMigrate(musCfgName, "folder", ST_MUSFOLD);
+        }
+        stWriteStore(store);
         return;
     }
 
-    if(!haveFS && !configOnSD) {
-        Serial.printf("%s: %s\n", funcName, fsNoAvail);
+    // One read for header and (usually) all records
+    len = f.read(buf, sizeof(buf));
+    
+    if(len < STORE_HDR_SIZE || memcmp(buf, STORE_MAGIC, 3) || buf[3] != STORE_VERSION) {
+        f.close();
+        stWriteStore(store);
         return;
     }
 
-    #ifdef FC_DBG
-    Serial.printf("%s: Writing to %s\n", funcName, configOnSD ? "SD" : "flash FS");
-    #endif
-
-    sprintf(buf, "%d", lastIRspeed);
-    json["speed"] = (char *)buf;
+    i = STORE_HDR_SIZE;
+    
+    do {
+        for( ; i + STORE_REC_SIZE <= len; i += STORE_REC_SIZE) {
+            id = buf[i];
+            val = (int16_t)(buf[i + 1] | (buf[i + 2] << 8));
+            if(id >= ST_NUM || stCRC8(buf + i, 3) != buf[i + 3]) {
+                bad = true;
+                break;
+            }
+            // Records of the other store are not ours to load
+            if(store ? (id < ST_NUM_SEC) : (id >= ST_NUM_SEC)) {
+                foreign = true;
+                continue;
+            }
+            if(stCheckRange(id, val)) {
+                stVals[id] = val;
+                stValid[id] = true;
+            }
+        }
+        if(i < len) bad = true;
+        i = 0;
+    } while(!bad && (len = f.read(buf, sizeof(buf))) > 0);
 
-    #ifdef FC_DBG
-    serializeJson(json, Serial);
-    Serial.println(F(" "));
-    #endif
+    stFileSize[store] = f.size();
+    
+    f.close();
 
-    if(openCfgFileWrite(spdCfgName, configFile)) {
-        serializeJson(json, configFile);
-        configFile.close();
-        prevSavedSpd = lastIRspeed;
-    } else {
-        Serial.printf("%s: %s\n", funcName, failFileWrite);
+    if(bad || foreign || stFileSize[store] >= STORE_MAX_SIZE) {
+        stWriteStore(store);
     }
 }
 
 /*
- *  Load/save the Minimum Box Light Level
+ * Background writer
+ *
+ * The save functions only note the new value and wake up the
+ * writer task, which collects everything pending and commits it
+ * with one write per store. The task runs at low priority on
+ * core 0, so slow SD cards do not stall the main loop (and with
+ * it, audio). settings_flush() commits pending values from the
+ * caller's context; it must be called before restarting.
  */
 
-bool loadBLLevel()
+static void stCommit(uint32_t mask, const int16_t *vals)
 {
-    const char *funcName = "loadBLLevel";
-    char temp[6];
-    File configFile;
+    uint8_t buf[ST_NUM * STORE_REC_SIZE];
+    int store, id, len;
+    bool ret;
+    File f;
+
+    for(store = 0; store < 2; store++) {
+
+        len = 0;
+        
+        for(id = store ? ST_NUM_SEC : 0; id < (store ? ST_NUM : ST_NUM_SEC); id++) {
+            if(mask & (1 << id)) {
+                portENTER_CRITICAL(&stMux);
+                stVals[id] = vals[id];
+                stValid[id] = true;
+                portEXIT_CRITICAL(&stMux);
+                buf[len]     = id;
+                buf[len + 1] = vals[id] & 0xff;
+                buf[len + 2] = (vals[id] >> 8) & 0xff;
+                buf[len + 3] = stCRC8(buf + len, 3);
+                len += STORE_REC_SIZE;
+            }
+        }
+
+        if(!len || !stAvail(store))
+            continue;
+
+        if(!stFileSize[store] || (stFileSize[store] + len > STORE_MAX_SIZE)) {
+            stWriteStore(store);
+            continue;
+        }
+
+        ret = false;
+
+        if((f = stFS(store).open(stName(store), FILE_APPEND))) {
+            if((ret = (f.write(buf, len) == len))) {
+                stFileSize[store] += len;
+            }
+            f.close();
+        } 
+
+        if(!ret) {
+            Serial.printf("stCommit: %s\n", failFileWrite);
+            stFileSize[store] = 0;  // Rewrite on next save
+        }
+
+        #ifdef FC_DBG
+        Serial.printf("stCommit: Store %d: %d record(s) appended\n", store, len / STORE_REC_SIZE);
+        #endif
+    }
+}
+
+static bool stGetPending(uint32_t& mask, int16_t *vals)
+{
+    portENTER_CRITICAL(&stMux);
+    mask = stDirty;
+    stDirty = 0;
+    memcpy(vals, stPend, sizeof(stPend));
+    portEXIT_CRITICAL(&stMux);
+
+    return (mask != 0);
+}
+
+static void stWriterTask(void *param)
+{
+    int16_t vals[ST_NUM];
+    uint32_t mask;
+
+    for(;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        
+        // Give changes made around the same time a chance to join
+        vTaskDelay(pdMS_TO_TICKS(ST_GATHER_MS));
+
+        xSemaphoreTake(stMutex, portMAX_DELAY);
+        if(stGetPending(mask, vals)) {
+            stCommit(mask, vals);
+        }
+        xSemaphoreGive(stMutex);
+    }
+}
+
+static void stStartWriter()
+{
+    if(!(stMutex = xSemaphoreCreateMutex()))
+        return;
+
+    if(xTaskCreatePinnedToCore(stWriterTask, "fcSetWr", ST_TASK_STACK, NULL, 1, &stTask, 0) != pdPASS) {
+        stTask = NULL;
+        Serial.println(F("stStartWriter: Failed to create task, saving synchronously"));
+    }
+}
+
+static void stQueue(int id, int val)
+{
+    if(!stTask) {
+        int16_t vals[ST_NUM];
+        vals[id] = val;
+        stCommit(1 << id, vals);
+        return;
+    }
+    
+    portENTER_CRITICAL(&stMux);
+    stVals[id] = val;
+    stValid[id] = true;
+    stPend[id] = val;
+    stDirty |= (1 << id);
+    portEXIT_CRITICAL(&stMux);
+
+    xTaskNotifyGive(stTask);
+}
+
+void settings_flush()
+{
+    int16_t vals[ST_NUM];
+    uint32_t mask;
+
+    if(!stTask)
+        return;
+
+    xSemaphoreTake(stMutex, portMAX_DELAY);
+    if(stGetPending(mask, vals)) {
+        #ifdef FC_DBG
+        Serial.println(F("settings_flush: Writing pending values"));
+        #endif
+        stCommit(mask, vals);
+    }
+    xSemaphoreGive(stMutex);
+}
+
+// Take current values of all secondary settings
+static void stRefresh()
+{
+    portENTER_CRITICAL(&stMux);
+    stVals[ST_VOLUME] = curSoftVol;
+    stVals[ST_SPEED] = lastIRspeed;
+    stVals[ST_BLL] = minBLL;
+    stVals[ST_IRLOCK] = irLocked ? 1 : 0;
+    for(int i = 0; i < ST_NUM_SEC; i++) {
+        stValid[i] = true;
+    }
+    portEXIT_CRITICAL(&stMux);
+}
+
+/*
+ *  Load/save the Volume
+ */
+
+bool loadCurVolume()
+{
+    if(!haveFS && !configOnSD) {
+        Serial.printf("loadCurVolume: %s\n", fsNoAvail);
+        return false;
+    }
+
+    if(stValid[ST_VOLUME]) {
+        curSoftVol = stVals[ST_VOLUME];
+    }
+
+    prevSavedVol = curSoftVol;
+
+    return true;
+}
+
+void saveCurVolume(bool useCache)
+{
+    const char *funcName = "saveCurVolume";
+
+    if(useCache && (prevSavedVol == curSoftVol)) {
+        #ifdef FC_DBG
+        Serial.printf("%s: Prev. saved vol identical, not writing\n", funcName);
+        #endif
+        return;
+    }
 
     if(!haveFS && !configOnSD) {
         Serial.printf("%s: %s\n", funcName, fsNoAvail);
+        return;
+    }
+
+    stQueue(ST_VOLUME, curSoftVol);
+    prevSavedVol = curSoftVol;
+}
+
+/*
+ *  Load/save the Speed
+ */
+
+bool loadCurSpeed()
+{
+    if(!haveFS && !configOnSD) {
+        Serial.printf("loadCurSpeed: %s\n", fsNoAvail);
         return false;
     }
 
-    #ifdef FC_DBG
-    Serial.printf("%s: Loading from %s\n", funcName, configOnSD ? "SD" : "flash FS");
-    #endif
+    if(stValid[ST_SPEED]) {
+        lastIRspeed = stVals[ST_SPEED];
+    }
 
-    if(openCfgFileRead(bllCfgName, configFile)) {
-        StaticJsonDocument<512> json;
-        if(!deserializeJson(json, configFile)) {
-            if(!CopyCheckValidNumParm(json["mbll"], temp, sizeof(temp), 0, 4, 0)) {
-                minBLL = atoi(temp);
-            }
-        } 
-        configFile.close();
+    prevSavedSpd = lastIRspeed;
+
+    return true;
+}
+
+void saveCurSpeed(bool useCache)
+{
+    const char *funcName = "saveCurSpeed";
+
+    if(useCache && (prevSavedSpd == lastIRspeed)) {
+        #ifdef FC_DBG
+        Serial.printf("%s: Prev. saved spd identical, not writing\n", funcName);
+        #endif
+        return;
+    }
+
+    if(!haveFS && !configOnSD) {
+        Serial.printf("%s: %s\n", funcName, fsNoAvail);
+        return;
+    }
+
+    stQueue(ST_SPEED, lastIRspeed);
+    prevSavedSpd = lastIRspeed;
+}
+
+/*
+ *  Load/save the Minimum Box Light Level
+ */
+
+bool loadBLLevel()
+{
+    if(!haveFS && !configOnSD) {
+        Serial.printf("loadBLLevel: %s\n", fsNoAvail);
+        return false;
     }
 
-    // Do not write a default file, use pre-set value
+    if(stValid[ST_BLL]) {
+        minBLL = stVals[ST_BLL];
+    }
 
     prevSavedBLL = minBLL;
 
@@ -775,9 +1368,6 @@ bool loadBLLevel()
 void saveBLLevel(bool useCache)
 {
     const char *funcName = "saveBLLevel";
-    char buf[6];
-    File configFile;
-    StaticJsonDocument<512> json;
 
     if(useCache && (prevSavedBLL == minBLL)) {
         #ifdef FC_DBG
@@ -791,25 +1381,8 @@ void saveBLLevel(bool useCache)
         return;
     }
 
-    #ifdef FC_DBG
-    Serial.printf("%s: Writing to %s\n", funcName, configOnSD ? "SD" : "flash FS");
-    #endif
-
-    sprintf(buf, "%d", minBLL);
-    json["mbll"] = (char *)buf;
-
-    #ifdef FC_DBG
-    serializeJson(json, Serial);
-    Serial.println(F(" "));
-    #endif
-
-    if(openCfgFileWrite(bllCfgName, configFile)) {
-        serializeJson(json, configFile);
-        configFile.close();
-        prevSavedBLL = minBLL;
-    } else {
-        Serial.printf("%s: %s\n", funcName, failFileWrite);
-    }
+    stQueue(ST_BLL, minBLL);
+    prevSavedBLL = minBLL;
 }
 
 /*
@@ -818,29 +1391,17 @@ void saveBLLevel(bool useCache)
 
 bool loadIdlePat()
 {
-    const char *funcName = "loadIdlePat";
-    char temp[6];
-    File configFile;
-
     if(!haveSD) {
         #ifdef FC_DBG
-        Serial.printf("%s: %s\n", funcName, fsNoAvail);
+        Serial.printf("loadIdlePat: %s\n", fsNoAvail);
         #endif
         return false;
     }
 
-    if(openCfgFileRead(ipaCfgName, configFile, true)) {
-        StaticJsonDocument<512> json;
-        if(!deserializeJson(json, configFile)) {
-            if(!CopyCheckValidNumParm(json["pattern"], temp, sizeof(temp), 0, 9, 0)) {
-                fluxPat = (uint8_t)atoi(temp);
-            }
-        } 
-        configFile.close();
+    if(stValid[ST_IDLEPAT]) {
+        fluxPat = stVals[ST_IDLEPAT];
     }
 
-    // Do not write a default file, use pre-set value
-
     prevSavedIM = fluxPat;
 
     return true;
@@ -849,9 +1410,6 @@ bool loadIdlePat()
 void saveIdlePat(bool useCache)
 {
     const char *funcName = "saveIdlePat";
-    char buf[6];
-    File configFile;
-    StaticJsonDocument<512> json;
 
     if(useCache && (prevSavedIM == fluxPat)) {
         #ifdef FC_DBG
@@ -867,21 +1425,8 @@ void saveIdlePat(bool useCache)
         return;
     }
 
-    sprintf(buf, "%d", fluxPat);
-    json["pattern"] = (char *)buf;
-
-    #ifdef FC_DBG
-    serializeJson(json, Serial);
-    Serial.println(F(" "));
-    #endif
-
-    if(openCfgFileWrite(ipaCfgName, configFile, true)) {
-        serializeJson(json, configFile);
-        configFile.close();
-        prevSavedIM = fluxPat;
-    } else {
-        Serial.printf("%s: %s\n", funcName, failFileWrite);
-    }
+    stQueue(ST_IDLEPAT, fluxPat);
+    prevSavedIM = fluxPat;
 }
 
 
@@ -891,31 +1436,15 @@ void saveIdlePat(bool useCache)
 
 bool loadIRLock()
 {
-    const char *funcName = "loadIRLock";
-    char temp[6];
-    File configFile;
-
     if(!haveFS && !configOnSD) {
-        Serial.printf("%s: %s\n", funcName, fsNoAvail);
+        Serial.printf("loadIRLock: %s\n", fsNoAvail);
         return false;
     }
 
-    #ifdef FC_DBG
-    Serial.printf("%s: Loading from %s\n", funcName, configOnSD ? "SD" : "flash FS");
-    #endif
-
-    if(openCfgFileRead(irlCfgName, configFile)) {
-        StaticJsonDocument<512> json;
-        if(!deserializeJson(json, configFile)) {
-            if(!CopyCheckValidNumParm(json["lock"], temp, sizeof(temp), 0, 1, 0)) {
-                irLocked = (atoi(temp) > 0);
-            }
-        } 
-        configFile.close();
+    if(stValid[ST_IRLOCK]) {
+        irLocked = (stVals[ST_IRLOCK] > 0);
     }
 
-    // Do not write a default file, use pre-set value
-
     prevSavedIRL = irLocked;
 
     return true;
@@ -924,9 +1453,6 @@ bool loadIRLock()
 void saveIRLock(bool useCache)
 {
     const char *funcName = "saveIRLock";
-    char buf[6];
-    File configFile;
-    StaticJsonDocument<512> json;
 
     if(useCache && (prevSavedIRL == irLocked)) {
         #ifdef FC_DBG
@@ -940,25 +1466,8 @@ void saveIRLock(bool useCache)
         return;
     }
 
-    #ifdef FC_DBG
-    Serial.printf("%s: Writing to %s\n", funcName, configOnSD ? "SD" : "flash FS");
-    #endif
-
-    sprintf(buf, "%d", irLocked ? 1 : 0);
-    json["lock"] = (char *)buf;
-
-    #ifdef FC_DBG
-    serializeJson(json, Serial);
-    Serial.println(F(" "));
-    #endif
-
-    if(openCfgFileWrite(irlCfgName, configFile)) {
-        serializeJson(json, configFile);
-        configFile.close();
-        prevSavedIRL = irLocked;
-    } else {
-        Serial.printf("%s: %s\n", funcName, failFileWrite);
-    }
+    stQueue(ST_IRLOCK, irLocked ? 1 : 0);
+    prevSavedIRL = irLocked;
 }
 
 /*
@@ -1074,20 +1583,28 @@ void copySettings()
     if(!haveSD || !haveFS)
         return;
 
+    settings_flush();
+
+    // Keep the writer task off the store while we
+    // write it to the other medium
+    if(stTask) xSemaphoreTake(stMutex, portMAX_DELAY);
+
     configOnSD = !configOnSD;
 
     if(configOnSD || !FlashROMode) {
+        uint16_t oldSize = stFileSize[0];
         #ifdef FC_DBG
         Serial.println(F("copySettings: Copying secondary settings to other medium"));
         #endif
-        saveCurVolume(false);
-        saveCurSpeed(false);
-        saveBLLevel(false);
-        saveIRLock(false);
+        stRefresh();
+        stWriteStore(0);
+        stFileSize[0] = oldSize;
         saveIRKeys();
     }
 
     configOnSD = !configOnSD;
+
+    if(stTask) xSemaphoreGive(stMutex);
 }
 
 /*
@@ -1096,29 +1613,12 @@ void copySettings()
 
 bool loadMusFoldNum()
 {
-    bool writedefault = true;
-    char temp[4];
-
     if(!haveSD)
         return false;
 
-    if(SD.exists(musCfgName)) {
-
-        File configFile = SD.open(musCfgName, "r");
-        if(configFile) {
-            StaticJsonDocument<512> json;
-            if(!deserializeJson(json, configFile)) {
-                if(!CopyCheckValidNumParm(json["folder"], temp, sizeof(temp), 0, 9, 0)) {
-                    musFolderNum = atoi(temp);
-                    writedefault = false;
-                }
-            } 
-            configFile.close();
-        }
-
-    }
-
-    if(writedefault) {
+    if(stValid[ST_MUSFOLD]) {
+        musFolderNum = stVals[ST_MUSFOLD];
+    } else {
         musFolderNum = 0;
         saveMusFoldNum();
     }
@@ -1128,26 +1628,74 @@ bool loadMusFoldNum()
 
 void saveMusFoldNum()
 {
-    const char *funcName = "saveMusFoldNum";
-    StaticJsonDocument<512> json;
-    char buf[4];
+    if(!haveSD)
+        return;
+
+    stQueue(ST_MUSFOLD, musFolderNum);
 
+    // Summary and position were for previous folder
+    stQueue(ST_MUSSUM, -2);
+    stQueue(ST_MPTRACK, -1);
+}
+
+/*
+ * Music folder summary: Number of last file in current
+ * music folder, -1 if there is no music, -2 if unknown.
+ */
+int loadMusFoldSum()
+{
+    if(!haveSD || !stValid[ST_MUSSUM])
+        return -2;
+
+    return stVals[ST_MUSSUM];
+}
+
+void saveMusFoldSum(int sum)
+{
     if(!haveSD)
         return;
 
-    sprintf(buf, "%1d", musFolderNum);
-    json["folder"] = buf;
-    
-    File configFile = SD.open(musCfgName, FILE_WRITE);
+    stQueue(ST_MUSSUM, sum);
+}
 
-    if(configFile) {
-        serializeJson(json, configFile);
-        configFile.close();
-    } else {
-        Serial.printf("%s: %s\n", funcName, failFileWrite);
+/*
+ * Music player position: Track, frame within track, and 
+ * shuffle seed (0 = not shuffled). Saved periodically while
+ * playing, so only values that have changed are written.
+ */
+bool loadMusPos(int& track, uint32_t& frame, uint16_t& seed)
+{
+    if(!haveSD || !stValid[ST_MPTRACK] || stVals[ST_MPTRACK] < 0)
+        return false;
+
+    track = stVals[ST_MPTRACK];
+    frame = stValid[ST_MPFRMLO] ? (uint16_t)stVals[ST_MPFRMLO] : 0;
+    if(stValid[ST_MPFRMHI]) frame |= (uint32_t)stVals[ST_MPFRMHI] << 16;
+    seed = stValid[ST_MPSEED] ? (uint16_t)stVals[ST_MPSEED] : 0;
+
+    return true;
+}
+
+static void stQueueChanged(int id, int val)
+{
+    if(!stValid[id] || stVals[id] != val) {
+        stQueue(id, val);
     }
 }
 
+void saveMusPos(int track, uint32_t frame, uint16_t seed)
+{
+    if(!haveSD)
+        return;
+
+    if(frame > 0xffffff) frame = 0;
+
+    stQueueChanged(ST_MPTRACK, track);
+    stQueueChanged(ST_MPFRMLO, (int16_t)(frame & 0xffff));
+    stQueueChanged(ST_MPFRMHI, frame >> 16);
+    stQueueChanged(ST_MPSEED, (int16_t)seed);
+}
+
 /*
  * Load/save/delete settings for static IP configuration
  */
@@ -1291,12 +1839,8 @@ bool check_allow_CPA()
 
 #define SND_KEY_LEN 98742
 
-static bool check_if_default_audio_present()
-{
-    File file;
-    size_t ts;
-    int i, idx = 0;
-    size_t sizes[NUM_AUDIOFILES] = {
+// Sizes of default audio files; from manifest if available
+static uint32_t sndSize[NUM_AUDIOFILES] = {
       9404, 7523, 5642, 6582, 6582,         // 0-4
       7836, 8463, 8463, 5015, 8777,         // 5-9
       5955,                                 // dot
@@ -1307,7 +1851,74 @@ static bool check_if_default_audio_present()
       36989,                                // fluxing
       43153,                                // renaming
       42212                                 // installing (not copied)
-    };
+};
+static uint32_t sndCRC[NUM_AUDIOFILES];
+static bool     sndHaveCRC = false;
+
+// Packed sound bank; installed instead of the single files if
+// the sound-pack contains one
+static uint32_t bankSize = 0;
+static uint32_t bankCRC = 0;
+static bool     sndHaveBank = false;
+
+/*
+ * Read manifest from ID file. After the "TCD" id line, it
+ * contains one line per file: "<name> <size> <crc32 in hex>".
+ * Older sound-packs have no manifest; the built-in sizes are
+ * used then, and no CRC check takes place.
+ * The sound bank (if any) is listed like the other files.
+ */
+static void readSndManifest()
+{
+    char line[64], name[20];
+    unsigned long size, crc;
+    uint32_t found = 0;
+    int i, len = 0, c;
+    File f;
+
+    if(!(f = SD.open(IDFN, FILE_READ)))
+        return;
+
+    do {
+        c = f.read();
+        if(c < 0 || c == '\n') {
+            line[len] = 0;
+            len = 0;
+            if(sscanf(line, "%19s %lu %lx", name, &size, &crc) == 3) {
+                if(!strcmp(SND_BANK_NAME + 1, name)) {
+                    bankSize = size;
+                    bankCRC = crc;
+                    sndHaveBank = true;
+                }
+                for(i = 0; i < NUM_AUDIOFILES; i++) {
+                    if(!strcmp(audioFiles[i] + 1, name)) {
+                        sndSize[i] = size;
+                        sndCRC[i] = crc;
+                        found |= (1 << i);
+                        break;
+                    }
+                }
+            }
+        } else if(len < (int)sizeof(line) - 1) {
+            line[len++] = c;
+        }
+    } while(c >= 0);
+
+    f.close();
+
+    sndHaveCRC = (found == (1UL << NUM_AUDIOFILES) - 1);
+
+    #ifdef FC_DBG
+    Serial.printf("Sound-pack manifest: %s%s\n", sndHaveCRC ? "complete" : (found ? "incomplete" : "none"),
+        sndHaveBank ? ", sound bank" : "");
+    #endif
+}
+
+static bool check_if_default_audio_present()
+{
+    File file;
+    size_t ts;
+    int i;
 
     if(!haveSD)
         return false;
@@ -1320,6 +1931,8 @@ static bool check_if_default_audio_present()
         return false;
     }
 
+    readSndManifest();
+
     for(i = 0; i < NUM_AUDIOFILES; i++) {
         if(!SD.exists(audioFiles[i])) {
             #ifdef FC_DBG
@@ -1332,39 +1945,339 @@ static bool check_if_default_audio_present()
         ts = file.size();
         file.close();
         #ifdef FC_DBG
-        sizes[idx++] = ts;
-        #else
-        if(sizes[idx++] != ts)
-            return false;
+        Serial.printf("%s: %d (%d)\n", audioFiles[i], ts, sndSize[i]);
         #endif
+        if(sndSize[i] != ts)
+            return false;
     }
 
-    #ifdef FC_DBG
-    for(i = 0; i < (NUM_AUDIOFILES); i++) {
-        Serial.printf("%d, ", sizes[i]);
+    // Sound bank listed but missing/wrong: Install single files
+    if(sndHaveBank) {
+        if(!(file = SD.open(SND_BANK_NAME))) {
+            sndHaveBank = false;
+        } else {
+            if(file.size() != bankSize) sndHaveBank = false;
+            file.close();
+        }
     }
-    Serial.println("");
-    #endif
 
     return true;
 }
 
 /*
  * Install default audio files from SD to flash FS #############
+ *
+ * Files are copied through two buffers: While the flash writer task
+ * writes one buffer to flash FS, the next block is read from SD into
+ * the other. Each file is written to a temporary file, verified
+ * against the CRC32 from the manifest (if any) and then renamed. On
+ * (re-)start, files already installed and verified are skipped, so
+ * an installation interrupted by power loss continues where it left
+ * off.
+ * If the sound-pack contains a sound bank, only the bank is copied,
+ * and the single files are removed from flash FS. If there is a
+ * sound partition, the bank is written there instead of to flash FS;
+ * its header magic is written last, so an incompletely written bank
+ * is never used.
  */
 
+#define CPA_BUF_SIZE   8192
+#define CPA_TASK_STACK 3072
+
+static const char *cpaTmpName = "/fcsnd.tmp";
+
+static uint8_t           *cpaBuf[2] = { NULL, NULL };
+static int                cpaBufSize = 0;
+static QueueHandle_t      cpaWrQ = NULL;      // Buffers to write (idx | len << 1; len 0 = done)
+static QueueHandle_t      cpaFreeQ = NULL;    // Free buffers (idx)
+static File              *cpaDFile = NULL;
+static const esp_partition_t *cpaPart = NULL;   // If set, write to partition instead of cpaDFile
+static uint32_t           cpaPartPos = 0;
+static volatile bool      cpaWrErr = false;
+
+static const esp_partition_t *sndPartition()
+{
+    return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, SND_PART_NAME);
+}
+
+static void cpaWriterTask(void *param)
+{
+    uint32_t item;
+    int len;
+
+    for(;;) {
+        xQueueReceive(cpaWrQ, &item, portMAX_DELAY);
+        if(!(len = item >> 1)) {
+            // End of file: Signal with invalid index
+            item = 2;
+        } else if(!cpaWrErr) {
+            if(cpaPart) {
+                if(esp_partition_write(cpaPart, cpaPartPos, cpaBuf[item & 1], len) != ESP_OK) {
+                    cpaWrErr = true;
+                }
+                cpaPartPos += len;
+            } else if(cpaDFile->write(cpaBuf[item & 1], len) != len) {
+                cpaWrErr = true;
+            }
+        }
+        xQueueSend(cpaFreeQ, &item, portMAX_DELAY);
+    }
+}
+
+static bool cpaStart()
+{
+    for(cpaBufSize = CPA_BUF_SIZE; cpaBufSize >= 1024; cpaBufSize >>= 1) {
+        cpaBuf[0] = (uint8_t *)malloc(cpaBufSize);
+        cpaBuf[1] = (uint8_t *)malloc(cpaBufSize);
+        if(cpaBuf[0] && cpaBuf[1])
+            break;
+        free(cpaBuf[0]);
+        free(cpaBuf[1]);
+        cpaBuf[0] = cpaBuf[1] = NULL;
+    }
+    if(!cpaBuf[0]) {
+        Serial.println(F("copy_audio_files: Failed to allocate buffers"));
+        return false;
+    }
+
+    cpaWrQ = xQueueCreate(2, sizeof(uint32_t));
+    cpaFreeQ = xQueueCreate(3, sizeof(uint32_t));
+    if(!cpaWrQ || !cpaFreeQ)
+        return false;
+
+    if(xTaskCreatePinnedToCore(cpaWriterTask, "fcCPAWr", CPA_TASK_STACK, NULL, 1, NULL, 0) != pdPASS)
+        return false;
+
+    #ifdef FC_DBG
+    Serial.printf("copy_audio_files: Using 2 x %d bytes\n", cpaBufSize);
+    #endif
+
+    return true;
+}
+
+static uint32_t cpaFileCRC(fs::FS& fs, const char *fn, size_t& fsize)
+{
+    uint32_t crc = 0;
+    size_t bytesr;
+    File f;
+
+    fsize = 0;
+
+    if(!(f = fs.open(fn, FILE_READ)))
+        return 0;
+
+    while((bytesr = f.read(cpaBuf[0], cpaBufSize)) > 0) {
+        crc = crc32_le(crc, cpaBuf[0], bytesr);
+        fsize += bytesr;
+    }
+    f.close();
+
+    return crc;
+}
+
+// Check if file in flash FS is complete and matches manifest
+static bool cpaIsInstalled(const char *fn, uint32_t size, bool haveCRC, uint32_t crc)
+{
+    size_t fsize;
+    uint32_t fcrc;
+
+    if(!SPIFFS.exists(fn))
+        return false;
+
+    fcrc = cpaFileCRC(SPIFFS, fn, fsize);
+    
+    if(fsize != size)
+        return false;
+
+    return (!haveCRC || fcrc == crc);
+}
+
+// Copy sFile through the writer task, return CRC32 and size of data read
+static void cpaCopy(File& sFile, uint32_t& crc, size_t& total)
+{
+    uint32_t item;
+    size_t bytesr;
+
+    crc = 0;
+    total = 0;
+    cpaWrErr = false;
+
+    // Both buffers free
+    xQueueReset(cpaFreeQ);
+    for(item = 0; item < 2; item++) {
+        xQueueSend(cpaFreeQ, &item, 0);
+    }
+
+    for(;;) {
+        xQueueReceive(cpaFreeQ, &item, portMAX_DELAY);
+        if(cpaWrErr || !(bytesr = sFile.read(cpaBuf[item], cpaBufSize)))
+            break;
+        crc = crc32_le(crc, cpaBuf[item], bytesr);
+        if(cpaPart && !total && bytesr >= 4) {
+            // Leave header magic erased; written after verification
+            memset(cpaBuf[item], 0xff, 4);
+        }
+        total += bytesr;
+        item |= (bytesr << 1);
+        xQueueSend(cpaWrQ, &item, portMAX_DELAY);
+    }
+
+    // Wait for writer to finish
+    item = 0;
+    xQueueSend(cpaWrQ, &item, portMAX_DELAY);
+    do {
+        xQueueReceive(cpaFreeQ, &item, portMAX_DELAY);
+    } while(item != 2);
+}
+
+static bool cpaCopyFile(const char *fn, uint32_t size, bool haveCRC, uint32_t fcrc)
+{
+    const char *funcName = "copy_audio_files";
+    File sFile, dFile;
+    uint32_t crc;
+    size_t total;
+    bool ret = false;
+
+    if(cpaIsInstalled(fn, size, haveCRC, fcrc)) {
+        #ifdef FC_DBG
+        Serial.printf("%s: %s already installed\n", funcName, fn);
+        #endif
+        return true;
+    }
+
+    if(!(sFile = SD.open(fn, FILE_READ))) {
+        Serial.printf("%s: Error opening source file: %s\n", funcName, fn);
+        return false;
+    }
+
+    // Make room: Remove old version
+    SPIFFS.remove(fn);
+
+    if(!(dFile = SPIFFS.open(cpaTmpName, FILE_WRITE))) {
+        Serial.printf("%s: Error opening destination file: %s\n", funcName, fn);
+        sFile.close();
+        return false;
+    }
+
+    cpaDFile = &dFile;
+    cpaCopy(sFile, crc, total);
+
+    dFile.close();
+    sFile.close();
+
+    if(cpaWrErr) {
+        Serial.printf("%s: Error writing %s\n", funcName, fn);
+    } else if(total != size || (haveCRC && crc != fcrc)) {
+        Serial.printf("%s: Source file %s corrupt\n", funcName, fn);
+    } else if(!SPIFFS.rename(cpaTmpName, fn)) {
+        Serial.printf("%s: Error renaming %s\n", funcName, fn);
+    } else if(!cpaIsInstalled(fn, size, haveCRC, fcrc)) {
+        Serial.printf("%s: Verification of %s failed\n", funcName, fn);
+    } else {
+        ret = true;
+    }
+
+    if(!ret) {
+        SPIFFS.remove(cpaTmpName);
+        SPIFFS.remove(fn);
+    }
+
+    return ret;
+}
+
+static uint32_t cpaPartCRC(const esp_partition_t *part, size_t size)
+{
+    uint32_t crc = 0;
+    size_t pos, len;
+
+    for(pos = 0; pos < size; pos += len) {
+        len = min((size_t)cpaBufSize, size - pos);
+        if(esp_partition_read(part, pos, cpaBuf[0], len) != ESP_OK)
+            return 0;
+        crc = crc32_le(crc, cpaBuf[0], len);
+    }
+
+    return crc;
+}
+
+// Write sound bank to sound partition
+static bool cpaCopyToPart(const esp_partition_t *part)
+{
+    const char *funcName = "copy_audio_files";
+    File sFile;
+    uint32_t crc;
+    size_t total;
+    bool ret = false;
+
+    if(bankSize > part->size) {
+        Serial.printf("%s: Sound bank too large for partition\n", funcName);
+        return false;
+    }
+
+    if(cpaPartCRC(part, bankSize) == bankCRC) {
+        #ifdef FC_DBG
+        Serial.printf("%s: Sound bank already installed\n", funcName);
+        #endif
+        return true;
+    }
+
+    if(!(sFile = SD.open(SND_BANK_NAME, FILE_READ))) {
+        Serial.printf("%s: Error opening source file: %s\n", funcName, SND_BANK_NAME);
+        return false;
+    }
+
+    if(esp_partition_erase_range(part, 0, (bankSize + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1)) != ESP_OK) {
+        Serial.printf("%s: Error erasing sound partition\n", funcName);
+        sFile.close();
+        return false;
+    }
+
+    cpaPart = part;
+    cpaPartPos = 0;
+    cpaCopy(sFile, crc, total);
+    cpaPart = NULL;
+
+    sFile.close();
+
+    if(cpaWrErr) {
+        Serial.printf("%s: Error writing sound partition\n", funcName);
+    } else if(total != bankSize || crc != bankCRC) {
+        Serial.printf("%s: Source file %s corrupt\n", funcName, SND_BANK_NAME);
+    } else if(esp_partition_write(part, 0, FCSB_MAGIC, 4) != ESP_OK) {
+        Serial.printf("%s: Error writing sound partition\n", funcName);
+    } else if(cpaPartCRC(part, bankSize) != bankCRC) {
+        Serial.printf("%s: Verification of sound partition failed\n", funcName);
+    } else {
+        ret = true;
+    }
+
+    if(!ret) {
+        esp_partition_erase_range(part, 0, SPI_FLASH_SEC_SIZE);
+    }
+
+    return ret;
+}
+
 void doCopyAudioFiles()
 {
+    unsigned long startNow = millis();
     bool delIDfile = false;
 
+    settings_flush();
+
+    // Bank file is kept open by audio; release it
+    audio_closeBank();
+
     if(!copy_audio_files()) {
-        // If copy fails, re-format flash FS
-        formatFlashFS();            // Format
-        rewriteSecondarySettings(); // Re-write ip/vol/speed/ir/etc settings
+        // If copy fails, remove installed audio files to make
+        // room (eg if FS is fragmented), and retry
         #ifdef FC_DBG 
-        Serial.println("Re-writing general settings");
+        Serial.println("Removing audio files and retrying");
         #endif
-        write_settings();           // Re-write general settings
+        for(int i = 0; i < NUM_AUDIOFILES - 1; i++) {
+            SPIFFS.remove(audioFiles[i]);
+        }
+        SPIFFS.remove(SND_BANK_NAME);
         if(!copy_audio_files()) {   // Retry copy
             showCopyError();
             mydelay(5000, false);
@@ -1375,6 +2288,9 @@ void doCopyAudioFiles()
         delIDfile = true;
     }
 
+    Serial.printf("Audio file installation %s, took %lums\n", 
+        delIDfile ? "done" : "failed", millis() - startNow);
+
     if(delIDfile)
         delete_ID_file();
 
@@ -1386,70 +2302,68 @@ void doCopyAudioFiles()
 
 bool copy_audio_files()
 {
+    const esp_partition_t *sndPart = sndPartition();
     int i, haveErr = 0;
 
     if(!allowCPA) {
         return false;
     }
 
-    for(i = 0; i < NUM_AUDIOFILES - 1; i++) {
-        open_and_copy(audioFiles[i], haveErr);
+    if(!cpaBuf[0] && !cpaStart()) {
+        return false;
     }
 
-    return (haveErr == 0);
-}
-
-static void open_and_copy(const char *fn, int& haveErr)
-{
-    const char *funcName = "copy_audio_files";
-    File sFile, dFile;
-
-    if((sFile = SD.open(fn, FILE_READ))) {
-        #ifdef FC_DBG
-        Serial.printf("%s: Opened source file: %s\n", funcName, fn);
-        #endif
-        if((dFile = SPIFFS.open(fn, FILE_WRITE))) {
-            #ifdef FC_DBG
-            Serial.printf("%s: Opened destination file: %s\n", funcName, fn);
-            #endif
-            if(!filecopy(sFile, dFile)) {
-                haveErr++;
-            }
-            dFile.close();
-        } else {
-            Serial.printf("%s: Error opening destination file: %s\n", funcName, fn);
-            haveErr++;
+    if(sndHaveBank) {
+        // Bank replaces single files; remove them to make room
+        for(i = 0; i < NUM_AUDIOFILES - 1; i++) {
+            SPIFFS.remove(audioFiles[i]);
         }
-        sFile.close();
-    } else {
-        Serial.printf("%s: Error opening source file: %s\n", funcName, fn);
-        haveErr++;
+        if(sndPart) {
+            SPIFFS.remove(SND_BANK_NAME);
+            return cpaCopyToPart(sndPart);
+        }
+        return cpaCopyFile(SND_BANK_NAME, bankSize, true, bankCRC);
     }
-}
 
-static bool filecopy(File source, File dest)
-{
-    uint8_t buffer[1024];
-    size_t bytesr, bytesw;
+    // Old bank would take precedence over the new files
+    SPIFFS.remove(SND_BANK_NAME);
+    if(sndPart) {
+        esp_partition_erase_range(sndPart, 0, SPI_FLASH_SEC_SIZE);
+    }
 
-    while((bytesr = source.read(buffer, 1024))) {
-        if((bytesw = dest.write(buffer, bytesr)) != bytesr) {
-            Serial.println(F("filecopy: Error writing data"));
-            return false;
+    for(i = 0; i < NUM_AUDIOFILES - 1; i++) {
+        if(!cpaCopyFile(audioFiles[i], sndSize[i], sndHaveCRC, sndCRC[i])) {
+            haveErr++;
         }
     }
 
-    return true;
+    return (haveErr == 0);
 }
 
 bool audio_files_present()
 {
+    const esp_partition_t *sndPart = sndPartition();
     File file;
     size_t ts;
     
     if(FlashROMode || !haveFS)
         return true;
 
+    if(sndPart) {
+        char buf[4];
+        if(esp_partition_read(sndPart, 0, buf, 4) == ESP_OK && !memcmp(buf, FCSB_MAGIC, 4))
+            return true;
+    }
+
+    if(SPIFFS.exists(SND_BANK_NAME)) {
+        char buf[4] = { 0 };
+        if((file = SPIFFS.open(SND_BANK_NAME))) {
+            file.read((uint8_t *)buf, 4);
+            file.close();
+        }
+        return !memcmp(buf, FCSB_MAGIC, 4);
+    }
+
     if(!SPIFFS.exists(audioFiles[SND_KEY_IDX]))
         return false;
       
@@ -1478,41 +2392,3 @@ void delete_ID_file()
         SD.remove(IDFN);
     }
 }
-
-/*
- * Various helpers
- */
-
-static void formatFlashFS()
-{
-    #ifdef FC_DBG
-    Serial.println(F("Formatting flash FS"));
-    #endif
-    SPIFFS.format();
-}
-
-// Re-write IP/speed/vol/etc settings
-// Used during audio file installation when flash FS needs
-// to be re-formatted.
-void rewriteSecondarySettings()
-{
-    bool oldconfigOnSD = configOnSD;
-    
-    #ifdef FC_DBG
-    Serial.println("Re-writing secondary settings");
-    #endif
-    
-    writeIpSettings();
-
-    // Create current settings on flash FS
-    // regardless of SD-option
-    configOnSD = false;
-       
-    saveCurVolume(false);
-    saveCurSpeed(false);
-    saveBLLevel(false);
-    saveIRLock(false);
-    saveIRKeys();
-    
-    configOnSD = oldconfigOnSD;
-}
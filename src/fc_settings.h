@@ -107,16 +107,80 @@ struct Settings {
 
 #ifdef FC_HAVEMQTT  
     char useMQTT[4]         = "0";
+    char pubMQTT[4]         = "0";
     char mqttServer[80]     = "";  // ip or domain [:port]  
     char mqttUser[128]      = "";  // user[:pass] (UTF8)
 #endif     
 
+#ifdef FC_HAVEAPI
+    char useAPI[4]          = "0";
+#endif
+
     char shuffle[4]         = MS(DEF_SHUFFLE);
 
     char CfgOnSD[4]         = MS(DEF_CFG_ON_SD);
     char sdFreq[4]          = MS(DEF_SD_FREQ);
 };
 
+/*
+ * Numerical settings as integers. Kept in sync with the strings
+ * in struct Settings by settings_updateVals() (and the config file
+ * parser), so that run-time code needs not parse strings.
+ */
+struct SettingsVal {
+    int16_t playFLUXsnd     = DEF_PLAY_FLUX_SND;
+    int16_t ssTimer         = DEF_SS_TIMER;
+
+    int16_t usePLforBL      = DEF_BLEDSWAP;
+    int16_t useVknob        = DEF_VKNOB;
+    int16_t useSknob        = DEF_SKNOB;
+    int16_t disDIR          = DEF_DISDIR;
+
+    int16_t wifiConRetries  = DEF_WIFI_RETRY;
+    int16_t wifiConTimeout  = DEF_WIFI_TIMEOUT;
+
+    int16_t TCDpresent      = DEF_TCD_PRES;
+    int16_t noETTOLead      = DEF_NO_ETTO_LEAD;
+
+    int16_t useGPSS         = DEF_USE_GPSS;
+    int16_t useNM           = DEF_USE_NM;
+    int16_t useFPO          = DEF_USE_FPO;
+    int16_t wait4FPOn       = DEF_WAIT_FPO;
+
+    int16_t playTTsnds      = DEF_PLAY_TT_SND;
+    int16_t skipTTBLAnim    = DEF_STTBL_ANIM;
+    int16_t playALsnd       = DEF_PLAY_ALM_SND;
+
+#ifdef FC_HAVEMQTT
+    int16_t useMQTT         = 0;
+    int16_t pubMQTT         = 0;
+#endif
+
+#ifdef FC_HAVEAPI
+    int16_t useAPI          = 0;
+#endif
+
+    int16_t shuffle         = DEF_SHUFFLE;
+
+    int16_t CfgOnSD         = DEF_CFG_ON_SD;
+    int16_t sdFreq          = DEF_SD_FREQ;
+};
+
+/*
+ * How a changed setting is brought into effect after the Config
+ * Portal saved it. settings_changed() returns the classes of all
+ * changed settings; the respective subsystems re-read their part.
+ * Settings of class 0 are only evaluated at boot (or directly from
+ * settingsVal at run-time) and need no action.
+ */
+#define SA_REBOOT   0x0001    // Used during boot/hardware setup only
+#define SA_FLUX     0x0002    // Flux sound mode
+#define SA_MAIN     0x0004    // Options evaluated by main_applySettings()
+#define SA_BTTFN    0x0008    // BTTFN: TCD IP
+#define SA_MQTT     0x0010    // MQTT: Server, user, publishing
+#define SA_API      0x0020    // HTTP API
+#define SA_WIFI     0x0040    // WiFi connection timeout/retries
+
 struct IPSettings {
     char ip[20]       = "";
     char gateway[20]  = "";
@@ -125,10 +189,13 @@ struct IPSettings {
 };
 
 extern struct Settings settings;
+extern struct SettingsVal settingsVal;
 extern struct IPSettings ipsettings;
 
 void settings_setup();
 void write_settings();
+void settings_updateVals();
+uint32_t settings_changed(const Settings& old);
 bool checkConfigExists();
 
 bool loadCurVolume();
@@ -148,9 +215,15 @@ void saveIRLock(bool useCache = true);
 
 bool loadMusFoldNum();
 void saveMusFoldNum();
+int  loadMusFoldSum();
+void saveMusFoldSum(int sum);
+bool loadMusPos(int& track, uint32_t& frame, uint16_t& seed);
+void saveMusPos(int track, uint32_t frame, uint16_t seed);
 
 void copySettings();
 
+void settings_flush();
+
 bool saveIRKeys();
 void deleteIRKeys();
 
@@ -166,6 +239,4 @@ void delete_ID_file();
 
 bool audio_files_present();
 
-void rewriteSecondarySettings();
-
 #endif
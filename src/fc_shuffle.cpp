@@ -0,0 +1,119 @@
+/*
+ * -------------------------------------------------------------------
+ * CircuitSetup.us Flux Capacitor
+ * (C) 2023 Thomas Winischhofer (A10001986)
+ * https://github.com/realA10001986/Flux-Capacitor
+ * http://fc.backtothefutu.re
+ *
+ * Music player shuffle
+ *
+ * -------------------------------------------------------------------
+ * License: MIT
+ * 
+ * Permission is hereby granted, free of charge, to any person 
+ * obtaining a copy of this software and associated documentation 
+ * files (the "Software"), to deal in the Software without restriction, 
+ * including without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell copies of the 
+ * Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY 
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "fc_shuffle.h"
+
+// Derive Feistel keys from seed
+void shuffleInit(FCShuffle *sh, uint16_t seed, int maxIdx)
+{
+    uint32_t x;
+
+    sh->maxIdx = maxIdx;
+    sh->bits = 0;
+    
+    if(maxIdx < 2)
+        return;
+
+    sh->bits = 1;
+    while((1 << (2 * sh->bits)) <= maxIdx) {
+        sh->bits++;
+    }
+
+    // splitmix32
+    x = seed;
+    for(int i = 0; i < MPSH_ROUNDS; i++) {
+        x += 0x9e3779b9;
+        uint32_t z = x;
+        z = (z ^ (z >> 16)) * 0x85ebca6b;
+        z = (z ^ (z >> 13)) * 0xc2b2ae35;
+        sh->keys[i] = z ^ (z >> 16);
+    }
+}
+
+// Identity mapping
+void shuffleOff(FCShuffle *sh)
+{
+    sh->bits = 0;
+}
+
+static uint32_t shuffleRound(const FCShuffle *sh, uint32_t r, int round)
+{
+    uint32_t x = (r ^ sh->keys[round]) * 0x2c1b3c6d;
+    x ^= x >> 12;
+    x *= 0x297a2d39;
+    x ^= x >> 15;
+    return x;
+}
+
+// Play list position -> track number
+int shuffleIdxToTrack(const FCShuffle *sh, int idx)
+{
+    uint32_t mask = (1 << sh->bits) - 1;
+    uint32_t l, r, t;
+
+    if(!sh->bits) return idx;
+
+    do {
+        l = idx >> sh->bits;
+        r = idx & mask;
+        for(int i = 0; i < MPSH_ROUNDS; i++) {
+            t = r;
+            r = l ^ (shuffleRound(sh, r, i) & mask);
+            l = t;
+        }
+        idx = (l << sh->bits) | r;
+    } while(idx > sh->maxIdx);
+
+    return idx;
+}
+
+// Track number -> play list position (inverse of above)
+int shuffleTrackToIdx(const FCShuffle *sh, int track)
+{
+    uint32_t mask = (1 << sh->bits) - 1;
+    uint32_t l, r, t;
+
+    if(!sh->bits) return track;
+
+    do {
+        l = track >> sh->bits;
+        r = track & mask;
+        for(int i = MPSH_ROUNDS - 1; i >= 0; i--) {
+            t = l;
+            l = r ^ (shuffleRound(sh, l, i) & mask);
+            r = t;
+        }
+        track = (l << sh->bits) | r;
+    } while(track > sh->maxIdx);
+
+    return track;
+}
@@ -0,0 +1,60 @@
+/*
+ * -------------------------------------------------------------------
+ * CircuitSetup.us Flux Capacitor
+ * (C) 2023 Thomas Winischhofer (A10001986)
+ * https://github.com/realA10001986/Flux-Capacitor
+ * http://fc.backtothefutu.re
+ *
+ * Music player shuffle
+ *
+ * -------------------------------------------------------------------
+ * License: MIT
+ * 
+ * Permission is hereby granted, free of charge, to any person 
+ * obtaining a copy of this software and associated documentation 
+ * files (the "Software"), to deal in the Software without restriction, 
+ * including without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell copies of the 
+ * Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY 
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _FC_SHUFFLE_H
+#define _FC_SHUFFLE_H
+
+#include <stdint.h>
+
+/*
+ * Shuffle: There is no play list. Play list position and track
+ * number are mapped onto each other by a keyed permutation of 
+ * [0, maxIdx], an 8-round Feistel network over the smallest 
+ * 2^(2*bits) domain covering all tracks; results outside the
+ * range are fed through again ("cycle walking") until they are 
+ * within it. Keys are derived from a seed, so a seed (and a 
+ * position) is all it takes to reproduce a shuffled sequence.
+ */
+#define MPSH_ROUNDS 8
+
+typedef struct {
+    int      maxIdx;
+    uint8_t  bits;                // Bits per Feistel half, 0: no shuffle
+    uint32_t keys[MPSH_ROUNDS];
+} FCShuffle;
+
+void shuffleInit(FCShuffle *sh, uint16_t seed, int maxIdx);
+void shuffleOff(FCShuffle *sh);
+int  shuffleIdxToTrack(const FCShuffle *sh, int idx);
+int  shuffleTrackToIdx(const FCShuffle *sh, int track);
+
+#endif
@@ -48,17 +48,22 @@
 #ifdef FC_HAVEMQTT
 #include "mqtt.h"
 #endif
+#ifdef FC_HAVEAPI
+#include <lwip/sockets.h>
+#endif
 
 // If undefined, use the checkbox/dropdown-hacks.
 // If defined, go back to standard text boxes
 //#define TC_NOCHECKBOXES
 
 Settings settings;
+SettingsVal settingsVal;
 
 IPSettings ipsettings;
 
 WiFiManager wm;
-bool wifiSetupDone = false;
+volatile bool wifiSetupDone = false;
+bool wifiHaveSTAConf = false;
 
 #ifdef FC_HAVEMQTT
 WiFiClient mqttWClient;
@@ -173,8 +178,21 @@ WiFiManagerParameter custom_useMQTT("uMQTT", "Use Home Assistant (MQTT 3.1.1)",
 #endif // -------------------------------------------------
 WiFiManagerParameter custom_mqttServer("ha_server", "<br>Broker IP[:port] or domain[:port]", settings.mqttServer, 79, "pattern='[a-zA-Z0-9\\.:\\-]+' placeholder='Example: 192.168.1.5'");
 WiFiManagerParameter custom_mqttUser("ha_usr", "User[:Password]", settings.mqttUser, 63, "placeholder='Example: ronald:mySecret'");
+#ifdef TC_NOCHECKBOXES  // --- Standard text boxes: -------
+WiFiManagerParameter custom_pubMQTT("pMQTT", "Publish state (0=no, 1=yes)", settings.pubMQTT, 1, "autocomplete='off' title='Enable to publish the Flux Capacitor state to the broker'");
+#else // -------------------- Checkbox hack: --------------
+WiFiManagerParameter custom_pubMQTT("pMQTT", "Publish state", settings.pubMQTT, 1, "autocomplete='off' title='Check to publish the Flux Capacitor state to the broker' type='checkbox' style='margin-top:5px;'", WFM_LABEL_AFTER);
+#endif // -------------------------------------------------
 #endif // HAVEMQTT
 
+#ifdef FC_HAVEAPI
+#ifdef TC_NOCHECKBOXES  // --- Standard text boxes: -------
+WiFiManagerParameter custom_useAPI("uAPI", "Enable HTTP API (0=no, 1=yes)<br><span style='font-size:80%'>Control and status at http://<i>hostname</i>:" MS(API_PORT) "/api/...</span>", settings.useAPI, 1, "autocomplete='off'");
+#else // -------------------- Checkbox hack: --------------
+WiFiManagerParameter custom_useAPI("uAPI", "Enable HTTP API<br><span style='font-size:80%'>Control and status at http://<i>hostname</i>:" MS(API_PORT) "/api/...</span>", settings.useAPI, 1, "autocomplete='off' type='checkbox' style='margin-top:5px'", WFM_LABEL_AFTER);
+#endif // -------------------------------------------------
+#endif
+
 WiFiManagerParameter custom_musHint("<div style='margin:0px;padding:0px'>MusicPlayer</div>");
 #ifdef TC_NOCHECKBOXES  // --- Standard text boxes: -------
 WiFiManagerParameter custom_shuffle("musShu", "Shuffle at startup (0=no, 1=yes)", settings.shuffle, 1, "autocomplete='off' title='Enable to shuffle playlist at startup'");
@@ -218,9 +236,12 @@ unsigned long wifiAPOffDelay = 0;     // default: never
 
 // WiFi power management in STA mode
 bool          wifiIsOff = false;
+#define WIFI_SETUP_STACK 8192
+
 unsigned long wifiOnNow = 0;
 unsigned long wifiOffDelay     = 0;   // default: never
 unsigned long origWiFiOffDelay = 0;
+static unsigned long cfgWiFiOffDelay = 0;  // As configured; suspended while MQTT/API in use
 
 #ifdef FC_HAVEMQTT
 #define       MQTT_SHORT_INT  (30*1000)
@@ -238,12 +259,18 @@ static bool          mqttSubAttempted = false;
 static bool          mqttOldState = true;
 static bool          mqttDoPing = true;
 static bool          mqttRestartPing = false;
+static bool          mqttConnecting = false;
 static bool          mqttPingDone = false;
 static unsigned long mqttPingNow = 0;
 static unsigned long mqttPingInt = MQTT_SHORT_INT;
 static uint16_t      mqttPingsExpired = 0;
 #endif
 
+#ifdef FC_HAVEAPI
+bool          useAPI = false;
+#endif
+
+static void wifiSetupTask(void *param);
 static void wifiConnect(bool deferConfigPortal = false);
 static void saveParamsCallback();
 static void saveConfigCallback();
@@ -266,13 +293,24 @@ static void setCBVal(WiFiManagerParameter *el, char *sv);
 
 #ifdef FC_HAVEMQTT
 static void strcpyutf8(char *dst, const char *src, unsigned int len);
+static void mqttSetup();
 static void mqttPing();
 static bool mqttReconnect(bool force = false);
-static void mqttLooper();
+static void mqttConnectResult();
 static void mqttCallback(char *topic, byte *payload, unsigned int length);
 static void mqttSubscribe();
+static void mqttPublishState(bool newStats);
+#endif
+
+#ifdef FC_HAVEAPI
+static void apiStart();
+static void apiUpdate();
 #endif
 
+static bool loopStats();
+static void wifiUpdateOffDelay();
+static bool wifi_applySettings(uint32_t changed);
+
 /*
  * wifi_setup()
  *
@@ -311,12 +349,12 @@ void wifi_setup()
     wm.setShowStaticFields(true);
     wm.setShowDnsFields(true);
 
-    temp = atoi(settings.wifiConTimeout);
+    temp = settingsVal.wifiConTimeout;
     if(temp < 7) temp = 7;
     if(temp > 25) temp = 25;
     wm.setConnectTimeout(temp);
 
-    wifiretry = atoi(settings.wifiConRetries);
+    wifiretry = settingsVal.wifiConRetries;
     if(wifiretry < 1) wifiretry = 1;
     if(wifiretry > 10) wifiretry = 10;
     wm.setConnectRetries(wifiretry);
@@ -366,6 +404,12 @@ void wifi_setup()
     wm.addParameter(&custom_useMQTT);
     wm.addParameter(&custom_mqttServer);
     wm.addParameter(&custom_mqttUser);
+    wm.addParameter(&custom_pubMQTT);
+    #endif
+
+    #ifdef FC_HAVEAPI
+    wm.addParameter(&custom_sectstart);     // 2
+    wm.addParameter(&custom_useAPI);
     #endif
 
     wm.addParameter(&custom_sectstart);     // 3
@@ -380,14 +424,8 @@ void wifi_setup()
 
     updateConfigPortalValues();
 
-    #ifdef FC_MDNS
-    if(MDNS.begin(settings.hostName)) {
-        MDNS.addService("http", "tcp", 80);
-    }
-    #endif
-
     // No WiFi powersave features here
-    wifiOffDelay = 0;
+    cfgWiFiOffDelay = wifiOffDelay = 0;
     wifiAPOffDelay = 0;
     
     // Configure static IP
@@ -402,7 +440,7 @@ void wifi_setup()
     {
         wifi_config_t conf;
         esp_wifi_get_config(WIFI_IF_STA, &conf);
-        if((conf.sta.ssid[0] != 0)) {
+        if((wifiHaveSTAConf = (conf.sta.ssid[0] != 0))) {
             if(!strncmp("TCD-AP", (const char *)conf.sta.ssid, 6)) {
                 if(wifiretry < 2) {
                     wm.setConnectRetries(2);
@@ -414,18 +452,63 @@ void wifi_setup()
         }
     }
     
+    // Connecting can take long (timeout, retries), so do this
+    // and the rest in the background while the FC boots. 
+    // wifi_loop() stays idle until wifiSetupDone is set.
     //if(!atoi(settings.wait4TCD)) {
-        wifi_setup2();
+        if(xTaskCreatePinnedToCore(wifiSetupTask, "fcWiFiSetup", WIFI_SETUP_STACK, NULL, 1, NULL, 0) != pdPASS) {
+            wifi_setup2();
+        }
     //}
 }
 
+static void wifiSetupTask(void *param)
+{
+    wifi_setup2();
+    vTaskDelete(NULL);
+}
+
 void wifi_setup2()
 {
+    #ifdef FC_MDNS
+    if(MDNS.begin(settings.hostName)) {
+        MDNS.addService("http", "tcp", 80);
+    }
+    #endif
+
     // Connect, but defer starting the CP
     wifiConnect(true);
 
 #ifdef FC_HAVEMQTT
-    useMQTT = (atoi(settings.useMQTT) > 0);
+    mqttSetup();
+#endif
+
+#ifdef FC_HAVEAPI
+    if((useAPI = (settingsVal.useAPI > 0))) {
+        apiStart();
+    }
+#endif
+
+    // No WiFi power save if we're using MQTT or serving the API
+    wifiUpdateOffDelay();
+
+    // Start the Config Portal. A WiFiScan does not
+    // disturb anything at this point.
+    if(WiFi.status() == WL_CONNECTED) {
+        wifiStartCP();
+    }
+
+    Serial.printf("WiFi setup done after %lums (%s)\n", millis() - powerupMillis, 
+        (WiFi.status() == WL_CONNECTED) ? "connected" : (wifiInAPMode ? "AP mode" : "not connected"));
+
+    wifiSetupDone = true;
+}
+
+#ifdef FC_HAVEMQTT
+// Evaluate MQTT settings; at boot, and when changed in the Config Portal
+static void mqttSetup()
+{
+    useMQTT = (settingsVal.useMQTT > 0);
     
     if((!settings.mqttServer[0]) || // No server -> no MQTT
        (wifiInAPMode))              // WiFi in AP mode -> no MQTT
@@ -433,16 +516,13 @@ void wifi_setup2()
     
     if(useMQTT) {
 
-        bool mqttRes = false;
         char *t;
         int tt;
 
-        // No WiFi power save if we're using MQTT
-        origWiFiOffDelay = wifiOffDelay = 0;
-
+        mqttPort = 1883;
         if((t = strchr(settings.mqttServer, ':'))) {
             strncpy(mqttServer, settings.mqttServer, t - settings.mqttServer);
-            mqttServer[t - settings.mqttServer + 1] = 0;
+            mqttServer[t - settings.mqttServer] = 0;
             tt = atoi(t+1);
             if(tt > 0 && tt <= 65535) {
                 mqttPort = tt;
@@ -451,6 +531,8 @@ void wifi_setup2()
             strcpy(mqttServer, settings.mqttServer);
         }
 
+        mqttDoPing = true;
+
         if(isIp(mqttServer)) {
             mqttClient.setServer(stringToIp(mqttServer), mqttPort);
         } else {
@@ -466,12 +548,12 @@ void wifi_setup2()
         }
         
         mqttClient.setCallback(mqttCallback);
-        mqttClient.setLooper(mqttLooper);
 
+        mqttUser[0] = mqttPass[0] = 0;
         if(settings.mqttUser[0] != 0) {
             if((t = strchr(settings.mqttUser, ':'))) {
                 strncpy(mqttUser, settings.mqttUser, t - settings.mqttUser);
-                mqttUser[t - settings.mqttUser + 1] = 0;
+                mqttUser[t - settings.mqttUser] = 0;
                 strcpy(mqttPass, t + 1);
             } else {
                 strcpy(mqttUser, settings.mqttUser);
@@ -482,6 +564,8 @@ void wifi_setup2()
         Serial.printf("MQTT: server '%s' port %d user '%s' pass '%s'\n", mqttServer, mqttPort, mqttUser, mqttPass);
         #endif
             
+        pubMQTT = (settingsVal.pubMQTT > 0);
+
         mqttReconnect(true);
         // Rest done in loop
             
@@ -492,10 +576,8 @@ void wifi_setup2()
         #endif
 
     }
-#endif
-
-    wifiSetupDone = true;
 }
+#endif
 
 /*
  * wifi_loop()
@@ -505,9 +587,20 @@ void wifi_loop()
 {
     char oldCfgOnSD = 0;
 
+    bool newStats;
+
+    // Still connecting in background
+    if(!wifiSetupDone)
+        return;
+
+    newStats = loopStats();
+
 #ifdef FC_HAVEMQTT
     if(useMQTT) {
         if(mqttClient.state() != MQTT_CONNECTING) {
+            if(mqttConnecting) {
+                mqttConnectResult();
+            }
             if(!mqttClient.connected()) {
                 if(mqttOldState || mqttRestartPing) {
                     // Disconnection first detected:
@@ -518,14 +611,10 @@ void wifi_loop()
                     mqttSubAttempted = false;
                 }
                 if(mqttDoPing && !mqttPingDone) {
-                    audio_loop();
                     mqttPing();
-                    audio_loop();
                 }
                 if(mqttPingDone) {
-                    audio_loop();
                     mqttReconnect();
-                    audio_loop();
                 }
             } else {
                 // Only call Subscribe() if connected
@@ -534,8 +623,17 @@ void wifi_loop()
             }
         }
         mqttClient.loop();
+        if(pubMQTT) {
+            mqttPublishState(newStats);
+        }
     }
-#endif    
+#endif
+
+#ifdef FC_HAVEAPI
+    if(useAPI) {
+        apiUpdate();
+    }
+#endif
     
     wm.process();
     
@@ -563,7 +661,10 @@ void wifi_loop()
 
     if(shouldSaveConfig) {
 
-        // Save settings and restart esp32
+        // Save settings; restart esp32 only if required
+
+        Settings oldSettings = settings;
+        uint32_t changed = 0;
 
         #ifdef FC_DBG
         Serial.println(F("Config Portal: Saving config"));
@@ -627,6 +728,11 @@ void wifi_loop()
 
             #ifdef FC_HAVEMQTT
             mystrcpy(settings.useMQTT, &custom_useMQTT);
+            mystrcpy(settings.pubMQTT, &custom_pubMQTT);
+            #endif
+
+            #ifdef FC_HAVEAPI
+            mystrcpy(settings.useAPI, &custom_useAPI);
             #endif
 
             mystrcpy(settings.shuffle, &custom_shuffle);
@@ -657,6 +763,11 @@ void wifi_loop()
 
             #ifdef FC_HAVEMQTT
             strcpyCB(settings.useMQTT, &custom_useMQTT);
+            strcpyCB(settings.pubMQTT, &custom_pubMQTT);
+            #endif
+
+            #ifdef FC_HAVEAPI
+            strcpyCB(settings.useAPI, &custom_useAPI);
             #endif
 
             strcpyCB(settings.shuffle, &custom_shuffle);
@@ -679,6 +790,22 @@ void wifi_loop()
         if(shouldSaveConfig > 1 || !checkConfigExists()) {
             write_settings();
         }
+
+        // Saving the WiFi config always requires a restart;
+        // other changes are applied live where possible
+        if(shouldSaveConfig > 1) {
+            changed = settings_changed(oldSettings);
+            if(!(changed & SA_REBOOT)) {
+                if(main_applySettings(changed) && wifi_applySettings(changed)) {
+                    #ifdef FC_DBG
+                    Serial.printf("Config Portal: Settings applied (0x%x)\n", changed);
+                    #endif
+                    updateConfigPortalValues();
+                    shouldSaveConfig = 0;
+                    return;
+                }
+            }
+        }
         
         shouldSaveConfig = 0;
 
@@ -687,6 +814,8 @@ void wifi_loop()
         stopAudio();
         allOff();
 
+        settings_flush();
+
         #ifdef FC_DBG
         Serial.println(F("Config Portal: Restarting ESP...."));
         #endif
@@ -892,6 +1021,27 @@ bool wifiIsOn()
     return false;
 }
 
+// WiFi must stay on while MQTT or the API is in use. Otherwise 
+// the configured WiFi-off delay applies (timer restarts now).
+static void wifiUpdateOffDelay()
+{
+    bool keepOn = false;
+
+#ifdef FC_HAVEMQTT
+    keepOn |= useMQTT;
+#endif
+#ifdef FC_HAVEAPI
+    keepOn |= useAPI;
+#endif
+
+    if(keepOn) {
+        origWiFiOffDelay = wifiOffDelay = 0;
+    } else if(origWiFiOffDelay != cfgWiFiOffDelay) {
+        origWiFiOffDelay = wifiOffDelay = cfgWiFiOffDelay;
+        wifiOnNow = millis();
+    }
+}
+
 void wifiStartCP()
 {
     if(wifiInAPMode || wifiIsOff)
@@ -1023,7 +1173,7 @@ static void setupStaticIP()
 void updateConfigPortalValues()
 {
     const char custHTMLSel[] = " selected";
-    int tb = atoi(settings.playFLUXsnd);
+    int tb = settingsVal.playFLUXsnd;
 
     // Make sure the settings form has the correct values
 
@@ -1078,6 +1228,11 @@ void updateConfigPortalValues()
     
     #ifdef FC_HAVEMQTT
     custom_useMQTT.setValue(settings.useMQTT, 1);
+    custom_pubMQTT.setValue(settings.pubMQTT, 1);
+    #endif
+
+    #ifdef FC_HAVEAPI
+    custom_useAPI.setValue(settings.useAPI, 1);
     #endif
 
     custom_shuffle.setValue(settings.shuffle, 1);
@@ -1109,6 +1264,11 @@ void updateConfigPortalValues()
 
     #ifdef FC_HAVEMQTT
     setCBVal(&custom_useMQTT, settings.useMQTT);
+    setCBVal(&custom_pubMQTT, settings.pubMQTT);
+    #endif
+
+    #ifdef FC_HAVEAPI
+    setCBVal(&custom_useAPI, settings.useAPI);
     #endif
 
     setCBVal(&custom_shuffle, settings.shuffle);
@@ -1251,6 +1411,80 @@ static void setCBVal(WiFiManagerParameter *el, char *sv)
 }
 #endif
 
+/*
+ * State model
+ *
+ * The FC's state as published via MQTT (bttf/fc/state/<name>)
+ * and served by the HTTP API (as JSON key <name>). Values are 
+ * ints; if names is given, the value indexes it.
+ * Loop timing (time between wifi_loop() calls) is averaged over
+ * STATS_INT for telemetry/metrics.
+ */
+
+#define STATS_INT  (60*1000)
+
+static const char *stFluxNames[] = { "OFF", "ON", "30", "60" };
+static const char *stTTNames[]   = { "IDLE", "P0", "P1", "P2" };
+static const char *stOnOff[]     = { "OFF", "ON" };
+
+static int stGetFlux()  { return playFLUX; }
+static int stGetSpeed() { return getFluxSpeed(); }
+static int stGetNM()    { return fluxNM ? 1 : 0; }
+static int stGetPower() { return FPBUnitIsOn ? 1 : 0; }
+
+static struct {
+    const char    *name;
+    int           (*get)();
+    const char    **names;        // NULL: Number
+    uint16_t      minInt;         // MQTT: Min interval between publishes (ms)
+    bool          valid;          // MQTT: Last published value
+    int           last;
+    unsigned long pubNow;
+} fcStates[] = {
+    { "flux",     stGetFlux,             stFluxNames, 0    },
+    { "speed",    stGetSpeed,            NULL,        1000 },
+    { "volume",   getVolumePercent,      NULL,        1000 },
+    { "track",    mp_getCurrentSong,     NULL,        0    },
+    { "duration", mp_getCurrentDuration, NULL,        0    },
+    { "tt",       getTTPhase,            stTTNames,   0    },
+    { "night",    stGetNM,               stOnOff,     0    },
+    { "power",    stGetPower,            stOnOff,     0    }
+};
+#define FC_NUM_STATES (int)(sizeof(fcStates) / sizeof(fcStates[0]))
+
+static unsigned long loopLast = 0;
+static unsigned long loopSum = 0;
+static unsigned long loopMax = 0;
+static uint32_t      loopCnt = 0;
+static unsigned long loopStatsNow = 0;
+static unsigned long loopAvg = 0;         // Of last complete STATS_INT
+static unsigned long loopMaxLast = 0;
+
+// Returns true when a new STATS_INT is complete
+static bool loopStats()
+{
+    unsigned long us = micros();
+
+    if(loopLast) {
+        unsigned long d = us - loopLast;
+        loopSum += d;
+        loopCnt++;
+        if(d > loopMax) loopMax = d;
+    }
+    loopLast = us;
+
+    if(millis() - loopStatsNow >= STATS_INT) {
+        loopStatsNow = millis();
+        loopAvg = loopCnt ? loopSum / loopCnt : 0;
+        loopMaxLast = loopMax;
+        loopSum = loopMax = 0;
+        loopCnt = 0;
+        return true;
+    }
+
+    return false;
+}
+
 #ifdef FC_HAVEMQTT
 static void strcpyutf8(char *dst, const char *src, unsigned int len)
 {
@@ -1292,62 +1526,47 @@ static int16_t filterOutUTF8(char *src, char *dst)
     return j;
 }
 
-static void mqttLooper()
-{
-    audio_loop();
-}
+// Sorted by name (binary search)!
+#define MQTT_TOP_FCCMD  1
+#define MQTT_TOP_TCDPUB 2
+static const FCCmdName mqttTopics[] = {
+    { "bttf/fc/cmd",    MQTT_TOP_FCCMD  },
+    { "bttf/tcd/pub",   MQTT_TOP_TCDPUB }
+};
+
+#define MQTT_TCD_PREPARE 1
+#define MQTT_TCD_TT      2
+#define MQTT_TCD_REENTRY 3
+#define MQTT_TCD_ABORT   4
+#define MQTT_TCD_ALARM   5
+static const FCCmdName mqttTCDCmds[] = {
+    { "ABORT_TT",       MQTT_TCD_ABORT   },
+    { "ALARM",          MQTT_TCD_ALARM   },
+    { "PREPARE",        MQTT_TCD_PREPARE },
+    { "REENTRY",        MQTT_TCD_REENTRY },
+    { "TIMETRAVEL",     MQTT_TCD_TT      }
+};
 
 static void mqttCallback(char *topic, byte *payload, unsigned int length)
 {
-    int i = 0, j, ml = (length <= 255) ? length : 255;
-    char tempBuf[256];
-    static const char *cmdList[] = {
-      "TIMETRAVEL",       // 0
-      "FLUX_OFF",         // 1
-      "FLUX_ON",          // 2
-      "FLUX_30",          // 3
-      "FLUX_60",          // 4
-      "MP_SHUFFLE_ON",    // 5 
-      "MP_SHUFFLE_OFF",   // 6
-      "MP_PLAY",          // 7
-      "MP_STOP",          // 8
-      "MP_NEXT",          // 9
-      "MP_PREV",          // 10
-      NULL
-    };
-    static const char *cmdList2[] = {
-      "PREPARE",          // 0
-      "TIMETRAVEL",       // 1
-      "REENTRY",          // 2
-      "ABORT_TT",         // 3
-      "ALARM",            // 4
-      NULL
-    };
+    char *pl = (char *)payload;
+    uint32_t cmd;
 
     if(!length) return;
 
-    memcpy(tempBuf, (const char *)payload, ml);
-    tempBuf[ml] = 0;
-    for(j = 0; j < ml; j++) {
-        if(tempBuf[j] >= 'a' && tempBuf[j] <= 'z') tempBuf[j] &= ~0x20;
+    // Payload lives in the client's receive buffer,
+    // so we can fold it in place.
+    for(unsigned int j = 0; j < length; j++) {
+        if(pl[j] >= 'a' && pl[j] <= 'z') pl[j] &= ~0x20;
     }
 
-    if(!strcmp(topic, "bttf/tcd/pub")) {
+    switch(findCmdName(mqttTopics, sizeof(mqttTopics) / sizeof(mqttTopics[0]), topic, strlen(topic))) {
+    case MQTT_TOP_TCDPUB:
 
         // Commands from TCD
 
-        while(cmdList2[i]) {
-            j = strlen(cmdList2[i]);
-            if((length >= j) && !strncmp((const char *)tempBuf, cmdList2[i], j)) {
-                break;
-            }
-            i++;          
-        }
-
-        if(!cmdList2[i]) return;
-
-        switch(i) {
-        case 0:
+        switch(findCmdName(mqttTCDCmds, sizeof(mqttTCDCmds) / sizeof(mqttTCDCmds[0]), pl, length)) {
+        case MQTT_TCD_PREPARE:
             // Prepare for TT. Comes at some undefined point,
             // an undefined time before the actual tt, and may
             // now come at all.
@@ -1359,7 +1578,7 @@ static void mqttCallback(char *topic, byte *payload, unsigned int length)
                 prepareTT();
             }
             break;
-        case 1:
+        case MQTT_TCD_TT:
             // Trigger Time Travel (if not running already)
             // Ignore command if TCD is connected by wire
             if(!TCDconnected && !TTrunning && !IRLearning) {
@@ -1368,82 +1587,41 @@ static void mqttCallback(char *topic, byte *payload, unsigned int length)
                 networkReentry = false;
                 networkAbort = false;
                 networkLead = ETTO_LEAD;
+                networkLeadNow = millis();
             }
             break;
-        case 2:   // Re-entry
+        case MQTT_TCD_REENTRY:
             // Start re-entry (if TT currently running)
             // Ignore command if TCD is connected by wire
             if(!TCDconnected && TTrunning && networkTCDTT) {
                 networkReentry = true;
             }
             break;
-        case 3:   // Abort TT (TCD fake-powered down during TT)
+        case MQTT_TCD_ABORT:
+            // Abort TT (TCD fake-powered down during TT)
             // Ignore command if TCD is connected by wire
             // (mainly because this is no network-triggered TT)
             if(!TCDconnected && TTrunning && networkTCDTT) {
                 networkAbort = true;
             }
             break;
-        case 4:
+        case MQTT_TCD_ALARM:
             networkAlarm = true;
             // Eval this at our convenience
             break;
         }
+        break;
        
-    } else if(!strcmp(topic, "bttf/fc/cmd")) {
-
-        // User commands
+    case MQTT_TOP_FCCMD:
 
-        // Not taking commands under these circumstances:
-        if(TTrunning || IRLearning || !FPBUnitIsOn)
-            return;
+        // User commands; executed through the command 
+        // queue like IR and BTTFN commands. queueCommand()
+        // refuses them during TT, IR learning and FPO.
 
-        while(cmdList[i]) {
-            j = strlen(cmdList[i]);
-            if((length >= j) && !strncmp((const char *)tempBuf, cmdList[i], j)) {
-                break;
-            }
-            i++;          
+        if((cmd = getCmdByName(pl, length))) {
+            queueCommand(cmd);
         }
-
-        if(!cmdList[i]) return;
-
-        switch(i) {
-        case 0:
-            // Trigger Time Travel; treated like button, not
-            // like TT from TCD.
-            networkTimeTravel = true;
-            networkTCDTT = false;
-            break;
-        case 1:
-        case 2:
-        case 3:
-        case 4:
-            setFluxMode(i - 1);
-            break;
-        case 5:
-        case 6:
-            if(haveMusic) mp_makeShuffle((i == 5));
-            break;
-        case 7:    
-            if(haveMusic) mp_play();
-            break;
-        case 8:
-            if(haveMusic && mpActive) {
-                mp_stop();
-                if(playFLUX) {
-                    play_flux();
-                }
-            }
-            break;
-        case 9:
-            if(haveMusic) mp_next(mpActive);
-            break;
-        case 10:
-            if(haveMusic) mp_prev(mpActive);
-            break;
-        }
-            
+        break;
     } 
 }
 
@@ -1509,24 +1687,14 @@ static bool mqttReconnect(bool force)
                 }
     
                 mqttReconnectNow = millis();
+
+                // connect() does not wait for the broker; the
+                // outcome is evaluated in mqttConnectResult()
+                // once the client leaves MQTT_CONNECTING.
+                mqttConnecting = true;
                 
                 if(!success) {
-                    mqttRestartPing = true;  // Force PING check before reconnection attempt
-                    mqttReconnFails++;
-                    if(mqttDoPing) {
-                        mqttPingInt = MQTT_SHORT_INT * (1 << (mqttReconnFails / MQTT_FAILCOUNT));
-                    } else {
-                        mqttReconnectInt = MQTT_SHORT_INT * (1 << (mqttReconnFails / MQTT_FAILCOUNT));
-                    }
-                    #ifdef FC_DBG
-                    Serial.printf("MQTT: Failed to reconnect (%d)\n", mqttReconnFails);
-                    #endif
-                } else {
-                    mqttReconnFails = 0;
-                    mqttReconnectInt = MQTT_SHORT_INT;
-                    #ifdef FC_DBG
-                    Serial.println("MQTT: Connected to broker, waiting for CONNACK");
-                    #endif
+                    mqttConnectResult();
                 }
     
                 return success;
@@ -1537,6 +1705,47 @@ static bool mqttReconnect(bool force)
     return true;
 }
 
+/*
+ * Evaluate the outcome of a connection attempt
+ * Everything but MQTT_CONNECTED counts as a failure and
+ * stretches the reconnection interval: DNS/TCP errors
+ * (MQTT_CONNECT_FAILED), CONNACK time-outs and lost
+ * connections as well as CONNACK refusals (1-5). Only
+ * for the former a PING check is done before the next 
+ * attempt; a broker that refused us is reachable.
+ */
+static void mqttConnectResult()
+{
+    int state = mqttClient.state();
+    unsigned long newInt;
+    
+    mqttConnecting = false;
+
+    if(state == MQTT_CONNECTED) {
+        mqttReconnFails = 0;
+        mqttReconnectInt = MQTT_SHORT_INT;
+        return;
+    }
+
+    mqttReconnFails++;
+    newInt = MQTT_SHORT_INT * (1 << (mqttReconnFails / MQTT_FAILCOUNT));
+    
+    if(state > MQTT_CONNECTED) {
+        mqttReconnectInt = newInt;
+    } else {
+        mqttRestartPing = true;  // Force PING check before reconnection attempt
+        if(mqttDoPing) {
+            mqttPingInt = newInt;
+        } else {
+            mqttReconnectInt = newInt;
+        }
+    }
+    
+    #ifdef FC_DBG
+    Serial.printf("MQTT: Failed to reconnect (%d, state %d)\n", mqttReconnFails, state);
+    #endif
+}
+
 static void mqttSubscribe()
 {
     // Meant only to be called when connected!
@@ -1555,11 +1764,389 @@ bool mqttState()
     return (useMQTT && mqttClient.connected());
 }
 
-void mqttPublish(const char *topic, const char *pl, unsigned int len)
+/*
+ * Messages are queued and sent from wifi_loop(); while
+ * disconnected, only the latest message per topic is kept.
+ * State changes should use QoS 1 so that they survive
+ * a lost connection.
+ */
+bool mqttPublish(const char *topic, const char *pl, unsigned int len, bool retained, bool qos1)
 {
     if(useMQTT) {
-        mqttClient.publish(topic, (uint8_t *)pl, len, false);
+        return mqttClient.queue(topic, (uint8_t *)pl, len, retained, qos1 ? 1 : 0);
     }
+
+    return false;
 }           
 
+
+/*
+ * State publishing
+ *
+ * Retained state topics are published with QoS 1 whenever a 
+ * value changes, but not more often than the topic's minimum 
+ * interval allows. Telemetry (loop timing, heap, audio 
+ * underruns; BTTFN round trip times) is published periodically.
+ * Values are formatted into mqttPubBuf and copied into the 
+ * client's queue.
+ */
+
+#define MQTT_STATE_INT  100         // Check for state changes every 100ms
+
+static char          mqttPubBuf[MQTT_TXQ_PLEN];
+static unsigned long mqttStateNow = 0;
+
+static void mqttPublishState(bool newStats)
+{
+    unsigned long now = millis();
+    char topic[MQTT_TXQ_TLEN];
+    int i, val, len;
+    uint16_t srtt, rttvar, rttmin;
+
+    if(now - mqttStateNow >= MQTT_STATE_INT) {
+        mqttStateNow = now;
+        for(i = 0; i < FC_NUM_STATES; i++) {
+            val = fcStates[i].get();
+            if(fcStates[i].valid && val == fcStates[i].last)
+                continue;
+            if(fcStates[i].valid && (now - fcStates[i].pubNow < fcStates[i].minInt))
+                continue;
+            if(fcStates[i].names) {
+                len = strlen(strcpy(mqttPubBuf, fcStates[i].names[val]));
+            } else {
+                len = sprintf(mqttPubBuf, "%d", val);
+            }
+            snprintf(topic, sizeof(topic), "bttf/fc/state/%s", fcStates[i].name);
+            if(mqttPublish(topic, mqttPubBuf, len, true, true)) {
+                fcStates[i].last = val;
+                fcStates[i].valid = true;
+                fcStates[i].pubNow = now;
+            }
+        }
+    }
+
+    if(newStats) {
+        len = snprintf(mqttPubBuf, sizeof(mqttPubBuf), 
+                  "{\"loop\":%lu,\"loop_max\":%lu,\"heap\":%u,\"heap_min\":%u,\"underruns\":%u}",
+                  loopAvg, loopMaxLast,
+                  ESP.getFreeHeap(), ESP.getMinFreeHeap(), audio_getUnderruns());
+        if(len >= (int)sizeof(mqttPubBuf)) len = sizeof(mqttPubBuf) - 1;
+        mqttPublish("bttf/fc/telemetry", mqttPubBuf, len);
+        if(bttfn_getRTT(&srtt, &rttvar, &rttmin)) {
+            len = sprintf(mqttPubBuf, "{\"rtt\":%u,\"rtt_var\":%u,\"rtt_min\":%u}",
+                      srtt, rttvar, rttmin);
+            mqttPublish("bttf/fc/telemetry/bttfn", mqttPubBuf, len);
+        }
+    }
+}
+
+#endif
+
+#ifdef FC_HAVEAPI
+/*
+ * HTTP API
+ *
+ * A minimal HTTP/1.1 server on API_PORT (the Config Portal 
+ * occupies port 80), run by its own task on core 0:
+ *   GET  /api/state    State as JSON, keys as in fcStates[]
+ *   GET  /api/metrics  Loop timing, heap, underruns, uptime
+ *   POST /api/cmd      Body: Command name as for MQTT (eg "MP_NEXT")
+ * One connection is served at a time and closed afterwards.
+ * The task never calls into the rest of the firmware: The main
+ * loop serializes state and metrics into apiState/apiMetrics
+ * every API_STATE_INT, the task only copies them out. Commands
+ * go through the command queue, like those from IR, BTTFN and
+ * MQTT. All buffers are static.
+ */
+
+#define API_STATE_INT   250
+#define API_RX_TIMEOUT  2           // seconds
+#define API_RXBUF_SIZE  512
+#define API_JSON_SIZE   256
+#define API_TASK_STACK  4096
+
+static TaskHandle_t  apiTask = NULL;
+static portMUX_TYPE  apiMux = portMUX_INITIALIZER_UNLOCKED;
+static char          apiState[API_JSON_SIZE];
+static char          apiMetrics[API_JSON_SIZE];
+static char          apiBuildBuf[API_JSON_SIZE];
+static int           apiStateLen = 0;
+static int           apiMetricsLen = 0;
+static unsigned long apiStateNow = 0;
+static uint32_t      apiRequests = 0;
+
+static char          apiRxBuf[API_RXBUF_SIZE + 1];
+static char          apiTxBuf[API_JSON_SIZE + 160];
+
+static void apiSetBuf(char *dst, int& dstLen, int len)
+{
+    if(len >= API_JSON_SIZE) return;
+
+    portENTER_CRITICAL(&apiMux);
+    memcpy(dst, apiBuildBuf, len);
+    dstLen = len;
+    portEXIT_CRITICAL(&apiMux);
+}
+
+// Called from wifi_loop()
+static void apiUpdate()
+{
+    int i, val, len;
+    uint16_t srtt, rttvar, rttmin;
+    bool haveRTT;
+
+    if(millis() - apiStateNow < API_STATE_INT)
+        return;
+    
+    apiStateNow = millis();
+
+    len = 1;
+    apiBuildBuf[0] = '{';
+    for(i = 0; i < FC_NUM_STATES && len < API_JSON_SIZE; i++) {
+        val = fcStates[i].get();
+        if(fcStates[i].names) {
+            len += snprintf(apiBuildBuf + len, API_JSON_SIZE - len, "%s\"%s\":\"%s\"", 
+                        i ? "," : "", fcStates[i].name, fcStates[i].names[val]);
+        } else {
+            len += snprintf(apiBuildBuf + len, API_JSON_SIZE - len, "%s\"%s\":%d", 
+                        i ? "," : "", fcStates[i].name, val);
+        }
+    }
+    if(len < API_JSON_SIZE - 1) {
+        apiBuildBuf[len++] = '}';
+        apiSetBuf(apiState, apiStateLen, len);
+    }
+
+    haveRTT = bttfn_getRTT(&srtt, &rttvar, &rttmin);
+    len = snprintf(apiBuildBuf, API_JSON_SIZE,
+              "{\"uptime\":%lu,\"loop\":%lu,\"loop_max\":%lu,\"heap\":%u,\"heap_min\":%u,"
+              "\"underruns\":%u,\"rssi\":%d,\"requests\":%u,"
+              "\"rtt\":%d,\"rtt_var\":%d,\"rtt_min\":%d}",
+              millis() / 1000, loopAvg, loopMaxLast, ESP.getFreeHeap(), ESP.getMinFreeHeap(),
+              audio_getUnderruns(), (WiFi.status() == WL_CONNECTED) ? WiFi.RSSI() : 0, apiRequests,
+              haveRTT ? srtt : -1, haveRTT ? rttvar : -1, haveRTT ? rttmin : -1);
+    apiSetBuf(apiMetrics, apiMetricsLen, len);
+}
+
+static void apiSend(int s, int code, const char *body, int bodyLen)
+{
+    const char *status;
+    int len;
+
+    switch(code) {
+    case 200: status = "OK";                 break;
+    case 400: status = "Bad Request";        break;
+    case 404: status = "Not Found";          break;
+    case 405: status = "Method Not Allowed"; break;
+    default:  status = "Service Unavailable";
+    }
+
+    len = snprintf(apiTxBuf, sizeof(apiTxBuf) - API_JSON_SIZE,
+              "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %d\r\n"
+              "Cache-Control: no-store\r\nConnection: close\r\n\r\n", code, status, bodyLen);
+    memcpy(apiTxBuf + len, body, bodyLen);
+    
+    send(s, apiTxBuf, len + bodyLen, 0);
+}
+
+static void apiSendBuf(int s, const char *buf, const int& bufLen)
+{
+    char body[API_JSON_SIZE];
+    int len;
+
+    portENTER_CRITICAL(&apiMux);
+    memcpy(body, buf, len = bufLen);
+    portEXIT_CRITICAL(&apiMux);
+
+    if(!len) {
+        apiSend(s, 503, "{\"error\":\"not ready\"}", 21);
+    } else {
+        apiSend(s, 200, body, len);
+    }
+}
+
+static void apiCommand(int s, char *pl, int length)
+{
+    uint32_t cmd;
+
+    for(int j = 0; j < length; j++) {
+        if(pl[j] >= 'a' && pl[j] <= 'z') pl[j] &= ~0x20;
+    }
+
+    if(!(cmd = getCmdByName(pl, length))) {
+        apiSend(s, 400, "{\"error\":\"unknown command\"}", 27);
+    } else if(!queueCommand(cmd)) {
+        apiSend(s, 503, "{\"error\":\"busy\"}", 16);
+    } else {
+        apiSend(s, 200, "{\"result\":\"ok\"}", 15);
+    }
+}
+
+static void apiHandle(int s)
+{
+    char *hdrEnd = NULL, *path, *p;
+    int len = 0, r, cl = 0;
+    bool isPost;
+
+    // Read request head, and body as per Content-Length
+    while(len < API_RXBUF_SIZE) {
+        if((r = recv(s, apiRxBuf + len, API_RXBUF_SIZE - len, 0)) <= 0)
+            return;
+        len += r;
+        apiRxBuf[len] = 0;
+        if(!hdrEnd && (hdrEnd = strstr(apiRxBuf, "\r\n\r\n"))) {
+            hdrEnd += 4;
+            if((p = strcasestr(apiRxBuf, "\r\nContent-Length:")) && p < hdrEnd) {
+                cl = atoi(p + 17);
+            }
+            if(cl < 0 || hdrEnd - apiRxBuf + cl > API_RXBUF_SIZE) {
+                apiSend(s, 400, "{\"error\":\"too long\"}", 20);
+                return;
+            }
+        }
+        if(hdrEnd && (len >= hdrEnd - apiRxBuf + cl))
+            break;
+    }
+    if(!hdrEnd) {
+        apiSend(s, 400, "{\"error\":\"bad request\"}", 23);
+        return;
+    }
+
+    apiRequests++;
+
+    isPost = !strncmp(apiRxBuf, "POST ", 5);
+    if(!isPost && strncmp(apiRxBuf, "GET ", 4)) {
+        apiSend(s, 405, "{\"error\":\"method\"}", 18);
+        return;
+    }
+    path = apiRxBuf + (isPost ? 5 : 4);
+    if(!(p = strpbrk(path, " ?\r"))) p = path;
+    len = p - path;
+
+    #define API_PATH(x) (len == (int)sizeof(x) - 1 && !strncmp(path, x, len))
+
+    if(API_PATH("/api/state") || API_PATH("/api/metrics")) {
+        if(isPost) {
+            apiSend(s, 405, "{\"error\":\"method\"}", 18);
+        } else if(path[5] == 's') {
+            apiSendBuf(s, apiState, apiStateLen);
+        } else {
+            apiSendBuf(s, apiMetrics, apiMetricsLen);
+        }
+    } else if(API_PATH("/api/cmd")) {
+        if(!isPost) {
+            apiSend(s, 405, "{\"error\":\"method\"}", 18);
+        } else {
+            apiCommand(s, hdrEnd, cl);
+        }
+    } else {
+        apiSend(s, 404, "{\"error\":\"not found\"}", 21);
+    }
+}
+
+static void apiTaskFn(void *param)
+{
+    struct sockaddr_in addr;
+    struct timeval tv = { API_RX_TIMEOUT, 0 };
+    int ls, cs, one = 1;
+
+    if((ls = socket(AF_INET, SOCK_STREAM, IPPROTO_IP)) < 0) {
+        Serial.println(F("API: Failed to create socket"));
+        vTaskDelete(NULL);
+        return;
+    }
+    setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(API_PORT);
+    if(bind(ls, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(ls, 2) < 0) {
+        Serial.println(F("API: Failed to bind socket"));
+        close(ls);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    for(;;) {
+        if((cs = accept(ls, NULL, NULL)) < 0) {
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+        if(useAPI) {
+            setsockopt(cs, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            setsockopt(cs, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+            apiHandle(cs);
+        }
+        close(cs);
+    }
+}
+
+static void apiStart()
+{
+    if(xTaskCreatePinnedToCore(apiTaskFn, "fcAPI", API_TASK_STACK, NULL, 1, &apiTask, 0) != pdPASS) {
+        apiTask = NULL;
+        Serial.println(F("API: Failed to create task"));
+    }
+
+    #ifdef FC_DBG
+    Serial.printf("API: Listening on port %d\n", API_PORT);
+    #endif
+}
 #endif
+
+/*
+ * Bring changed network-related settings into effect.
+ * Returns false if a reboot is required after all.
+ */
+static bool wifi_applySettings(uint32_t changed)
+{
+    if(changed & SA_WIFI) {
+        int temp = settingsVal.wifiConTimeout;
+        if(temp < 7) temp = 7;
+        if(temp > 25) temp = 25;
+        wm.setConnectTimeout(temp);
+        temp = settingsVal.wifiConRetries;
+        if(temp < 1) temp = 1;
+        if(temp > 10) temp = 10;
+        wm.setConnectRetries(temp);
+    }
+
+#ifdef FC_HAVEMQTT
+    if(changed & SA_MQTT) {
+        if(useMQTT) {
+            mqttClient.disconnect();
+            mqttConnecting = false;
+            mqttOldState = true;
+            mqttReconnectNow = 0;
+            mqttReconnectInt = MQTT_SHORT_INT;
+            mqttReconnFails = 0;
+            mqttPingInt = MQTT_SHORT_INT;
+            mqttPingsExpired = 0;
+        }
+        // Republish full state to the (new) broker
+        for(int i = 0; i < FC_NUM_STATES; i++) {
+            fcStates[i].valid = false;
+        }
+        mqttSetup();
+    }
+#endif
+
+#ifdef FC_HAVEAPI
+    if(changed & SA_API) {
+        // The server task is kept once started;
+        // it refuses connections while disabled
+        if((useAPI = (settingsVal.useAPI > 0))) {
+            if(!apiTask) {
+                apiStart();
+            }
+        }
+    }
+#endif
+
+    if(changed & (SA_MQTT | SA_API)) {
+        wifiUpdateOffDelay();
+    }
+
+    return true;
+}
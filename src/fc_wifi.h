@@ -33,7 +33,8 @@
 #ifndef _FC_WIFI_H
 #define _FC_WIFI_H
 
-extern bool wifiSetupDone;
+extern volatile bool wifiSetupDone;
+extern bool wifiHaveSTAConf;
 extern bool wifiIsOff;
 extern bool wifiAPIsOff;
 extern bool wifiInAPMode;
@@ -48,6 +49,11 @@ void wifiStartCP();
 
 void updateConfigPortalValues();
 
+#ifdef FC_HAVEMQTT
+bool mqttState();
+bool mqttPublish(const char *topic, const char *pl, unsigned int len, bool retained = false, bool qos1 = false);
+#endif
+
 bool wifi_getIP(uint8_t& a, uint8_t& b, uint8_t& c, uint8_t& d);
 bool isIp(char *str);
 
@@ -86,6 +86,48 @@
 
 /*  Changelog
  *
+ *  2023/10/02 (A10001986)
+ *    - Audio: Integer (Q15) gain with ramped changes; volume steps now evenly
+ *      spaced in dB; MP3 decoder synthesizes only one (mixed) channel
+ *    - libmad: Use ESP32 32x32->64 multiply instructions
+ *    - MQTT: Non-blocking connect and incremental packet reception
+ *    - MQTT: Queued publishing (latest message per topic) with QoS 1 support
+ *    - MQTT: Optionally publish state and telemetry; commands dispatched through
+ *      remote command queue
+ *    - Volume, speed, box light level, IR lock, idle pattern and music folder
+ *      now kept in binary journal ("fcstate.bin"); old JSON files migrated
+ *    - Secondary settings written by low-priority background task
+ *    - Main config parsed by table-driven streaming reader (no JSON document);
+ *      numerical settings kept as integers
+ *    - Faster boot: WiFi connect (and MQTT, mDNS) runs in background; boot
+ *      timing logged
+ *    - Music player initialized on first use; folder summary cached
+ *    - Audio file installer: Double-buffered copy, CRC32 verification (manifest
+ *      in FC_def_snd.txt), resumable; no longer formats flash FS on failure
+ *    - Default sounds can be installed as a packed "sound bank" (one file
+ *      containing all sounds, ID3 tags removed, frame index). The sound-pack
+ *      contains the bank; tools/mkfcbank.py builds it from the single files.
+ *      The bank stays open, so playback of default sounds no longer involves
+ *      opening and parsing a file.
+ *    - Optional sound partition (see partitions_fcsnd.csv): The sound bank is
+ *      installed to this partition and played back from memory-mapped flash;
+ *      the MP3 decoder reads mapped data in place instead of copying it.
+ *    - Music player: Index mp3 frames of songs in background (stored as 
+ *      ".xxx.idx" next to song); allows frame-accurate seeking, MQTT 
+ *      commands MP_FWD/MP_REW and publishing song duration
+ *    - Music player: Remember song and position when stopped, and save it
+ *      (with shuffle seed) to settings store every minute while playing; 
+ *      playback resumes there after reboot and after fake power on
+ *    - Music player: Shuffle without play list; track order is a keyed
+ *      permutation (Feistel network with cycle walking) derived from a
+ *      16-bit seed. Saves up to 2KB of RAM.
+ *    - Add HTTP API (port 8080, to be enabled in Config Portal): GET /api/state,
+ *      /api/metrics, POST /api/cmd. Served by its own task from buffers the 
+ *      main loop refreshes. MQTT state publishing and API share the same
+ *      state table. Make command queue safe for multiple producers.
+ *    - Config Portal: Apply changed settings without reboot where possible;
+ *      only hardware/hostname/AP/secondary-storage settings still reboot.
+ *      Fix MQTT server/user parsing when a port or password was given.
  *  2023/09/30 (A10001986)
  *    - Extend remote commands to 32 bit
  *    - Fix ring buffer handling for remote commands
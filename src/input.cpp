@@ -202,7 +202,7 @@ bool IRRemote::calcHash()
     
     uint32_t hash = FNV_BASIS_32;
     
-    for(int i = 1; i + 2 < _buflen; i++) {
+    for(uint32_t i = 1; i + 2 < _buflen; i++) {
         hash = (hash * FNV_PRIME_32) ^ compare(_buf[i], _buf[i+2]);
     }
     
@@ -357,3 +357,121 @@ void FCButton::transitionTo(ButtonState nextState)
     _state = nextState;
 }
  
+
+/*
+ * FCPot class
+ *
+ * Samples a pot every <interval> ms, removes spikes through a median-of-5,
+ * smoothes small changes through a first-order IIR (bigger moves are
+ * followed at once), and only reports a new value if it moved by more
+ * than <hyst>. Values within <hyst> of an end stop are reported as the
+ * end stop, so the end stops can be reached without giving up the
+ * hysteresis there. Callers read the cached value; scan() returns true
+ * when it changed.
+ *
+ * The ADC's continuous (DMA) mode is not used since the ESP32 routes it
+ * through I2S0, which is taken by audio output.
+ *
+ * Callers only scan() a pot while it is in use; after a pause, the
+ * filter restarts from a fresh sample instead of crawling from the
+ * stale value.
+ */
+
+FCPot::FCPot(const int pin, const unsigned long interval, const uint16_t hyst)
+{
+    _pin = pin;
+    _interval = interval;
+    _hyst = hyst;
+}
+
+void FCPot::begin()
+{
+    analogReadResolution(POT_RESOLUTION);
+    analogSetWidth(POT_RESOLUTION);
+
+    prime();
+}
+
+#define POT_SNAP 8   // Moves bigger than this are not smoothed
+
+bool FCPot::scan()
+{
+    unsigned long now = millis();
+    uint16_t newVal;
+    int32_t diff;
+
+    if(now - _lastScan < _interval)
+        return false;
+
+    if(now - _lastScan > _interval * 4) {
+        newVal = _value;
+        prime();
+        return (_value != newVal);
+    }
+
+    _lastScan = now;
+
+    _raw[_rawIdx] = analogRead(_pin);
+    if(++_rawIdx >= POT_MEDIAN) _rawIdx = 0;
+
+    // y += (x - y) / 8, or y = x for big moves
+    diff = ((int32_t)median() << 4) - _filt;
+    if(diff > (POT_SNAP << 4) || diff < -(POT_SNAP << 4)) {
+        _filt += diff;
+    } else {
+        _filt += diff >> 3;
+    }
+    newVal = (_filt + 8) >> 4;
+
+    diff = (int32_t)newVal - _held;
+    if(diff < 0) diff = -diff;
+
+    if(diff > _hyst) {
+        _held = newVal;
+        newVal = endStops(_held);
+        if(newVal != _value) {
+            _value = newVal;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Private
+ */
+
+void FCPot::prime()
+{
+    for(int i = 0; i < POT_MEDIAN; i++) {
+        _raw[i] = analogRead(_pin);
+    }
+    _held = median();
+    _filt = _held << 4;
+    _value = endStops(_held);
+    _lastScan = millis();
+}
+
+uint16_t FCPot::median()
+{
+    uint16_t s[POT_MEDIAN], t;
+    int i, j;
+
+    for(i = 0; i < POT_MEDIAN; i++) {
+        t = _raw[i];
+        for(j = i; j > 0 && s[j - 1] > t; j--) {
+            s[j] = s[j - 1];
+        }
+        s[j] = t;
+    }
+
+    return s[POT_MEDIAN / 2];
+}
+
+uint16_t FCPot::endStops(uint16_t val)
+{
+    if(val <= _hyst) return 0;
+    if(val >= POT_MAX - _hyst) return POT_MAX;
+    return val;
+}
@@ -125,4 +125,42 @@ class FCButton {
         bool _pressNotified = false;
 };
 
+/*
+ * FCPot class
+ */
+
+// Resolution for pots, 9-12 allowed
+#define POT_RESOLUTION 9
+#define POT_MAX        ((1 << POT_RESOLUTION) - 1)
+#define POT_MEDIAN     5        // Median filter taps
+
+class FCPot {
+
+    public:
+        FCPot(const int pin, const unsigned long interval = 20, const uint16_t hyst = 2);
+
+        void begin();
+
+        bool scan();
+        uint16_t value() { return _value; }
+
+    private:
+        void prime();
+        uint16_t median();
+        uint16_t endStops(uint16_t val);
+
+        int _pin;
+
+        unsigned long _interval;
+        unsigned long _lastScan = 0;
+
+        uint16_t _hyst;
+
+        uint16_t _raw[POT_MEDIAN];
+        uint8_t  _rawIdx = 0;
+        int32_t  _filt;           // IIR state, 4 fractional bits
+        uint16_t _held = 0;       // After hysteresis
+        uint16_t _value = 0;
+};
+
 #endif
@@ -44,12 +44,32 @@
 #include "lwip/netdb.h"
 #include "lwip/dns.h"
 
-static void defLooper()
+/*
+ * DNS result for async connect. The callback runs in
+ * the lwip thread; a lookup is only ever outstanding
+ * for one client at a time.
+ */
+#define DNS_PENDING   0
+#define DNS_OK        1
+#define DNS_FAILED    2
+
+static volatile int      dnsResult = DNS_PENDING;
+static volatile uint32_t dnsAddr = 0;
+
+static void dnsFound(const char *, const ip_addr_t *ipaddr, void *)
 {
+    if(ipaddr && ipaddr->u_addr.ip4.addr) {
+        dnsAddr = ipaddr->u_addr.ip4.addr;
+        dnsResult = DNS_OK;
+    } else {
+        dnsResult = DNS_FAILED;
+    }
 }
 
 PubSubClient::PubSubClient()
 {
+    memset(_txq, 0, sizeof(_txq));
+    this->nextMsgId = 1;
     this->_state = MQTT_DISCONNECTED;
     this->_client = NULL;
     setCallback(NULL);
@@ -57,23 +77,24 @@ PubSubClient::PubSubClient()
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
-    setLooper(defLooper);
 }
 
 PubSubClient::PubSubClient(WiFiClient& client)
 {
+    memset(_txq, 0, sizeof(_txq));
+    this->nextMsgId = 1;
     this->_state = MQTT_DISCONNECTED;
     setClient(client);
     this->bufferSize = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
-    setLooper(defLooper);
 }
 
 PubSubClient::~PubSubClient()
 {
     free(this->buffer);
+    free(this->rxBuffer);
 }
 
 bool PubSubClient::connect(const char *id)
@@ -86,244 +107,410 @@ bool PubSubClient::connect(const char *id, const char *user, const char *pass)
     return connect(id, user, pass, true);
 }
 
+/*
+ * connect() only starts the connection process; it never 
+ * waits for the network. DNS lookup (if a domain was given),
+ * TCP connect and CONNACK are driven by loop(). state()
+ * stays MQTT_CONNECTING until the broker has accepted us 
+ * (MQTT_CONNECTED) or something failed (MQTT_CONNECT_FAILED 
+ * for DNS/TCP errors, other codes as before). 
+ * id, user and pass must remain valid until then.
+ */
 bool PubSubClient::connect(const char *id, const char *user, const char *pass, bool cleanSession)
 {
-    if(!connected()) {
+    if(connected())
+        return true;
 
-        int result = 0;
+    if(_state == MQTT_CONNECTING)
+        return true;
 
-        if(_client->connected()) {
-            result = 1;
-        } else {
-            if(domain) {
-                result = _client->connect(this->domain, this->port, (int)5000);
-            } else {
-                result = _client->connect(this->ip, this->port, (int)5000);
-            }
-        }
+    _cid = id;
+    _cuser = user;
+    _cpass = pass;
+    _cclean = cleanSession;
 
-        if(result == 1) {
-          
-            nextMsgId = 1;
-            
-            // Leave room in the buffer for header and variable length field
-            uint16_t length = MQTT_MAX_HEADER_SIZE;
-            unsigned int j;
+    _rxState = RX_HDR;
+    _rxOvfl = false;
+    
+    _state = MQTT_CONNECTING;
+    _cNow = millis();
 
-#if MQTT_VERSION == MQTT_VERSION_3_1
-            uint8_t d[9] = { 0x00, 0x06, 'M', 'Q', 'I', 's', 'd', 'p', MQTT_VERSION };
-            #define MQTT_HEADER_VERSION_LENGTH 9
-#elif MQTT_VERSION == MQTT_VERSION_3_1_1
-            uint8_t d[7] = { 0x00, 0x04, 'M', 'Q', 'T', 'T', MQTT_VERSION };
-            #define MQTT_HEADER_VERSION_LENGTH 7
-#endif
-            for(j = 0; j < MQTT_HEADER_VERSION_LENGTH; j++) {
-                this->buffer[length++] = d[j];
-            }
+    if(_client->connected()) {
+        return sendConnect();
+    }
 
-            uint8_t v = 0;
-            
-            if(cleanSession) v |= 0x02;
+    if(domain) {
+        ip_addr_t addr;
+        dnsResult = DNS_PENDING;
+        err_t err = dns_gethostbyname(this->domain, &addr, dnsFound, NULL);
+        if(err == ERR_OK && addr.u_addr.ip4.addr) {
+            _cip = addr.u_addr.ip4.addr;
+        } else if(err == ERR_INPROGRESS) {
+            _cstate = CONN_DNS;
+            return true;
+        } else {
+            connectFailed(MQTT_CONNECT_FAILED);
+            return false;
+        }
+    } else {
+        _cip = (uint32_t)this->ip;
+    }
 
-            if(user) {
-                v |= 0x80;
-                if(pass) {
-                    v |= 0x40;
-                }
-            }
-            this->buffer[length++] = v;
+    return startConnect();
+}
 
-            this->buffer[length++] = (this->keepAlive >> 8);
-            this->buffer[length++] = (this->keepAlive & 0xff);
+// Open socket and initiate non-blocking TCP connect to _cip
+bool PubSubClient::startConnect()
+{
+    struct sockaddr_in addr;
+    
+    if((_cs = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        connectFailed(MQTT_CONNECT_FAILED);
+        return false;
+    }
 
-            CHECK_STRING_LENGTH(length, id)
-            length = writeString(id, this->buffer, length);
+    fcntl(_cs, F_SETFL, fcntl(_cs, F_GETFL, 0) | O_NONBLOCK);
 
-            if(user) {
-                CHECK_STRING_LENGTH(length, user)
-                length = writeString(user, this->buffer, length);
-                if(pass) {
-                    CHECK_STRING_LENGTH(length, pass)
-                    length = writeString(pass, this->buffer, length);
-                }
-            }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = _cip;
+    addr.sin_port = htons(this->port);
 
-            write(MQTTCONNECT, this->buffer, length - MQTT_MAX_HEADER_SIZE);
+    if(lwip_connect(_cs, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        connectFailed(MQTT_CONNECT_FAILED);
+        return false;
+    }
 
-            lastInActivity = lastOutActivity = millis();
+    _cstate = CONN_TCP;
+    _cNow = millis();
 
-            _state = MQTT_CONNECTING;
+    return true;
+}
 
-            return true;
+// Advance the connect process; called from loop()
+bool PubSubClient::pollConnect()
+{
+    unsigned long now = millis();
+    
+    switch(_cstate) {
+    case CONN_DNS:
+        if(dnsResult == DNS_OK) {
+            _cip = dnsAddr;
+            return startConnect();
+        } else if(dnsResult == DNS_FAILED || (now - _cNow >= this->socketTimeout)) {
+            #ifdef FC_DBG
+            Serial.println("MQTT: DNS lookup failed");
+            #endif
+            connectFailed(MQTT_CONNECT_FAILED);
+            return false;
+        }
+        break;
+        
+    case CONN_TCP:
+        {
+            fd_set fdset;
+            struct timeval tv = { 0, 0 };
+            int res, sockerr = 0;
+            socklen_t len = sizeof(sockerr);
             
-        } else {
+            FD_ZERO(&fdset);
+            FD_SET(_cs, &fdset);
 
-            _state = MQTT_CONNECT_FAILED;
+            res = select(_cs + 1, NULL, &fdset, NULL, &tv);
+            
+            if(!res) {
+                if(now - _cNow >= MQTT_CONNECT_TIMEOUT) {
+                    #ifdef FC_DBG
+                    Serial.println("MQTT: TCP connect timed-out");
+                    #endif
+                    connectFailed(MQTT_CONNECT_FAILED);
+                    return false;
+                }
+                break;
+            }
+            
+            if(res < 0 || getsockopt(_cs, SOL_SOCKET, SO_ERROR, &sockerr, &len) < 0 || sockerr) {
+                connectFailed(MQTT_CONNECT_FAILED);
+                return false;
+            }
+
+            // Back to blocking mode for WiFiClient
+            fcntl(_cs, F_SETFL, fcntl(_cs, F_GETFL, 0) & ~O_NONBLOCK);
+            res = 1;
+            setsockopt(_cs, IPPROTO_TCP, TCP_NODELAY, &res, sizeof(res));
+            setsockopt(_cs, SOL_SOCKET, SO_KEEPALIVE, &res, sizeof(res));
 
+            // WiFiClient takes ownership of the socket
+            *_client = WiFiClient(_cs);
+            _cs = -1;
+
+            return sendConnect();
         }
         
-        return false;
-        
+    case CONN_ACK:
+        if(readPacket()) {
+            if(_rxLen == 4 && (rxBuffer[0] & 0xf0) == MQTTCONNACK) {
+                if(rxBuffer[3] == 0) {
+                    lastInActivity = millis();
+                    pingOutstanding = false;
+                    _cstate = CONN_IDLE;
+                    _state = MQTT_CONNECTED;
+                    requeue();
+                    #ifdef FC_DBG
+                    Serial.println("MQTT: CONNACK received");
+                    #endif
+                    return true;
+                }
+                connectFailed(rxBuffer[3]);
+            } else {
+                connectFailed(MQTT_CONNECT_BAD_PROTOCOL);
+            }
+            #ifdef FC_DBG
+            Serial.printf("MQTT: CONNACK failed, state %d\n", _state);
+            #endif
+            return false;
+        } else if(_state != MQTT_CONNECTING) {
+            // Parser dropped the connection
+            connectFailed(MQTT_CONNECT_BAD_PROTOCOL);
+            return false;
+        } else if(now - lastInActivity >= this->socketTimeout) {
+            #ifdef FC_DBG
+            Serial.println("MQTT: CONNACK timed-out");
+            #endif
+            connectFailed(MQTT_CONNECTION_TIMEOUT);
+            return false;
+        }
+        break;
     }
-    
+
     return true;
 }
 
-// reads a byte into result
-bool PubSubClient::readByte(uint8_t *result)
+#define CHECK_CONN_STRING_LENGTH(l,s) if(l+2+strnlen(s, this->bufferSize) > this->bufferSize) { connectFailed(MQTT_CONNECT_FAILED); return false; }
+
+/*
+ * nextMsgId is not reset here: Unacknowledged QoS1 messages
+ * keep their id across a reconnect, so new ones must not 
+ * start over.
+ */
+bool PubSubClient::sendConnect()
 {
-    unsigned long mnow, currentMillis;
-    unsigned long previousMillis = millis();
+    // Leave room in the buffer for header and variable length field
+    uint16_t length = MQTT_MAX_HEADER_SIZE;
+    unsigned int j;
 
-    mnow = previousMillis;
+#if MQTT_VERSION == MQTT_VERSION_3_1
+    uint8_t d[9] = { 0x00, 0x06, 'M', 'Q', 'I', 's', 'd', 'p', MQTT_VERSION };
+    #define MQTT_HEADER_VERSION_LENGTH 9
+#elif MQTT_VERSION == MQTT_VERSION_3_1_1
+    uint8_t d[7] = { 0x00, 0x04, 'M', 'Q', 'T', 'T', MQTT_VERSION };
+    #define MQTT_HEADER_VERSION_LENGTH 7
+#endif
+    for(j = 0; j < MQTT_HEADER_VERSION_LENGTH; j++) {
+        this->buffer[length++] = d[j];
+    }
+
+    uint8_t v = 0;
     
-    while(!_client->available()) {
+    if(_cclean) v |= 0x02;
 
-        currentMillis =  millis();
-        
-        if(currentMillis - previousMillis >= this->socketTimeout)
-            return false;
-        
-        if(currentMillis - mnow > 20) {
-            looper();
-            mnow = millis();
+    if(_cuser) {
+        v |= 0x80;
+        if(_cpass) {
+            v |= 0x40;
         }
+    }
+    this->buffer[length++] = v;
 
-        delay(2);
+    this->buffer[length++] = (this->keepAlive >> 8);
+    this->buffer[length++] = (this->keepAlive & 0xff);
 
+    CHECK_CONN_STRING_LENGTH(length, _cid)
+    length = writeString(_cid, this->buffer, length);
+
+    if(_cuser) {
+        CHECK_CONN_STRING_LENGTH(length, _cuser)
+        length = writeString(_cuser, this->buffer, length);
+        if(_cpass) {
+            CHECK_CONN_STRING_LENGTH(length, _cpass)
+            length = writeString(_cpass, this->buffer, length);
+        }
     }
-    
-    *result = _client->read();
-    
+
+    if(!write(MQTTCONNECT, this->buffer, length - MQTT_MAX_HEADER_SIZE)) {
+        connectFailed(MQTT_CONNECT_FAILED);
+        return false;
+    }
+
+    lastInActivity = lastOutActivity = millis();
+
+    _cstate = CONN_ACK;
+
     return true;
 }
 
-// reads a byte into result[*index] and increments index
-bool PubSubClient::readByte(uint8_t *result, uint16_t *index)
+void PubSubClient::connectFailed(int state)
 {
-    uint16_t current_index = *index;
-    uint8_t *write_address = &(result[current_index]);
-    
-    if(readByte(write_address)) {
-        *index = current_index + 1;
-        return true;
+    if(_cs >= 0) {
+        closesocket(_cs);
+        _cs = -1;
     }
-    
+    _client->stop();
+    _cstate = CONN_IDLE;
+    _state = state;
+}
+
+/*
+ * Incremental packet reader
+ * 
+ * Consumes whatever the socket has buffered and returns true 
+ * as soon as a complete packet is in rxBuffer (_rxLen bytes, 
+ * _rxLL length bytes). Partial packets are kept across calls; 
+ * this never waits for data. Packets exceeding the buffer are
+ * skipped.
+ */
+bool PubSubClient::readPacket()
+{
+    int avail, r;
+    uint8_t digit;
+
+    while((avail = _client->available()) > 0) {
+
+        switch(_rxState) {
+        case RX_HDR:
+            rxBuffer[0] = _client->read();
+            _rxLen = 1;
+            _rxRemain = 0;
+            _rxMult = 1;
+            _rxState = RX_LEN;
+            break;
+            
+        case RX_LEN:
+            if(_rxLen == 5) {
+                // Invalid remaining length encoding - kill the connection
+                _rxState = RX_HDR;
+                _state = MQTT_DISCONNECTED;
+                _client->stop();
+                return false;
+            }
+            digit = _client->read();
+            rxBuffer[_rxLen++] = digit;
+            _rxRemain += (digit & 0x7f) * _rxMult;
+            _rxMult <<= 7;
+            if(!(digit & 0x80)) {
+                _rxLL = _rxLen - 1;
+                _rxOvfl = (_rxLen + _rxRemain > this->bufferSize);
+                if(!_rxRemain) {
+                    _rxState = RX_HDR;
+                    return true;
+                }
+                _rxState = RX_BODY;
+            }
+            break;
+
+        case RX_BODY:
+            if(_rxOvfl) {
+                _client->read();
+                r = 1;
+            } else {
+                r = (_rxRemain < (uint32_t)avail) ? _rxRemain : avail;
+                if((r = _client->read(rxBuffer + _rxLen, r)) <= 0)
+                    return false;
+                _rxLen += r;
+            }
+            _rxRemain -= r;
+            if(!_rxRemain) {
+                _rxState = RX_HDR;
+                if(!_rxOvfl) 
+                    return true;
+                _rxOvfl = false;
+            }
+            break;
+        }
+    }
+
     return false;
 }
 
-uint32_t PubSubClient::readPacket(uint8_t *lengthLength)
+void PubSubClient::handlePacket(unsigned long t)
 {
-    uint16_t len = 0;
+    uint16_t len = _rxLen;
+    uint8_t  llen = _rxLL;
+    uint8_t  type = rxBuffer[0] & 0xf0;
+    uint8_t  resp[4];
+    uint8_t  *payload;
     
-    if(!readByte(this->buffer, &len))
-        return 0;
+    lastInActivity = t;
     
-    bool isPublish = ((this->buffer[0] & 0xf0) == MQTTPUBLISH);
-    
-    uint32_t multiplier = 1;
-    uint32_t length = 0;
-    uint8_t  digit = 0;
-    uint32_t start = 0;
+    if(type == MQTTPUBLISH) {
+      
+        if(callback) {
+            // topic length in bytes
+            uint16_t tl = (rxBuffer[llen+1] << 8) + rxBuffer[llen+2];
+            
+            // move topic inside buffer 1 byte to front to make room for 0-terminator
+            memmove(rxBuffer + llen + 2, rxBuffer + llen + 3, tl); 
+            rxBuffer[llen + 2 + tl] = 0;
+             
+            char *topic = (char *)rxBuffer + llen + 2;
+            
+            if((rxBuffer[0] & 0x06) == MQTTQOS1) {
 
-    do {
+                // msgId only present for QOS>0
+                resp[0] = MQTTPUBACK;
+                resp[1] = 2;
+                resp[2] = rxBuffer[llen + 3 + tl]; 
+                resp[3] = rxBuffer[llen + 3 + tl + 1];
+                
+                payload = rxBuffer + llen + 3 + tl + 2;
+                callback(topic, payload, len - llen - 3 - tl - 2);
 
-        if(len == 5) {
-            // Invalid remaining length encoding - kill the connection
-            _state = MQTT_DISCONNECTED;
-            _client->stop();
-            return 0;
+                _client->write(resp, 4);
+                lastOutActivity = t;
+
+            } else {
+              
+                payload = rxBuffer + llen + 3 + tl;
+                callback(topic, payload, len - llen - 3 - tl);
+                
+            }
         }
         
-        if(!readByte(&digit)) return 0;
-        
-        this->buffer[len++] = digit;
-        length += (digit & 0x7f) * multiplier;
-        multiplier <<= 7;
-        
-    } while((digit & 0x80) != 0);
-    
-    *lengthLength = len - 1;
+    } else if(type == MQTTPUBACK) {
+
+        uint16_t msgId = (rxBuffer[llen+1] << 8) | rxBuffer[llen+2];
 
-    if(isPublish) {
+        for(int i = 0; i < MQTT_TXQ_SIZE; i++) {
+            if(_txq[i].state == TXQ_WAITACK && _txq[i].msgId == msgId) {
+                _txq[i].state = TXQ_FREE;
+                break;
+            }
+        }
+        
+    } else if(type == MQTTPINGREQ) {
       
-        // Read in topic length to calculate bytes to skip over for Stream writing
-        if(!readByte(this->buffer, &len)) return 0;
-        if(!readByte(this->buffer, &len)) return 0;
-        start = 2;
+        resp[0] = MQTTPINGRESP;
+        resp[1] = 0;
+        _client->write(resp, 2);
         
-    }
-    
-    uint32_t idx = len;
-
-    for(uint32_t i = start; i < length; i++) {
+    } else if(type == MQTTPINGRESP) {
       
-        if(!readByte(&digit)) 
-            return 0;
-
-        if(len < this->bufferSize) {
-            this->buffer[len] = digit;
-            len++;
-        }
-        idx++;
+        pingOutstanding = false;
+        
     }
-
-    if(idx > this->bufferSize)
-        len = 0; // This will cause the packet to be ignored.
-    
-    return len;
 }
 
 bool PubSubClient::loop()
 {
     if(_state == MQTT_CONNECTING) {
 
-        if(!_client->available()) {
-
-            if(millis() - lastInActivity >= this->socketTimeout) {
-                _state = MQTT_CONNECTION_TIMEOUT;
-                _client->stop();
-                #ifdef FC_DBG
-                Serial.println("MQTT: CONNACK timed-out");
-                #endif
-                return false;
-            }
-
-            return true;
-            
-        } else {
-
-            uint8_t llen;
-            uint32_t len = readPacket(&llen);
-
-            if(len == 4) {
-                if(buffer[3] == 0) {
-                    lastInActivity = millis();
-                    pingOutstanding = false;
-                    _state = MQTT_CONNECTED;
-                    #ifdef FC_DBG
-                    Serial.println("MQTT: CONNACK received");
-                    #endif
-                    return true;
-                } else {
-                    _state = buffer[3];
-                }
-            } else {
-                _state = MQTT_CONNECT_BAD_PROTOCOL;
-            }
-            _client->stop();
-
-            #ifdef FC_DBG
-            Serial.printf("MQTT: CONNACK failed, state %d\n", _state);
-            #endif
-
-            return false;
-        }
+        return pollConnect();
       
     } else if(connected()) {
         
         unsigned long t = millis();
         unsigned long ka = this->keepAlive * 1000UL;
+        int i;
         
         if((t - lastInActivity > ka) || (t - lastOutActivity > ka)) {
 
@@ -332,85 +519,32 @@ bool PubSubClient::loop()
                 _client->stop();
                 return false;
             } else {
-                this->buffer[0] = MQTTPINGREQ;
-                this->buffer[1] = 0;
-                _client->write(this->buffer, 2);
+                uint8_t req[2] = { MQTTPINGREQ, 0 };
+                _client->write(req, 2);
                 lastOutActivity = t;
                 lastInActivity = t;
                 pingOutstanding = true;
             }
 
         }
-        
-        if(_client->available()) {
-          
-            uint8_t  llen;
-            uint16_t len = readPacket(&llen);
-            uint8_t  msgId1 = 0, msgId2 = 0;
-            uint8_t  *payload;
-            
-            if(len > 0) {
-                
-                lastInActivity = t;
-                uint8_t type = this->buffer[0] & 0xf0;
-                
-                if(type == MQTTPUBLISH) {
-                  
-                    if(callback) {
-                        // topic length in bytes
-                        uint16_t tl = (this->buffer[llen+1] << 8) + this->buffer[llen+2];
-                        
-                        // move topic inside buffer 1 byte to front to make room for 0-terminator
-                        memmove(this->buffer + llen + 2, this->buffer + llen + 3, tl); 
-                        this->buffer[llen + 2 + tl] = 0;
-                         
-                        char *topic = (char *)this->buffer + llen + 2;
-                        
-                        if((this->buffer[0] & 0x06) == MQTTQOS1) {
-
-                            // msgId only present for QOS>0
-                            msgId1 = this->buffer[llen + 3 + tl]; 
-                            msgId2 = this->buffer[llen + 3 + tl + 1];
-                            
-                            payload = this->buffer + llen + 3 + tl + 2;
-                            callback(topic, payload, len - llen - 3 - tl - 2);
-
-                            this->buffer[0] = MQTTPUBACK;
-                            this->buffer[1] = 2;
-                            this->buffer[2] = msgId1;
-                            this->buffer[3] = msgId2;
-                            _client->write(this->buffer, 4);
-                            lastOutActivity = t;
-
-                        } else {
-                          
-                            payload = this->buffer + llen + 3 + tl;
-                            callback(topic, payload, len - llen - 3 - tl);
-                            
-                        }
-                    }
-                    
-                } else if(type == MQTTPINGREQ) {
-                  
-                    this->buffer[0] = MQTTPINGRESP;
-                    this->buffer[1] = 0;
-                    _client->write(this->buffer, 2);
-                    
-                } else if(type == MQTTPINGRESP) {
-                  
-                    pingOutstanding = false;
-                    
-                }
 
-            } else if(!connected()) {
-              
-                // readPacket has closed the connection
-                return false;
-                
-            }
+        // Limit the number of packets per call so that a 
+        // flood of messages does not hold up the caller
+        for(i = 0; i < MQTT_MAX_RX_PACKETS; i++) {
+            if(!readPacket()) 
+                break;
+            handlePacket(t);
         }
         
-        return true;
+        if(!connected()) {
+            // readPacket has closed the connection
+            return false;
+        }
+
+        flushQueue(t);
+        
+        // flushQueue closes the connection on a short write
+        return connected();
     }
     
     return false;
@@ -445,6 +579,141 @@ bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned i
     return false;
 }
 
+/*
+ * Outbound publish queue
+ *
+ * queue() only copies the message; it is sent from loop()
+ * once connected. Messages to a topic already in the queue 
+ * replace the older one (latest state wins). QoS1 messages 
+ * stay queued until acknowledged by PUBACK, and are resent 
+ * after MQTT_RESEND_INT or a reconnect.
+ * Returns false if the message is too long or the queue 
+ * is full.
+ */
+bool PubSubClient::queue(const char *topic, const uint8_t *payload, unsigned int plength, bool retained, uint8_t qos)
+{
+    int i, slot = -1;
+
+    if(qos > 1 || plength > MQTT_TXQ_PLEN || strlen(topic) >= MQTT_TXQ_TLEN)
+        return false;
+
+    for(i = 0; i < MQTT_TXQ_SIZE; i++) {
+        if(_txq[i].state == TXQ_FREE) {
+            if(slot < 0) slot = i;
+        } else if(!strcmp(_txq[i].topic, topic)) {
+            slot = i;
+            break;
+        }
+    }
+
+    if(slot < 0)
+        return false;
+
+    strcpy(_txq[slot].topic, topic);
+    memcpy(_txq[slot].payload, payload, plength);
+    _txq[slot].plength = plength;
+    _txq[slot].header = MQTTPUBLISH | (qos ? MQTTQOS1 : 0) | (retained ? 1 : 0);
+    _txq[slot].msgId = 0;
+    _txq[slot].state = TXQ_PENDING;
+
+    return true;
+}
+
+// Re-send unacknowledged messages after (re)connect
+void PubSubClient::requeue()
+{
+    for(int i = 0; i < MQTT_TXQ_SIZE; i++) {
+        if(_txq[i].state == TXQ_WAITACK) {
+            _txq[i].state = TXQ_PENDING;
+        }
+    }
+}
+
+// Send all pending messages, as many per write() as fit into buffer
+void PubSubClient::flushQueue(unsigned long now)
+{
+    uint32_t batch = 0;
+    uint16_t pos = 0, len, tl;
+    int i, j;
+
+    for(i = 0; i <= MQTT_TXQ_SIZE; i++) {
+
+        if(i < MQTT_TXQ_SIZE) {
+            
+            if(_txq[i].state == TXQ_WAITACK && (now - _txq[i].sentNow >= MQTT_RESEND_INT)) {
+                _txq[i].state = TXQ_PENDING;
+            }
+            
+            if(_txq[i].state != TXQ_PENDING)
+                continue;
+
+            tl = strlen(_txq[i].topic);
+            len = 2 + tl + _txq[i].plength;
+            if(_txq[i].header & MQTTQOS1) len += 2;
+
+            // Topic and payload limits keep the remaining length
+            // below 128, so it always fits in one byte
+            if(pos + 2 + len <= this->bufferSize) {
+                if(_txq[i].header & MQTTQOS1) {
+                    if(_txq[i].msgId) {
+                        // Re-transmission
+                        this->buffer[pos] = _txq[i].header | 0x08;
+                    } else {
+                        if(!++nextMsgId) nextMsgId++;
+                        _txq[i].msgId = nextMsgId;
+                        this->buffer[pos] = _txq[i].header;
+                    }
+                } else {
+                    this->buffer[pos] = _txq[i].header;
+                }
+                this->buffer[pos + 1] = len;
+                pos = writeString(_txq[i].topic, this->buffer, pos + 2);
+                if(_txq[i].header & MQTTQOS1) {
+                    this->buffer[pos++] = _txq[i].msgId >> 8;
+                    this->buffer[pos++] = _txq[i].msgId & 0xff;
+                }
+                memcpy(this->buffer + pos, _txq[i].payload, _txq[i].plength);
+                pos += _txq[i].plength;
+                batch |= (1 << i);
+                continue;
+            }
+
+        }
+
+        if(!pos)
+            break;
+
+        if(_client->write(this->buffer, pos) != pos) {
+            // A partial packet is on the stream, the broker
+            // would mis-parse anything we send after it. 
+            // Drop the connection; the batch stays queued
+            // and is sent again after reconnecting.
+            _client->stop();
+            _state = MQTT_CONNECTION_LOST;
+            return;
+        }
+
+        lastOutActivity = now;
+
+        for(j = 0; j < MQTT_TXQ_SIZE; j++) {
+            if(batch & (1 << j)) {
+                if(_txq[j].header & MQTTQOS1) {
+                    _txq[j].state = TXQ_WAITACK;
+                    _txq[j].sentNow = now;
+                } else {
+                    _txq[j].state = TXQ_FREE;
+                }
+            }
+        }
+
+        // Buffer was full: Start next batch with current entry
+        if(i < MQTT_TXQ_SIZE) i--;
+        
+        pos = 0;
+        batch = 0;
+    }
+}
+
 size_t PubSubClient::buildHeader(uint8_t header, uint8_t *buf, uint16_t length)
 {
     uint8_t lenBuf[4];
@@ -556,12 +825,17 @@ bool PubSubClient::subscribe_int(bool unsubscribe, const char *topic, const char
 
 void PubSubClient::disconnect()
 {
-    this->buffer[0] = MQTTDISCONNECT;
-    this->buffer[1] = 0;
+    uint8_t req[2] = { MQTTDISCONNECT, 0 };
 
-    _client->write(this->buffer, 2);
+    if(_state == MQTT_CONNECTING && _cstate != CONN_ACK) {
+        connectFailed(MQTT_DISCONNECTED);
+        return;
+    }
+    
+    _client->write(req, 2);
 
     _state = MQTT_DISCONNECTED;
+    _cstate = CONN_IDLE;
 
     _client->flush();
     _client->stop();
@@ -624,11 +898,6 @@ void PubSubClient::setCallback(void (*callback)(char*, uint8_t*, unsigned int))
     this->callback = callback;
 }
 
-void PubSubClient::setLooper(void (*looper)())
-{
-    this->looper = looper;
-}
-
 void PubSubClient::setClient(WiFiClient& client)
 {
     this->_client = &client;
@@ -644,8 +913,11 @@ bool PubSubClient::setBufferSize(uint16_t size)
     if(size == 0)
         return false;
 
+    // Transmit and receive buffers are separate so that a 
+    // publish() does not clobber a partially received packet
     if(this->bufferSize == 0) {
         this->buffer = (uint8_t*)malloc(size);
+        this->rxBuffer = (uint8_t*)malloc(size);
     } else {
         uint8_t* newBuffer = (uint8_t*)realloc(this->buffer, size);
         if(newBuffer) {
@@ -653,11 +925,17 @@ bool PubSubClient::setBufferSize(uint16_t size)
         } else {
             return false;
         }
+        newBuffer = (uint8_t*)realloc(this->rxBuffer, size);
+        if(newBuffer) {
+            this->rxBuffer = newBuffer;
+        } else {
+            return false;
+        }
     }
     
     this->bufferSize = size;
     
-    return (this->buffer != NULL);
+    return (this->buffer != NULL && this->rxBuffer != NULL);
 }
 
 uint16_t PubSubClient::getBufferSize()
@@ -685,14 +963,12 @@ void PubSubClient::setSocketTimeout(uint16_t timeout)
 
 bool PubSubClient::sendPing()
 {
-    struct sockaddr_in    address;
     ip4_addr_t            ping_target;
     struct icmp_echo_hdr *iecho;
     struct sockaddr_in    to;
     struct timeval        tout;
     int    size       =   32;
     size_t ping_size  =   sizeof(struct icmp_echo_hdr) + size;
-    size_t data_len   =   ping_size - sizeof(struct icmp_echo_hdr);
     int    err;
 
     #ifdef FC_DBG
@@ -708,7 +984,6 @@ bool PubSubClient::sendPing()
     if((_s = socket(AF_INET, SOCK_RAW, IP_PROTO_ICMP)) < 0)
         return false;
 
-    address.sin_addr.s_addr = ip;
     ping_target.addr        = ip;
 
     tout.tv_sec  = 0;
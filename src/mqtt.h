@@ -59,6 +59,30 @@
 #define MQTT_SOCKET_TIMEOUT 15
 #endif
 
+// MQTT_CONNECT_TIMEOUT: TCP connect timeout in milliseconds
+#ifndef MQTT_CONNECT_TIMEOUT
+#define MQTT_CONNECT_TIMEOUT 5000
+#endif
+
+// MQTT_MAX_RX_PACKETS: Max number of packets handled per loop() call
+#ifndef MQTT_MAX_RX_PACKETS
+#define MQTT_MAX_RX_PACKETS 4
+#endif
+
+// MQTT_TXQ_SIZE: Number of entries in the outbound publish queue
+#ifndef MQTT_TXQ_SIZE
+#define MQTT_TXQ_SIZE 12
+#endif
+
+// Max topic/payload length of queued messages
+#define MQTT_TXQ_TLEN 32
+#define MQTT_TXQ_PLEN 88
+
+// MQTT_RESEND_INT: Time in ms after which an unacknowledged QoS1 message is resent
+#ifndef MQTT_RESEND_INT
+#define MQTT_RESEND_INT 5000
+#endif
+
 // MQTT_MAX_TRANSFER_SIZE : limit how much data is passed to the network client
 //  in each write call. Needed for the Arduino Wifi Shield. Leave undefined to
 //  pass the entire MQTT packet in each write call.
@@ -104,6 +128,22 @@
 #define PING_IDLE     0
 #define PING_PINGING  1
 
+// Connect phases (while state is MQTT_CONNECTING)
+#define CONN_IDLE     0
+#define CONN_DNS      1
+#define CONN_TCP      2
+#define CONN_ACK      3
+
+// Publish queue entry states
+#define TXQ_FREE      0
+#define TXQ_PENDING   1
+#define TXQ_WAITACK   2
+
+// Receive parser states
+#define RX_HDR        0
+#define RX_LEN        1
+#define RX_BODY       2
+
 #define CHECK_STRING_LENGTH(l,s) if(l+2+strnlen(s, this->bufferSize) > this->bufferSize) { _client->stop(); return false; }
 
 class PubSubClient {
@@ -117,7 +157,6 @@ class PubSubClient {
         void setServer(IPAddress ip, uint16_t port);
         void setServer(const char *domain, uint16_t port);
         void setCallback(void (*callback)(char *, uint8_t *, unsigned int));
-        void setLooper(void (*looper)());
         void setClient(WiFiClient& client);
         void setKeepAlive(uint16_t keepAlive);
         void setSocketTimeout(uint16_t timeout);
@@ -132,6 +171,7 @@ class PubSubClient {
         void disconnect();
 
         bool publish(const char *topic, const uint8_t *payload, unsigned int plength, bool retained = false);
+        bool queue(const char *topic, const uint8_t *payload, unsigned int plength, bool retained = false, uint8_t qos = 0);
              
         bool subscribe(const char *topic, const char *topic2 = NULL, uint8_t qos = 0);
         bool unsubscribe(const char *topic);
@@ -149,9 +189,14 @@ class PubSubClient {
     private:
 
         bool subscribe_int(bool unsubscribe, const char *topic, const char *topic2L, uint8_t qos);
-        uint32_t readPacket(uint8_t *);
-        bool readByte(uint8_t *result);
-        bool readByte(uint8_t *result, uint16_t *index);
+        bool startConnect();
+        bool pollConnect();
+        bool sendConnect();
+        void connectFailed(int state);
+        bool readPacket();
+        void handlePacket(unsigned long now);
+        void flushQueue(unsigned long now);
+        void requeue();
         bool write(uint8_t header, uint8_t *buf, uint16_t length);
         uint16_t writeString(const char *string, uint8_t *buf, uint16_t pos);
         // Build up the header ready to send
@@ -162,6 +207,7 @@ class PubSubClient {
        
         WiFiClient* _client;
         uint8_t* buffer;
+        uint8_t* rxBuffer;
         uint16_t bufferSize;
         uint16_t keepAlive;
         unsigned long socketTimeout;
@@ -170,13 +216,41 @@ class PubSubClient {
         unsigned long lastInActivity;
         bool pingOutstanding;
         void (*callback)(char *, uint8_t *, unsigned int);
-        void (*looper)();
 
         IPAddress ip;
         const char* domain;
         uint16_t port;
         int _state;
 
+        // Async connect
+        int _cstate = CONN_IDLE;
+        int _cs = -1;
+        unsigned long _cNow;
+        uint32_t _cip;
+        const char *_cid;
+        const char *_cuser;
+        const char *_cpass;
+        bool _cclean;
+
+        // Incremental receive
+        int _rxState = RX_HDR;
+        uint16_t _rxLen;
+        uint32_t _rxRemain;
+        uint32_t _rxMult;
+        uint8_t _rxLL;
+        bool _rxOvfl = false;
+
+        // Outbound publish queue; one entry per topic
+        struct {
+            uint8_t  state;
+            uint8_t  header;
+            uint16_t msgId;
+            uint16_t plength;
+            unsigned long sentNow;
+            char     topic[MQTT_TXQ_TLEN];
+            uint8_t  payload[MQTT_TXQ_PLEN];
+        } _txq[MQTT_TXQ_SIZE];
+
         int _s;
         int _pstate = PING_IDLE;
         uint16_t _pseq_num = 34;
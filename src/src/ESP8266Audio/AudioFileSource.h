@@ -38,6 +38,10 @@ class AudioFileSource
     virtual uint32_t getSize() { return 0; };
     virtual uint32_t getPos() { return 0; };
     virtual bool loop() { return true; };
+    // Memory-mapped sources: Pointer to data at current position, and
+    // number of readable bytes there (incl. MAD_BUFFER_GUARD bytes after
+    // the end of data). NULL if no direct access possible.
+    virtual const uint8_t *getDirect(uint32_t *len) { (void)len; return NULL; };
 
   public:
     virtual bool RegisterMetadataCB(AudioStatus::metadataCBFn fn, void *data) { return cb.RegisterMetadataCB(fn, data); }
@@ -107,7 +107,7 @@ enum mad_flow AudioGeneratorMP3::ErrorToFlow()
 
   strcpy_P(err, mad_stream_errorstr(stream));
   snprintf_P(errLine, sizeof(errLine), PSTR("Decoding error '%s' at byte offset %d"),
-           err, (stream->this_frame - buff) + lastReadPos);
+           err, (int)((stream->this_frame - stream->buffer) + lastReadPos));
   yield(); // Something bad happened anyway, ensure WiFi gets some time, too
   cb.st(stream->error, errLine);
   return MAD_FLOW_CONTINUE;
@@ -117,6 +117,8 @@ enum mad_flow AudioGeneratorMP3::Input()
 {
   int unused = 0;
 
+  if (directIn) return InputDirect();
+
   if (stream->next_frame) {
     unused = lastBuffLen - (stream->next_frame - buff);
     if (unused < 0) {
@@ -151,6 +153,35 @@ enum mad_flow AudioGeneratorMP3::Input()
   return MAD_FLOW_CONTINUE;
 }
 
+// Memory-mapped source: Point libmad directly at the source's data
+// instead of copying it to buff. Position the source at the frame
+// libmad stopped at, and hand it all data from there.
+enum mad_flow AudioGeneratorMP3::InputDirect()
+{
+  const unsigned char *data;
+  uint32_t len;
+
+  if (stream->next_frame) {
+    int used = stream->next_frame - stream->buffer;
+    if (used <= 0 || !file->seek(used, SEEK_CUR)) {
+      // No progress (or beyond end): What is left is no complete frame
+      file->seek(0, SEEK_END);
+    }
+    stream->next_frame = NULL;
+  }
+
+  lastReadPos = file->getPos();
+  data = file->getDirect(&len);
+  if (!data || len <= MAD_BUFFER_GUARD) {
+    return MAD_FLOW_STOP;
+  }
+
+  lastBuffLen = len;
+  mad_stream_buffer(stream, data, len);
+
+  return MAD_FLOW_CONTINUE;
+}
+
 void AudioGeneratorMP3::desync ()
 {
     audioLogger->printf_P(PSTR("MP3:desync\n"));
@@ -169,26 +200,24 @@ bool AudioGeneratorMP3::DecodeNextFrame()
     return false;
   }
   nsCountMax  = MAD_NSBSAMPLES(&frame->header);
+
+  // Synthesis is linear, so synthesizing (L+R)/2 gives the same PCM as
+  // averaging two synthesized channels, at half the cost.
+  if (monoMix && (frame->header.mode != MAD_MODE_SINGLE_CHANNEL)) {
+    mad_fixed_t *l = &frame->sbsample[0][0][0];
+    mad_fixed_t const *r = &frame->sbsample[1][0][0];
+    for (int i = nsCountMax * 32; i > 0; i--, l++, r++) {
+      *l = (*l >> 1) + (*r >> 1);
+    }
+    frame->header.mode = MAD_MODE_SINGLE_CHANNEL;
+  }
   return true;
 }
 
 bool AudioGeneratorMP3::GetOneSample(int16_t sample[2])
 {
-  if (synth->pcm.samplerate != lastRate) {
-    output->SetRate(synth->pcm.samplerate);
-    lastRate = synth->pcm.samplerate;
-  }
-  if (synth->pcm.channels != lastChannels) {
-    output->SetChannels(synth->pcm.channels);
-    lastChannels = synth->pcm.channels;
-  }
-    
   // If we're here, we have one decoded frame and sent 0 or more samples out
-  if (samplePtr < synth->pcm.length) {
-    sample[AudioOutput::LEFTCHANNEL ] = synth->pcm.samples[0][samplePtr];
-    sample[AudioOutput::RIGHTCHANNEL] = synth->pcm.samples[1][samplePtr];
-    samplePtr++;
-  } else {
+  if (samplePtr >= synth->pcm.length) {
     samplePtr = 0;
     
     switch ( mad_synth_frame_onens(synth, frame, nsCount++) ) {
@@ -199,10 +228,23 @@ bool AudioGeneratorMP3::GetOneSample(int16_t sample[2])
           break; // Do nothing
     }
     // for IGNORE and CONTINUE, just play what we have now
-    sample[AudioOutput::LEFTCHANNEL ] = synth->pcm.samples[0][samplePtr];
-    sample[AudioOutput::RIGHTCHANNEL] = synth->pcm.samples[1][samplePtr];
-    samplePtr++;
   }
+
+  // Rate and channels only known after synthesis; the output must
+  // know about mono before the first sample (right channel undefined)
+  if (synth->pcm.samplerate != lastRate) {
+    output->SetRate(synth->pcm.samplerate);
+    lastRate = synth->pcm.samplerate;
+  }
+  if (synth->pcm.channels != lastChannels) {
+    output->SetChannels(synth->pcm.channels);
+    lastChannels = synth->pcm.channels;
+  }
+
+  sample[AudioOutput::LEFTCHANNEL ] = synth->pcm.samples[0][samplePtr];
+  sample[AudioOutput::RIGHTCHANNEL] = synth->pcm.samples[1][samplePtr];
+  samplePtr++;
+
   return true;
 }
 
@@ -273,6 +315,9 @@ bool AudioGeneratorMP3::begin(AudioFileSource *source, AudioOutput *output)
   // Reset error count from previous file
   unrecoverable = 0;
 
+  uint32_t dlen;
+  directIn = (file->getDirect(&dlen) != NULL);
+
   output->SetBitsPerSample(16); // Constant for MP3 decoder
   output->SetChannels(2);
 
@@ -340,7 +385,7 @@ bool AudioGeneratorMP3::begin(AudioFileSource *source, AudioOutput *output)
   mad_frame_init(frame);
   mad_synth_init(synth);
   synth->pcm.length = 0;
-  mad_stream_options(stream, 0); // TODO - add options support
+  mad_stream_options(stream, halfRate ? MAD_OPTION_HALFSAMPLERATE : 0);
   madInitted = true;
  
   running = true;
@@ -38,6 +38,13 @@ class AudioGeneratorMP3 : public AudioGenerator
     virtual bool isRunning() override;
     virtual void desync () override;
 
+    // Mix stereo frames down to one channel in the subband domain, so only
+    // one channel goes through synthesis. For mono outputs.
+    void SetMonoMix(bool enable) { monoMix = enable; }
+    // Synthesize at half the sample rate (libmad's synth_half). Takes effect
+    // on the next begin().
+    void SetHalfRate(bool enable) { halfRate = enable; }
+
     static constexpr int preAllocSize () { return preAllocBuffSize() + preAllocStreamSize() + preAllocFrameSize() + preAllocSynthSize(); }
     static constexpr int preAllocBuffSize () { return ((buffLen + 7) & ~7); }
     static constexpr int preAllocStreamSize () { return ((sizeof(struct mad_stream) + 7) & ~7); }
@@ -73,11 +80,15 @@ class AudioGeneratorMP3 : public AudioGenerator
     // The internal helpers
     enum mad_flow ErrorToFlow();
     enum mad_flow Input();
+    enum mad_flow InputDirect();
     bool DecodeNextFrame();
     bool GetOneSample(int16_t sample[2]);
 
   private:
     int unrecoverable = 0;
+    bool monoMix = false;
+    bool halfRate = false;
+    bool directIn = false;    // Source is memory-mapped: Decode in place
 };
 
 #endif
@@ -32,7 +32,22 @@ class AudioOutput
     virtual bool SetRate(int hz) { hertz = hz; return true; }
     virtual bool SetBitsPerSample(int bits) { bps = bits; return true; }
     virtual bool SetChannels(int chan) { channels = chan; return true; }
-    virtual bool SetGain(float f) { if (f>4.0) f = 4.0; if (f<0.0) f=0.0; gainF2P6 = (uint8_t)(f*(1<<6)); return true; }
+    virtual bool SetGain(float f) { if (f>2.0) f = 2.0; if (f<0.0) f=0.0; SetGainQ15((uint32_t)(f*(1<<15))); return true; }
+    // Q15 gain, 32768 == unity, max just below 2.0. Unless immediate, the
+    // change is ramped linearly over gainRampLen samples (no zipper noise).
+    void SetGainQ15(uint32_t g, bool immediate = false)
+    {
+      if (g > 0xffff) g = 0xffff;
+      gainTarget = g;
+      if (immediate) {
+        gainQ15 = g;
+        gainStep = 0;
+        return;
+      }
+      int32_t d = gainTarget - gainQ15;
+      gainStep = d / gainRampLen;
+      if (!gainStep && d) gainStep = (d > 0) ? 1 : -1;
+    }
     virtual bool begin() { return false; };
     typedef enum { LEFTCHANNEL=0, RIGHTCHANNEL=1 } SampleIndex;
     virtual bool ConsumeSample(int16_t sample[2]) { (void)sample; return false; }
@@ -64,8 +79,20 @@ class AudioOutput
       }
     };
 
+    // Advance the gain ramp; call once per consumed sample frame
+    inline void StepGain() {
+      if (gainStep) {
+        gainQ15 += gainStep;
+        if ((gainStep > 0) ? (gainQ15 >= gainTarget) : (gainQ15 <= gainTarget)) {
+          gainQ15 = gainTarget;
+          gainStep = 0;
+        }
+      }
+    }
+
     inline int16_t Amplify(int16_t s) {
-      int32_t v = (s * gainF2P6)>>6;
+      int32_t v = (s * gainQ15)>>15;
+      if (gainQ15 <= (1<<15)) return (int16_t)v;  // Cannot overflow
       if (v < -32767) return -32767;
       else if (v > 32767) return 32767;
       else return (int16_t)(v&0xffff);
@@ -75,7 +102,10 @@ class AudioOutput
     uint16_t hertz;
     uint8_t bps;
     uint8_t channels;
-    uint8_t gainF2P6; // Fixed point 2.6
+    static constexpr int32_t gainRampLen = 256;
+    int32_t gainQ15 = 1<<15;      // Fixed point Q15, current
+    int32_t gainTarget = 1<<15;
+    int32_t gainStep = 0;
 
   protected:
     AudioStatus cb;
@@ -28,6 +28,11 @@
 #endif
 #include "AudioOutputI2S.h"
 
+// Driver event queue; only TX_Q_OVF is of interest, but
+// the driver also posts a TX_DONE for every DMA buffer.
+// When full, the driver drops the oldest event.
+#define I2S_EVT_QUEUE_LEN 32
+
 #if defined(ESP32) || defined(ESP8266)
 AudioOutputI2S::AudioOutputI2S(int port, int output_mode, int dma_buf_count, int use_apll)
 {
@@ -231,7 +236,7 @@ bool AudioOutputI2S::begin(bool txDAC)
           .use_apll = use_apll // Use audio PLL
       };
       audioLogger->printf("+%d %p\n", portNo, &i2s_config_dac);
-      if (i2s_driver_install((i2s_port_t)portNo, &i2s_config_dac, 0, NULL) != ESP_OK)
+      if (i2s_driver_install((i2s_port_t)portNo, &i2s_config_dac, I2S_EVT_QUEUE_LEN, &i2sEvents) != ESP_OK)
       {
         audioLogger->println("ERROR: Unable to install I2S drives\n");
       }
@@ -309,6 +314,11 @@ bool AudioOutputI2S::ConsumeSample(int16_t sample[2])
       int16_t r = Amplify(ms[RIGHTCHANNEL]) + 0x8000;
       s32 = (r << 16) | (l & 0xffff);
     }
+    else if (this->mono)
+    {
+      uint32_t m = Amplify(ms[LEFTCHANNEL]) & 0xffff;
+      s32 = (m << 16) | m;
+    }
     else
     {
       s32 = ((Amplify(ms[RIGHTCHANNEL])) << 16) | (Amplify(ms[LEFTCHANNEL]) & 0xffff);
@@ -318,15 +328,43 @@ bool AudioOutputI2S::ConsumeSample(int16_t sample[2])
 
     size_t i2s_bytes_written;
     i2s_write((i2s_port_t)portNo, (const char*)&s32, sizeof(uint32_t), &i2s_bytes_written, 0);
+    if (i2s_bytes_written) {
+      StepGain();
+      samplesOut++;
+    }
     return i2s_bytes_written;
   #elif defined(ESP8266)
     uint32_t s32 = ((Amplify(ms[RIGHTCHANNEL])) << 16) | (Amplify(ms[LEFTCHANNEL]) & 0xffff);
-    return i2s_write_sample_nb(s32); // If we can't store it, return false.  OTW true
+    if (!i2s_write_sample_nb(s32)) return false; // If we can't store it, return false.  OTW true
+    StepGain();
+    samplesOut++;
+    return true;
   #elif defined(ARDUINO_ARCH_RP2040)
     return !!I2S.write((void*)ms, 4);
   #endif
 }
 
+/*
+ * The driver posts I2S_EVENT_TX_Q_OVF when the DMA finishes a 
+ * buffer while all buffers are still queued for sending, ie
+ * nothing was refilled in time: The DMA ran dry. This also 
+ * happens while no audio is played at all, so the caller 
+ * must ignore the count while idle.
+ */
+uint32_t AudioOutputI2S::GetUnderruns()
+{
+  uint32_t cnt = 0;
+  #ifdef ESP32
+    i2s_event_t evt;
+    if (!i2sOn || !i2sEvents)
+      return 0;
+    while (xQueueReceive(i2sEvents, &evt, 0) == pdTRUE) {
+      if (evt.type == I2S_EVENT_TX_Q_OVF) cnt++;
+    }
+  #endif
+  return cnt;
+}
+
 void AudioOutputI2S::flush()
 {
   #ifdef ESP32
@@ -353,6 +391,7 @@ bool AudioOutputI2S::stop()
   #ifdef ESP32
     i2s_zero_dma_buffer((i2s_port_t)portNo);
     i2s_driver_uninstall((i2s_port_t)portNo); //stop & destroy i2s driver
+    i2sEvents = NULL;
   #elif defined(ESP8266)
     i2s_end();
   #elif defined(ARDUINO_ARCH_RP2040)
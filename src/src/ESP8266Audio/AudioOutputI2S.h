@@ -21,6 +21,10 @@
 #pragma once
 
 #include "AudioOutput.h"
+#ifdef ESP32
+  #include "freertos/FreeRTOS.h"
+  #include "freertos/queue.h"
+#endif
 
 class AudioOutputI2S : public AudioOutput
 {
@@ -45,6 +49,8 @@ class AudioOutputI2S : public AudioOutput
     bool begin(bool txDAC);
     bool SetOutputModeMono(bool mono);  // Force mono output no matter the input
     bool SetLsbJustified(bool lsbJustified);  // Allow supporting non-I2S chips, e.g. PT8211 
+    uint32_t GetSamplesOut() { return samplesOut; }   // Running count of samples written
+    uint32_t GetUnderruns();  // DMA underruns since last call
 
   protected:
     bool SetPinout();
@@ -56,6 +62,10 @@ class AudioOutputI2S : public AudioOutput
     bool i2sOn;
     int dma_buf_count;
     int use_apll;
+    uint32_t samplesOut = 0;
+#ifdef ESP32
+    QueueHandle_t i2sEvents = NULL;
+#endif
     // We can restore the old values and free up these pins when in NoDAC mode
     uint32_t orig_bck;
     uint32_t orig_ws;
@@ -46,7 +46,15 @@ extern int stackfree();
 /* Define if your MIPS CPU supports a 2-operand MADD16 instruction. */
 /* #undef HAVE_MADD16_ASM */
 
-#define FPM_DEFAULT
+/* ESP32 (Xtensa LX6/LX7) has MULL/MULSH; use the 32x32->64 backend there.
+   Host builds (tools/madcmp) select the FPM on the command line. */
+#if !defined(FPM_XTENSA) && !defined(FPM_64BIT) && !defined(FPM_DEFAULT)
+# if defined(ESP32) && defined(__XTENSA__)
+#  define FPM_XTENSA
+# else
+#  define FPM_DEFAULT
+# endif
+#endif
 
 /* Define if your MIPS CPU supports a 2-operand MADD instruction. */
 #define HAVE_MADD_ASM 1
@@ -91,10 +99,15 @@ extern int stackfree();
 /* #undef OPT_ACCURACY */
 
 /* Define to optimize for speed over accuracy. */
+#if !defined(OPT_ACCURACY)
 #define OPT_SPEED 1
+#endif
 
-/* Define to enable a fast subband synthesis approximation optimization. */
+/* Define to enable a fast subband synthesis approximation optimization.
+   FPM_XTENSA accumulates the synthesis window in 64 bits instead. */
+#if defined(FPM_DEFAULT)
 #define OPT_SSO 1
+#endif
 
 /* Define to influence a strict interpretation of the ISO/IEC standards, even
    if this is in opposition with best accepted practices. */
@@ -349,6 +349,48 @@ mad_fixed_t mad_f_mul_inline(mad_fixed_t x, mad_fixed_t y)
 	 : "=r" (lo), "=r" (hi)  \
 	 : "%r" (x), "rI" (y))
 
+/* --- Xtensa ------------------------------------------------------------- */
+
+# elif defined(FPM_XTENSA)
+
+/*
+ * This ESP32 (Xtensa LX6/LX7) version is as accurate as FPM_64BIT but
+ * does not go through the 64-bit libgcc multiply. MULL and MULSH give the
+ * low and high words of the 32x32->64 product in one cycle each; the
+ * disposition of the least significant bit depends on OPT_ACCURACY via
+ * mad_f_scale64().
+ */
+#  if defined(__XTENSA__)
+#   define MAD_F_MLX(hi, lo, x, y)  \
+    asm ("mull	%0, %2, %3\n\t"  \
+	 "mulsh	%1, %2, %3"  \
+	 : "=&r" (lo), "=&r" (hi)  \
+	 : "%r" (x), "r" (y))
+#  else
+/*
+ * Same result in C, for host verification builds (tools/madcmp).
+ */
+#   define MAD_F_MLX(hi, lo, x, y)  \
+    ({ mad_fixed64_t __p = (mad_fixed64_t) (x) * (y);  \
+       (lo) = (mad_fixed64lo_t) __p;  \
+       (hi) = (mad_fixed64hi_t) (__p >> 32);  \
+    })
+#  endif
+
+/*
+ * There is no 64-bit accumulator; add the partial products with carry.
+ * This keeps subband synthesis at full precision (no OPT_SSO).
+ */
+#  define MAD_F_MLA(hi, lo, x, y)  \
+    ({ mad_fixed64hi_t __hi;  \
+       mad_fixed64lo_t __lo;  \
+       MAD_F_MLX(__hi, __lo, (x), (y));  \
+       (lo) += __lo;  \
+       (hi) += __hi + ((lo) < __lo);  \
+    })
+
+#  define MAD_F_SCALEBITS  MAD_F_FRACBITS
+
 /* --- PowerPC ------------------------------------------------------------- */
 
 # elif defined(FPM_PPC)
@@ -38,7 +38,7 @@
 #  error "cannot optimize for both speed and accuracy"
 # endif
 
-# if defined(OPT_SPEED) && !defined(OPT_SSO)
+# if defined(OPT_SPEED) && !defined(OPT_SSO) && !defined(FPM_XTENSA)
 #  define OPT_SSO
 # endif
 
@@ -562,8 +562,18 @@ void dct32(mad_fixed_t const in[32], unsigned int slot,
 #  endif
 # endif
 
+/* On the ESP32, keep the window table in internal RAM; it is read for every
+   output sample, and flash cache misses stall synthesis while SD and WiFi
+   are competing for the cache. */
+# if defined(FPM_XTENSA) && defined(__XTENSA__)
+#  include <esp_attr.h>
+#  define D_ATTR  DRAM_ATTR
+# else
+#  define D_ATTR  PROGMEM
+# endif
+
 static
-mad_fixed_t const D[17][32] PROGMEM = {
+mad_fixed_t const D[17][32] D_ATTR = {
 # include "D.dat.h"
 };
 
@@ -0,0 +1,179 @@
+/*
+ * banktest - Host test of sound bank playback
+ *
+ * Runs the firmware's AudioFileSourceBank and AudioGeneratorMP3
+ * (with libmad) on the host. The bank image is mmap()ed and
+ * handed to AudioFileSourceBank::begin(image, size), exactly as
+ * the firmware does with the memory-mapped sound partition, so
+ * the generator decodes in place through getDirect() and
+ * InputDirect().
+ *
+ * For every sound in the bank, checks that
+ * - the in-place decode produces audio,
+ * - it matches (bit-exact) the same sound decoded from the
+ *   bank as a file (read() path, no direct access),
+ * - it matches the original MP3 file from srcdir decoded
+ *   through AudioFileSourceFSLoop (ID3 tags and junk the
+ *   bank leaves out do not change the output),
+ *   The read() path loses the last frame, since libmad needs
+ *   MAD_BUFFER_GUARD bytes after it; in place, the bank's 
+ *   guard bytes allow decoding it. So the read() output must 
+ *   be the in-place output less at most one frame.
+ * - looped playback wraps around instead of stopping.
+ *
+ * Usage: banktest fcsnd.bin srcdir
+ *        (see banktest.sh)
+ */
+
+#include <Arduino.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "AudioFileSourceLoop.h"
+#include "src/ESP8266Audio/AudioGeneratorMP3.h"
+
+fs::FS SD, LittleFS, SPIFFS;
+
+#define MAX_FRAME_SAMPLES (1152 * 2)
+
+static int failed = 0;
+
+#define CHECK(c, ...) do { if(!(c)) { printf("FAIL: " __VA_ARGS__); printf("\n"); failed++; } } while(0)
+
+// Collects the PCM. Reports "DMA full" every 512 samples
+// so the generator has to resume across loop() calls.
+// Like AudioOutputI2S, it takes the right channel from 
+// the left one for mono sounds (the generator's right 
+// channel is undefined then).
+class HostOut : public AudioOutput
+{
+  public:
+    virtual bool begin() override { return true; }
+    virtual bool ConsumeSample(int16_t sample[2]) override
+    {
+        int16_t ms[2] = { sample[0], sample[1] };
+        if(++calls % 512 == 0) return false;
+        MakeSampleStereo16(ms);
+        pcm.push_back(ms[0]);
+        pcm.push_back(ms[1]);
+        return true;
+    }
+    std::vector<int16_t> pcm;
+
+  private:
+    uint32_t calls = 0;
+};
+
+// b equals a, or a less its last frame
+static bool samePCM(const std::vector<int16_t>& a, const std::vector<int16_t>& b)
+{
+    if(b.size() > a.size() || a.size() - b.size() > MAX_FRAME_SAMPLES)
+        return false;
+
+    return std::equal(b.begin(), b.end(), a.begin());
+}
+
+// Play src until the generator stops, or maxFrames sample frames
+static std::vector<int16_t> play(AudioFileSource *src, bool *direct, size_t maxFrames = 0)
+{
+    AudioGeneratorMP3 mp3;
+    HostOut out;
+    uint32_t dlen;
+
+    *direct = (src->getDirect(&dlen) != NULL);
+
+    if(!mp3.begin(src, &out)) {
+        return out.pcm;
+    }
+    while(mp3.isRunning()) {
+        if(!mp3.loop()) {
+            mp3.stop();
+            break;
+        }
+        if(maxFrames && out.pcm.size() >= maxFrames * 2) {
+            mp3.stop();
+            break;
+        }
+    }
+
+    return out.pcm;
+}
+
+int main(int argc, char **argv)
+{
+    AudioFileSourceBank mapBank, fileBank;
+    const uint8_t *image;
+    const FCSBEntry *tbl;
+    FCSBHeader hdr;
+    struct stat st;
+    char fn[512];
+    bool direct;
+    int fd, i;
+
+    if(argc != 3) {
+        fprintf(stderr, "Usage: banktest fcsnd.bin srcdir\n");
+        return 2;
+    }
+
+    if((fd = open(argv[1], O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        perror(argv[1]);
+        return 2;
+    }
+    image = (const uint8_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(image == MAP_FAILED) {
+        perror("mmap");
+        return 2;
+    }
+
+    CHECK(mapBank.begin(image, st.st_size), "begin(image) failed");
+    CHECK(fileBank.begin(argv[1]), "begin(file) failed");
+    CHECK(!mapBank.begin(image, sizeof(hdr) - 1), "begin(image) accepted truncated image");
+    CHECK(mapBank.begin(image, st.st_size), "begin(image) failed after failed begin");
+    if(failed) return 1;
+
+    memcpy(&hdr, image, sizeof(hdr));
+    tbl = (const FCSBEntry *)(image + sizeof(hdr));
+
+    for(i = 0; i < hdr.count; i++) {
+        const char *name = tbl[i].name;
+        std::vector<int16_t> pm, pf, po, pl;
+        AudioFileSourceFSLoop orig;
+
+        CHECK(mapBank.open(name), "%s: not found in mapped bank", name);
+        pm = play(&mapBank, &direct);
+        CHECK(direct, "%s: mapped bank not decoded in place", name);
+
+        CHECK(fileBank.open(name), "%s: not found in bank file", name);
+        pf = play(&fileBank, &direct);
+        CHECK(!direct, "%s: bank file claims direct access", name);
+
+        snprintf(fn, sizeof(fn), "%s/%s", argv[2], name);
+        CHECK(orig.open(fn), "%s: cannot open", fn);
+        po = play(&orig, &direct);
+
+        CHECK(pm.size() > 0, "%s: no output", name);
+        CHECK(samePCM(pm, pf), "%s: in-place decode differs from file decode (%zu/%zu samples)", name, pm.size(), pf.size());
+        CHECK(samePCM(pm, po), "%s: differs from original file (%zu/%zu samples)", name, pm.size(), po.size());
+
+        mapBank.open(name);
+        mapBank.setPlayLoop(true);
+        pl = play(&mapBank, &direct, pm.size());
+        mapBank.setPlayLoop(false);
+        CHECK(pl.size() >= pm.size() * 2, "%s: looped playback stopped after %zu samples", name, pl.size() / 2);
+
+        printf("%-18s %4d frames, %7zu samples\n", name, tbl[i].numFrames, pm.size() / 2);
+    }
+
+    if(failed) {
+        printf("%d check(s) FAILED\n", failed);
+        return 1;
+    }
+    printf("OK\n");
+
+    return 0;
+}
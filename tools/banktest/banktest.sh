@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# banktest.sh - Build a sound bank and play it through the firmware's
+#               bank source and MP3 generator on the host
+#
+# Usage: tools/banktest/banktest.sh [srcdir]
+#
+#   srcdir defaults to src/data. libmad's host build uses the
+#   pgmspace.h stand-in from tools/madcmp.
+
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+TOP="$HERE/../.."
+SRC="$TOP/src"
+LIBMAD="$SRC/src/ESP8266Audio/libmad"
+OUT=${BANKTEST_OUT:-/tmp/banktest}
+CC=${CC:-cc}
+CXX=${CXX:-c++}
+DATA=${1:-$SRC/data}
+
+mkdir -p "$OUT/obj"
+
+INC="-I$HERE/shim -I$TOP/tools/madcmp -I$SRC -I$LIBMAD"
+
+# Known upstream libmad warnings (OPT_DCTO's unused lo, fastsdct's
+# strided output)
+MADW="-Wno-unused-but-set-variable -Wno-stringop-overflow"
+
+for f in "$LIBMAD"/*.c; do
+    $CC -O2 -Wall -Wextra $MADW $INC -c -o "$OUT/obj/$(basename "$f" .c).o" "$f"
+done
+for f in "$SRC/AudioFileSourceLoop.cpp" \
+         "$SRC/src/ESP8266Audio/AudioGeneratorMP3.cpp" \
+         "$SRC/src/ESP8266Audio/AudioLogger.cpp" \
+         "$HERE/banktest.cpp"; do
+    $CXX -std=gnu++11 -O2 -Wall -Wextra $INC -c -o "$OUT/obj/$(basename "$f" .cpp).o" "$f"
+done
+$CXX -o "$OUT/banktest" "$OUT"/obj/*.o
+
+python3 "$TOP/tools/mkfcbank.py" -o "$OUT/fcsnd.bin" "$DATA" > /dev/null
+
+"$OUT/banktest" "$OUT/fcsnd.bin" "$DATA"
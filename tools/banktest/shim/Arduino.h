@@ -0,0 +1,53 @@
+/*
+ * Host stand-in for the parts of the Arduino core used by
+ * the audio library and AudioFileSourceLoop
+ */
+
+#ifndef _ARDUINO_SHIM_H
+#define _ARDUINO_SHIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define PSTR(s)         (s)
+#define F(s)            (s)
+#define strcpy_P        strcpy
+#define snprintf_P      snprintf
+
+static inline void yield() { }
+
+template<typename T> static inline T min(T a, T b) { return (a < b) ? a : b; }
+template<typename T> static inline T max(T a, T b) { return (a > b) ? a : b; }
+
+class Print {
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) = 0;
+        size_t printf(const char *fmt, ...)
+        {
+            char buf[256];
+            va_list ap;
+            va_start(ap, fmt);
+            int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+            va_end(ap);
+            for(int i = 0; buf[i]; i++) write(buf[i]);
+            return n;
+        }
+        size_t printf_P(const char *fmt, ...)
+        {
+            char buf[256];
+            va_list ap;
+            va_start(ap, fmt);
+            int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+            va_end(ap);
+            for(int i = 0; buf[i]; i++) write(buf[i]);
+            return n;
+        }
+        size_t println(const char *s) { return printf("%s\n", s); }
+        void flush() { }
+};
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Host stand-in for Arduino's File and file systems
+ * Paths are host paths.
+ */
+
+#ifndef _FS_SHIM_H
+#define _FS_SHIM_H
+
+#include <Arduino.h>
+
+#define FILE_READ "r"
+
+class File {
+    public:
+        File() : _f(NULL) {}
+        File(FILE *f) : _f(f) {}
+        operator bool() const { return _f != NULL; }
+        size_t read(uint8_t *buf, size_t len) { return _f ? fread(buf, 1, len, _f) : 0; }
+        bool seek(uint32_t pos) { return _f && !fseek(_f, pos, SEEK_SET); }
+        size_t position() { return _f ? ftell(_f) : 0; }
+        size_t size()
+        {
+            long p, s;
+            if(!_f) return 0;
+            p = ftell(_f);
+            fseek(_f, 0, SEEK_END);
+            s = ftell(_f);
+            fseek(_f, p, SEEK_SET);
+            return s;
+        }
+        void close()
+        {
+            if(_f) fclose(_f);
+            _f = NULL;
+        }
+    private:
+        FILE *_f;
+};
+
+namespace fs {
+class FS {
+    public:
+        File open(const char *path, const char * = FILE_READ)
+        {
+            return File(fopen(path, "rb"));
+        }
+};
+}
+
+#endif
@@ -0,0 +1,2 @@
+#include "FS.h"
+extern fs::FS SD;
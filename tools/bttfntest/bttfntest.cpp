@@ -0,0 +1,315 @@
+/*
+ * bttfntest - Host test of the BTTFN packet validator
+ *
+ * Builds src/fc_bttfn.cpp and feeds BTTFNValidate() random,
+ * truncated, oversized, bad-checksum and misaligned buffers.
+ * Every buffer is placed right before a PROT_NONE guard page,
+ * so reading past its length crashes the test.
+ *
+ * Checks that
+ * - packets shorter than BTTF_PACKET_SIZE are always rejected,
+ * - for all other buffers, the result matches a reference check
+ *   (header, version, checksum) over the first 48 bytes,
+ * - valid packets are copied to pkt unchanged, at any buffer
+ *   alignment,
+ * - a single flipped bit anywhere in a valid packet is rejected.
+ *
+ * Then times BTTFNValidate() against the old parser (fixed 48
+ * byte read into a static buffer, then byte offsets), for valid
+ * packets and for junk.
+ *
+ * Usage: tools/bttfntest/bttfntest.sh
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "fc_bttfn.h"
+
+#define RUNS        200000
+#define BENCH_RUNS  2000000
+
+static int failed = 0;
+
+#define CHECK(c, ...) do { if(!(c)) { printf("FAIL: " __VA_ARGS__); printf("\n"); failed++; } } while(0)
+
+static uint32_t rng = 1;
+
+static uint32_t rand32()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+/*
+ * Guarded buffer: len bytes ending exactly at a PROT_NONE page
+ */
+
+static uint8_t *guardPage;
+static long    pageSize;
+
+static void guardInit()
+{
+    uint8_t *m;
+
+    pageSize = sysconf(_SC_PAGESIZE);
+    m = (uint8_t *)mmap(NULL, 2 * pageSize, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(m == MAP_FAILED || mprotect(m + pageSize, pageSize, PROT_NONE)) {
+        perror("mmap");
+        exit(1);
+    }
+    guardPage = m + pageSize;
+}
+
+static uint8_t *guarded(const uint8_t *data, size_t len)
+{
+    uint8_t *buf = guardPage - len;
+
+    memcpy(buf, data, len);
+    return buf;
+}
+
+/*
+ * Packets
+ */
+
+static void makeValid(uint8_t *p)
+{
+    BTTFNPacket *pkt = (BTTFNPacket *)p;
+
+    for(int i = 0; i < BTTF_PACKET_SIZE; i++) p[i] = rand32();
+    memcpy(pkt->hdr, BTTFUDPHD, 4);
+    pkt->ver = BTTFN_VERSION | ((rand32() & 1) ? BTTFN_VER_NOT : BTTFN_VER_RESP);
+    pkt->csum = BTTFNChecksum(pkt);
+}
+
+// Independent reference of what is valid
+static bool refValid(const uint8_t *p, size_t len)
+{
+    uint8_t a = 0;
+
+    if(len < BTTF_PACKET_SIZE)
+        return false;
+    if(p[0] != 'B' || p[1] != 'T' || p[2] != 'T' || p[3] != 'F')
+        return false;
+    if(p[4] != (BTTFN_VERSION | 0x40) && p[4] != (BTTFN_VERSION | 0x80))
+        return false;
+    for(int i = 4; i < 47; i++) a += p[i] ^ 0x55;
+
+    return p[47] == a;
+}
+
+// Fill buf with one of several kinds of test input
+static size_t makeInput(uint8_t *buf, size_t maxLen)
+{
+    size_t len;
+
+    switch(rand32() % 6) {
+    case 0:     // Random junk
+        len = rand32() % maxLen;
+        for(size_t i = 0; i < len; i++) buf[i] = rand32();
+        break;
+    case 1:     // Junk with valid header
+        len = rand32() % maxLen;
+        for(size_t i = 0; i < len; i++) buf[i] = rand32();
+        memcpy(buf, BTTFUDPHD, len < 4 ? len : 4);
+        break;
+    case 2:     // Truncated valid packet
+        makeValid(buf);
+        len = rand32() % BTTF_PACKET_SIZE;
+        break;
+    case 3:     // Valid packet, possibly with trailing junk
+        makeValid(buf);
+        len = BTTF_PACKET_SIZE + rand32() % (maxLen - BTTF_PACKET_SIZE);
+        for(size_t i = BTTF_PACKET_SIZE; i < len; i++) buf[i] = rand32();
+        break;
+    case 4:     // Bad checksum
+        makeValid(buf);
+        buf[47] += 1 + rand32() % 255;
+        len = BTTF_PACKET_SIZE;
+        break;
+    default:    // Bad version
+        makeValid(buf);
+        buf[4] = rand32();
+        ((BTTFNPacket *)buf)->csum = BTTFNChecksum((BTTFNPacket *)buf);
+        len = BTTF_PACKET_SIZE;
+        break;
+    }
+
+    return len;
+}
+
+/*
+ * Old parser: WiFiUDP::read() of up to 48 bytes into a static
+ * buffer (stale bytes stay if the packet is shorter), then
+ * checks through byte offsets.
+ */
+
+static uint8_t oldBuf[BTTF_PACKET_SIZE];
+
+static bool oldValidate(const uint8_t *buf, size_t len)
+{
+    memcpy(oldBuf, buf, len < BTTF_PACKET_SIZE ? len : BTTF_PACKET_SIZE);
+
+    if(memcmp(oldBuf, BTTFUDPHD, 4))
+        return false;
+
+    uint8_t a = 0;
+    for(int i = 4; i < BTTF_PACKET_SIZE - 1; i++) {
+        a += oldBuf[i] ^ 0x55;
+    }
+    if(oldBuf[BTTF_PACKET_SIZE - 1] != a)
+        return false;
+
+    if(oldBuf[4] == (BTTFN_VERSION | 0x40))
+        return true;
+
+    return oldBuf[4] == (BTTFN_VERSION | 0x80);
+}
+
+/*
+ * Tests
+ */
+
+static void testRandom()
+{
+    uint8_t data[128];
+    BTTFNPacket pkt;
+    int accepted = 0;
+
+    for(int i = 0; i < RUNS; i++) {
+        size_t len = makeInput(data, sizeof(data));
+        uint8_t *buf = guarded(data, len);
+        bool ok = BTTFNValidate(buf, len, &pkt);
+
+        if(ok) accepted++;
+        CHECK(ok == refValid(data, len), "run %d: len %zu: %s", i, len, ok ? "accepted" : "rejected");
+        if(ok) {
+            CHECK(!memcmp(&pkt, data, BTTF_PACKET_SIZE), "run %d: packet not copied", i);
+        }
+        if(failed > 10) break;
+    }
+
+    printf("random         %d buffers, %d accepted\n", RUNS, accepted);
+}
+
+static void testTruncated()
+{
+    uint8_t data[BTTF_PACKET_SIZE];
+    BTTFNPacket pkt;
+
+    makeValid(data);
+
+    // Even with stale valid data behind it (the old parser's trap)
+    for(size_t len = 0; len < BTTF_PACKET_SIZE; len++) {
+        memcpy(&pkt, data, sizeof(pkt));
+        CHECK(!BTTFNValidate(guarded(data, len), len, &pkt), "truncated packet (%zu bytes) accepted", len);
+    }
+    CHECK(BTTFNValidate(guarded(data, BTTF_PACKET_SIZE), BTTF_PACKET_SIZE, &pkt), "valid packet rejected");
+
+    printf("truncated      lengths 0-%d\n", BTTF_PACKET_SIZE - 1);
+}
+
+static void testBitFlips()
+{
+    uint8_t data[BTTF_PACKET_SIZE];
+    BTTFNPacket pkt;
+    int n = 0;
+
+    makeValid(data);
+    for(int bit = 0; bit < BTTF_PACKET_SIZE * 8; bit++) {
+        data[bit >> 3] ^= 1 << (bit & 7);
+        CHECK(!BTTFNValidate(guarded(data, sizeof(data)), sizeof(data), &pkt), "bit %d flipped: accepted", bit);
+        data[bit >> 3] ^= 1 << (bit & 7);
+        n++;
+    }
+
+    printf("bit flips      %d\n", n);
+}
+
+static void testAlignment()
+{
+    uint8_t data[BTTF_PACKET_SIZE], *mem, *buf;
+    BTTFNPacket pkt;
+
+    mem = (uint8_t *)malloc(BTTF_PACKET_SIZE + 16);
+    makeValid(data);
+    for(int off = 0; off < 8; off++) {
+        buf = mem + off;
+        memcpy(buf, data, sizeof(data));
+        memset(&pkt, 0, sizeof(pkt));
+        CHECK(BTTFNValidate(buf, sizeof(data), &pkt), "offset %d: rejected", off);
+        CHECK(!memcmp(&pkt, data, sizeof(data)), "offset %d: packet not copied", off);
+        CHECK(bttfnGet32(pkt.id) == (uint32_t)(data[6] | (data[7] << 8) | (data[8] << 16) | ((uint32_t)data[9] << 24)),
+            "offset %d: id", off);
+    }
+    free(mem);
+
+    printf("alignment      offsets 0-7\n");
+}
+
+/*
+ * Benchmark
+ */
+
+static double nsNow()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench(const char *name, const uint8_t *buf, size_t len)
+{
+    static BTTFNPacket pkt;
+    volatile int sink = 0;
+    double t0, tNew, tOld;
+
+    t0 = nsNow();
+    for(int i = 0; i < BENCH_RUNS; i++) sink += BTTFNValidate(buf, len, &pkt);
+    tNew = (nsNow() - t0) / BENCH_RUNS;
+
+    t0 = nsNow();
+    for(int i = 0; i < BENCH_RUNS; i++) sink += oldValidate(buf, len);
+    tOld = (nsNow() - t0) / BENCH_RUNS;
+
+    printf("timing %-7s BTTFNValidate %5.1f ns, old parser %5.1f ns\n", name, tNew, tOld);
+
+    // Loose bound, host timing is noisy
+    CHECK(tNew <= 2.0 * tOld + 5.0, "%s: BTTFNValidate slower than old parser", name);
+}
+
+int main()
+{
+    uint8_t valid[BTTF_PACKET_SIZE], junk[BTTF_PACKET_SIZE];
+
+    guardInit();
+
+    testRandom();
+    testTruncated();
+    testBitFlips();
+    testAlignment();
+
+    makeValid(valid);
+    for(int i = 0; i < BTTF_PACKET_SIZE; i++) junk[i] = rand32();
+    bench("valid", valid, sizeof(valid));
+    bench("junk", junk, sizeof(junk));
+    memcpy(junk, BTTFUDPHD, 4);
+    bench("badsum", junk, sizeof(junk));
+
+    if(failed) {
+        printf("%d check(s) FAILED\n", failed);
+        return 1;
+    }
+    printf("OK\n");
+
+    return 0;
+}
@@ -0,0 +1,19 @@
+#!/bin/sh
+#
+# bttfntest.sh - Build and run the BTTFN packet validator host test
+#
+# Usage: tools/bttfntest/bttfntest.sh
+
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+SRC="$HERE/../../src"
+OUT=${BTTFNTEST_OUT:-/tmp/bttfntest}
+CXX=${CXX:-c++}
+
+mkdir -p "$OUT"
+
+$CXX -std=gnu++11 -O2 -g -Wall -Wextra -I"$SRC" \
+    -o "$OUT/bttfntest" "$SRC/fc_bttfn.cpp" "$HERE/bttfntest.cpp"
+
+"$OUT/bttfntest"
@@ -0,0 +1,200 @@
+/*
+ * madcmp - Host check of libmad's fixed-point backends
+ *
+ * Decodes MP3 files with the firmware's libmad the same way
+ * AudioGeneratorMP3 does (frame by frame, one granule slot
+ * of 32 samples per mad_synth_frame_onens() call) and writes
+ * 16-bit PCM. madcmp.sh builds this once per backend and
+ * compares the output against the reference decode.
+ *
+ * Usage: madcmp [-m] in.mp3 out.pcm
+ *        madcmp -c ref.pcm test.pcm [maxdiff]
+ *        madcmp -x stereo.pcm mono.pcm [maxdiff]
+ *
+ *   With -m, stereo is mixed to mono in the subband domain
+ *   like AudioGeneratorMP3 with SetMonoMix(true).
+ *
+ *   With -c, two PCM files are compared sample by sample.
+ *   The exit code is 1 if any sample differs by more than
+ *   maxdiff (default 1) LSB, or the lengths differ.
+ *
+ *   With -x, a mono mix is compared with (L+R)/2 of the
+ *   stereo decode, as AudioOutputI2S computes it in mono 
+ *   mode (mono sources: with the plain decode). Prints max
+ *   and RMS error and the SNR; the exit code is 1 if any
+ *   sample is off by more than maxdiff (default 1) LSB.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "config.h"
+#include "mad.h"
+
+int stackfree() { return 8192; }
+
+static unsigned char *readFile(const char *fn, long *len, long extra)
+{
+    FILE *f = fopen(fn, "rb");
+    unsigned char *buf;
+
+    if(!f) {
+        perror(fn);
+        exit(2);
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if(!(buf = calloc(1, *len + extra))) {
+        exit(2);
+    }
+    if(fread(buf, 1, *len, f) != (size_t)*len) {
+        perror(fn);
+        exit(2);
+    }
+    fclose(f);
+    return buf;
+}
+
+static int compare(const char *fa, const char *fb, int maxDiff)
+{
+    long la, lb, i, n, over = 0;
+    unsigned char *a = readFile(fa, &la, 0);
+    unsigned char *b = readFile(fb, &lb, 0);
+    int d, worst = 0;
+
+    n = ((la < lb) ? la : lb) / 2;
+    for(i = 0; i < n; i++) {
+        d = (int16_t)(a[i*2] | (a[i*2+1] << 8)) - (int16_t)(b[i*2] | (b[i*2+1] << 8));
+        if(d < 0) d = -d;
+        if(d > worst) worst = d;
+        if(d > maxDiff) over++;
+    }
+
+    printf("%s: %ld samples, max diff %d LSB, %ld over %d%s\n",
+        fb, n, worst, over, maxDiff, (la != lb) ? ", LENGTH DIFFERS" : "");
+
+    return (over || la != lb) ? 1 : 0;
+}
+
+static int mixReport(const char *fs, const char *fm, int maxDiff)
+{
+    long ls, lm, i, n, ch;
+    unsigned char *s = readFile(fs, &ls, 0);
+    unsigned char *m = readFile(fm, &lm, 0);
+    double sig = 0.0, err = 0.0, snr;
+    int ref, d, worst = 0;
+
+    n = lm / 2;
+    ch = n ? ls / lm : 0;
+    if((ch != 1 && ch != 2) || ls != lm * ch) {
+        printf("%s: %ld samples, LENGTH DIFFERS\n", fm, n);
+        return 1;
+    }
+    for(i = 0; i < n; i++) {
+        if(ch == 2) {
+            ref = ((int16_t)(s[i*4]   | (s[i*4+1] << 8)) +
+                   (int16_t)(s[i*4+2] | (s[i*4+3] << 8))) >> 1;
+        } else {
+            ref = (int16_t)(s[i*2] | (s[i*2+1] << 8));
+        }
+        d = (int16_t)(m[i*2] | (m[i*2+1] << 8)) - ref;
+        sig += (double)ref * ref;
+        err += (double)d * d;
+        if(d < 0) d = -d;
+        if(d > worst) worst = d;
+    }
+    snr = err ? 10.0 * log10(sig / err) : INFINITY;
+
+    printf("%s: %ld samples%s, max err %d LSB, RMS err %.3f LSB, SNR %.1f dB\n",
+        fm, n, (ch == 1) ? " (mono source)" : "", worst, sqrt(err / n), snr);
+
+    return (worst > maxDiff) ? 1 : 0;
+}
+
+static int decode(const char *fin, const char *fout, int monoMix)
+{
+    struct mad_stream stream;
+    struct mad_frame frame;
+    struct mad_synth synth;
+    unsigned char *buf;
+    long len, frames = 0;
+    unsigned int ns, ch, i;
+    mad_fixed_t *l;
+    mad_fixed_t const *r;
+    FILE *f;
+
+    buf = readFile(fin, &len, MAD_BUFFER_GUARD);
+
+    if(!(f = fopen(fout, "wb"))) {
+        perror(fout);
+        return 2;
+    }
+
+    mad_stream_init(&stream);
+    mad_frame_init(&frame);
+    mad_synth_init(&synth);
+    mad_stream_buffer(&stream, buf, len + MAD_BUFFER_GUARD);
+
+    for(;;) {
+        if(mad_frame_decode(&frame, &stream) == -1) {
+            if(MAD_RECOVERABLE(stream.error))
+                continue;
+            break;
+        }
+        frames++;
+        // As AudioGeneratorMP3::DecodeNextFrame()
+        if(monoMix && frame.header.mode != MAD_MODE_SINGLE_CHANNEL) {
+            l = &frame.sbsample[0][0][0];
+            r = &frame.sbsample[1][0][0];
+            for(i = MAD_NSBSAMPLES(&frame.header) * 32; i > 0; i--, l++, r++) {
+                *l = (*l >> 1) + (*r >> 1);
+            }
+            frame.header.mode = MAD_MODE_SINGLE_CHANNEL;
+        }
+        for(ns = 0; ns < MAD_NSBSAMPLES(&frame.header); ns++) {
+            mad_synth_frame_onens(&synth, &frame, ns);
+            for(i = 0; i < synth.pcm.length; i++) {
+                for(ch = 0; ch < synth.pcm.channels; ch++) {
+                    int16_t s = synth.pcm.samples[ch][i];
+                    fputc(s & 0xff, f);
+                    fputc((s >> 8) & 0xff, f);
+                }
+            }
+        }
+    }
+
+    mad_synth_finish(&synth);
+    mad_frame_finish(&frame);
+    mad_stream_finish(&stream);
+
+    fclose(f);
+    free(buf);
+
+    printf("%s: %ld frames (%s)\n", fin, frames, mad_build);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc >= 4 && !strcmp(argv[1], "-c")) {
+        return compare(argv[2], argv[3], (argc > 4) ? atoi(argv[4]) : 1);
+    }
+    if(argc >= 4 && !strcmp(argv[1], "-x")) {
+        return mixReport(argv[2], argv[3], (argc > 4) ? atoi(argv[4]) : 1);
+    }
+    if(argc == 4 && !strcmp(argv[1], "-m")) {
+        return decode(argv[2], argv[3], 1);
+    }
+    if(argc == 3) {
+        return decode(argv[1], argv[2], 0);
+    }
+    fprintf(stderr, "Usage: madcmp [-m] in.mp3 out.pcm\n"
+                    "       madcmp -c ref.pcm test.pcm [maxdiff]\n"
+                    "       madcmp -x stereo.pcm mono.pcm [maxdiff]\n");
+    return 2;
+}
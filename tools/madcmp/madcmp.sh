@@ -0,0 +1,94 @@
+#!/bin/sh
+#
+# madcmp.sh - Compare libmad fixed-point backends on the host
+#
+# Builds the firmware's libmad three times:
+#   ref     FPM_64BIT, OPT_ACCURACY: full precision reference
+#   xtensa  FPM_XTENSA as used on the ESP32 (C version of MULL/MULSH)
+#   default FPM_DEFAULT with OPT_SSO, the previous ESP32 setting
+# decodes the given MP3 files (default: src/data/*.mp3) with each,
+# and checks that the xtensa output stays within +/-1 LSB of the
+# reference. The figures for the default backend are informational.
+#
+# Then the mono mix (AudioGeneratorMP3::SetMonoMix) is checked:
+# The xtensa build decodes each file with and without it, and
+# the mix is compared against (L+R)/2 of the stereo decode, which
+# is what the firmware played before. Max/RMS error and SNR are
+# reported; more than +/-1 LSB fails. The default sounds are all
+# mono, so by default, mkstereo.py makes stereo files (plain and
+# M/S joint stereo) from startup.mp3 and flux.mp3 for this.
+#
+# Usage: tools/madcmp/madcmp.sh [file.mp3 ...]
+
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+TOP="$HERE/../.."
+LIBMAD="$TOP/src/src/ESP8266Audio/libmad"
+OUT=${MADCMP_OUT:-/tmp/madcmp}
+CC=${CC:-cc}
+
+# Known upstream libmad warnings (OPT_DCTO's unused lo, fastsdct's
+# strided output)
+MADW="-Wno-unused-but-set-variable -Wno-stringop-overflow"
+
+mkdir -p "$OUT"
+
+build() {
+    b=$1
+    shift
+    rm -rf "$OUT/$b"
+    mkdir -p "$OUT/$b"
+    for f in "$LIBMAD"/*.c "$HERE/madcmp.c"; do
+        w="-Wall -Wextra"
+        case $f in "$LIBMAD"/*) w="$w $MADW" ;; esac
+        $CC -O2 $w -I"$HERE" -I"$LIBMAD" "$@" -c -o "$OUT/$b/$(basename "$f" .c).o" "$f"
+    done
+    $CC -o "$OUT/$b/madcmp" "$OUT/$b"/*.o -lm
+}
+
+build ref     -DFPM_64BIT -DOPT_ACCURACY
+build xtensa  -DFPM_XTENSA
+build default -DFPM_DEFAULT
+
+if [ $# -eq 0 ]; then
+    set -- "$TOP"/src/data/*.mp3
+    mix=""
+    for n in startup flux; do
+        python3 "$HERE/mkstereo.py" -s "$TOP/src/data/$n.mp3" "$OUT/$n.stereo.mp3"
+        python3 "$HERE/mkstereo.py" -j "$TOP/src/data/$n.mp3" "$OUT/$n.joint.mp3"
+        mix="$mix $OUT/$n.stereo.mp3 $OUT/$n.joint.mp3"
+    done
+else
+    mix="$*"
+fi
+
+fail=0
+for f in "$@"; do
+    n=$(basename "$f" .mp3)
+    for B in ref xtensa default; do
+        "$OUT/$B/madcmp" "$f" "$OUT/$n.$B.pcm" > /dev/null
+    done
+    "$OUT/ref/madcmp" -c "$OUT/$n.ref.pcm" "$OUT/$n.xtensa.pcm" || fail=1
+    "$OUT/ref/madcmp" -c "$OUT/$n.ref.pcm" "$OUT/$n.default.pcm" 32767 > "$OUT/$n.default.txt"
+    sed 's/^/  (previous: /; s/$/)/' "$OUT/$n.default.txt"
+done
+
+echo "Mono mix vs. (L+R)/2 (FPM_XTENSA):"
+mixfail=0
+for f in $mix; do
+    n=$(basename "$f" .mp3)
+    "$OUT/xtensa/madcmp" "$f" "$OUT/$n.st.pcm" > /dev/null
+    "$OUT/xtensa/madcmp" -m "$f" "$OUT/$n.mix.pcm" > /dev/null
+    "$OUT/xtensa/madcmp" -x "$OUT/$n.st.pcm" "$OUT/$n.mix.pcm" || mixfail=1
+done
+
+if [ $fail -ne 0 ]; then
+    echo "FAIL: FPM_XTENSA differs from reference by more than 1 LSB"
+    exit 1
+fi
+if [ $mixfail -ne 0 ]; then
+    echo "FAIL: Mono mix differs from (L+R)/2 by more than 1 LSB"
+    exit 1
+fi
+echo "OK"
@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+#
+# mkstereo.py - Make stereo MP3 test files from mono ones
+#
+# The default sounds are all mono, so this provides stereo input
+# for madcmp.sh. The layer III frames of a mono MP3 are repacked
+# as stereo frames without re-encoding:
+#
+#   -s  Plain stereo; left is frame i, right is frame i + offset
+#       (default: half the file)
+#   -j  M/S joint stereo; mid is frame i, side is the same frame
+#       6dB down (global_gain - 4). libmad wants both channels
+#       of an M/S frame to have the same block type, hence no
+#       offset here.
+#
+# All main data is taken out of the bit reservoir (main_data_begin
+# is always 0), and every frame gets the lowest bitrate it fits in.
+# Only MPEG-1 input is supported: MPEG-2 LSF mono frames usually
+# do not fit twice into LSF's maximum bitrate.
+#
+# Usage: mkstereo.py -s|-j [-o offset] in.mp3 out.mp3
+
+import sys
+
+BITRATES = [0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0]
+SRATES   = [44100, 48000, 32000, 0]
+
+
+class BitReader:
+
+    def __init__(self, data, pos=0):
+        self.data = data
+        self.pos = pos * 8
+
+    def read(self, n):
+        v = 0
+        for _ in range(n):
+            v = (v << 1) | ((self.data[self.pos >> 3] >> (7 - (self.pos & 7))) & 1)
+            self.pos += 1
+        return v
+
+
+class BitWriter:
+
+    def __init__(self):
+        self.bits = []
+
+    def write(self, v, n):
+        self.bits.extend((v >> (n - 1 - i)) & 1 for i in range(n))
+
+    def bytes(self, size):
+        b = bytearray(size)
+        for i, bit in enumerate(self.bits):
+            b[i >> 3] |= bit << (7 - (i & 7))
+        return b
+
+
+def frame_len(bri, sri, pad):
+    return 144 * BITRATES[bri] * 1000 // SRATES[sri] + pad
+
+
+def parse(name, d):
+    """Return (sri, frames); a frame is (scfsi, [granule records],
+    [granule main data bits]), records and data as (value, nbits)"""
+    pos = 0
+    if d[0:3] == b"ID3":
+        pos = (((d[6] & 0x7f) << 21) | ((d[7] & 0x7f) << 14) |
+               ((d[8] & 0x7f) << 7) | (d[9] & 0x7f)) + 10
+    while pos + 1 < len(d) and not (d[pos] == 0xff and (d[pos + 1] & 0xe0) == 0xe0):
+        pos += 1
+    res = bytearray()       # Main data of all frames so far
+    frames = []
+    sri = None
+    while pos + 4 <= len(d) and d[pos] == 0xff and (d[pos + 1] & 0xe0) == 0xe0:
+        h = d[pos:pos + 4]
+        if (h[1] & 0x1e) != 0x1a or (h[3] >> 6) != 3:
+            sys.exit("%s: Not an MPEG-1 layer III mono file" % name)
+        if sri is None:
+            sri = (h[2] >> 2) & 3
+        elif sri != (h[2] >> 2) & 3:
+            sys.exit("%s: Sample rate changes" % name)
+        flen = frame_len(h[2] >> 4, sri, (h[2] >> 1) & 1)
+        if pos + flen > len(d):
+            break
+        sipos = pos + 4 + (0 if (h[1] & 1) else 2)
+        br = BitReader(d, sipos)
+        mdb = br.read(9)
+        br.read(5)
+        scfsi = br.read(4)
+        recs = [(br.read(59), 59), (br.read(59), 59)]
+        area = d[sipos + 17:pos + flen]
+        if mdb > len(res):
+            sys.exit("%s: Bad main_data_begin" % name)
+        md = BitReader(res[len(res) - mdb:] + area)
+        data = []
+        for v, n in recs:
+            p23 = v >> (n - 12)
+            data.append((md.read(p23), p23))
+        res += area
+        frames.append((scfsi, recs, data))
+        pos += flen
+    if sri is None:
+        sys.exit("%s: No MPEG audio frames found" % name)
+    return sri, frames
+
+
+def lower_gain(rec, steps):
+    v, n = rec
+    sh = n - 12 - 9 - 8
+    gg = (v >> sh) & 0xff
+    gg = max(gg - steps, 0)
+    return ((v & ~(0xff << sh)) | (gg << sh), n)
+
+
+def build(sri, frames, joint, offset):
+    out = bytearray()
+    for i, (scfsi, recs, data) in enumerate(frames):
+        if joint:
+            scfsi2 = scfsi
+            recs2 = [lower_gain(r, 4) for r in recs]
+            data2 = data
+        else:
+            scfsi2, recs2, data2 = frames[(i + offset) % len(frames)]
+        w = BitWriter()
+        w.write(0, 9)               # main_data_begin
+        w.write(0, 3)               # private bits
+        w.write(scfsi, 4)
+        w.write(scfsi2, 4)
+        for gr in range(2):
+            w.write(*recs[gr])
+            w.write(*recs2[gr])
+        for gr in range(2):
+            w.write(*data[gr])
+            w.write(*data2[gr])
+        need = (len(w.bits) + 7) // 8 + 4
+        for bri in range(1, 15):
+            flen = frame_len(bri, sri, 0)
+            if flen >= need:
+                break
+        else:
+            sys.exit("Frame %d too big for stereo" % i)
+        h = bytearray(4)
+        h[0] = 0xff
+        h[1] = 0xfb                 # MPEG-1 layer III, no CRC
+        h[2] = (bri << 4) | (sri << 2)
+        h[3] = ((1 << 6) | (2 << 4)) if joint else 0            # joint M/S or stereo
+        out += h + w.bytes(flen - 4)
+    return out
+
+
+def main():
+    args = sys.argv[1:]
+    joint = None
+    offset = None
+    while args and args[0].startswith("-"):
+        a = args.pop(0)
+        if a in ("-s", "-j"):
+            joint = (a == "-j")
+        elif a == "-o" and args:
+            offset = int(args.pop(0))
+        else:
+            args = []
+    if joint is None or len(args) != 2:
+        sys.exit("Usage: mkstereo.py -s|-j [-o offset] in.mp3 out.mp3")
+
+    with open(args[0], "rb") as f:
+        sri, frames = parse(args[0], f.read())
+    if offset is None:
+        offset = len(frames) // 2
+    with open(args[1], "wb") as f:
+        f.write(build(sri, frames, joint, offset))
+
+
+if __name__ == "__main__":
+    main()
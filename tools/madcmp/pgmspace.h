@@ -0,0 +1,17 @@
+/*
+ * Host stand-in for the Arduino <pgmspace.h>, so libmad builds
+ * for madcmp. Flash and RAM are the same thing here.
+ */
+#ifndef _MADCMP_PGMSPACE_H
+#define _MADCMP_PGMSPACE_H
+
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)                 (s)
+#define memcpy_P                memcpy
+#define pgm_read_byte(a)        (*(const unsigned char *)(a))
+#define pgm_read_word(a)        (*(const unsigned short *)(a))
+#define pgm_read_dword(a)       (*(const unsigned int *)(a))
+
+#endif
@@ -0,0 +1,254 @@
+#!/usr/bin/env python3
+#
+# mkfcbank.py - Build packed sound bank for the Flux Capacitor
+#
+# Packs the default sound files into one image ("fcsnd.bin"), which
+# the audio installer copies to flash instead of the single files.
+# ID3 tags and any data before the first/after the last MPEG audio
+# frame are removed, so the firmware can start playback without
+# looking at the files.
+#
+# Usage: mkfcbank.py [-o fcsnd.bin] [-m FC_def_snd.txt] [srcdir]
+#        mkfcbank.py -c fcsnd.bin
+#
+#   srcdir defaults to src/data. With -m, the manifest line for the
+#   bank ("fcsnd.bin <size> <crc32>") is added to (or updated in)
+#   the given sound-pack ID file.
+#
+# Image layout (all numbers little endian):
+#
+#   Header (16 bytes):
+#     char     magic[4]      "FCSB"
+#     uint16   version       1
+#     uint16   count         number of sounds
+#     uint32   size          total size of image
+#     uint32   reserved      0
+#   Sound table (count x 32 bytes):
+#     char     name[16]      file name without "/", NUL-padded
+#     uint32   offset        start of MPEG data in image
+#     uint32   length        length of MPEG data
+#     uint32   idxOffset     start of frame index in image
+#     uint16   numFrames     number of MPEG frames
+#     uint16   idxCount      number of frame index entries
+#   Frame indices:
+#     uint32   offset of every IDX_STEP'th frame, relative to
+#              start of sound's MPEG data
+#   MPEG data, each sound starting 4-byte-aligned and followed by
+#   at least GUARD zero bytes (the decoder reads up to 8 bytes 
+#   beyond a frame; the firmware decodes memory-mapped sounds
+#   in place)
+#
+# The image can either be stored as a file on flash FS, or in a
+# data partition named "fcsnd" (see partitions_fcsnd.csv).
+#
+# With -c, an existing image is checked instead: It is mmap()ed
+# and every sound's frame chain (headers, frame index, guard 
+# bytes) is walked in place. This does not decode anything; 
+# tools/banktest/banktest.sh plays the bank through the 
+# firmware's AudioFileSourceBank and AudioGeneratorMP3.
+
+import mmap
+import os
+import struct
+import sys
+import time
+import zlib
+
+MAGIC    = b"FCSB"
+VERSION  = 1
+IDX_STEP = 32
+GUARD    = 8
+HDR_FMT  = "<4sHHII"
+ENT_FMT  = "<16sIIIHH"
+
+# Order matches the firmware's list of default sounds;
+# installing.mp3 is only ever played from SD, so it is
+# not part of the bank.
+SOUNDS = [
+    "0.mp3", "1.mp3", "2.mp3", "3.mp3", "4.mp3",
+    "5.mp3", "6.mp3", "7.mp3", "8.mp3", "9.mp3",
+    "dot.mp3",
+    "flux.mp3",
+    "startup.mp3",
+    "timetravel.mp3",
+    "travelstart.mp3",
+    "alarm.mp3",
+    "fluxing.mp3",
+    "renaming.mp3",
+]
+
+BITRATES_V1 = [0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0]
+BITRATES_V2 = [0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0]
+SRATES      = [44100, 48000, 32000, 0]
+
+
+def frame_len(d, pos):
+    """Length of MPEG layer III frame at pos, 0 if no valid header"""
+    if pos + 4 > len(d):
+        return 0
+    h1, h2, h3 = d[pos + 1], d[pos + 2], d[pos + 3]
+    if d[pos] != 0xff or (h1 & 0xe0) != 0xe0:
+        return 0
+    ver = (h1 >> 3) & 3         # 3 = MPEG1, 2 = MPEG2, 0 = MPEG2.5
+    layer = (h1 >> 1) & 3       # 1 = layer III
+    if ver == 1 or layer != 1:
+        return 0
+    br = (BITRATES_V1 if ver == 3 else BITRATES_V2)[h2 >> 4] * 1000
+    sr = SRATES[(h2 >> 2) & 3]
+    if not br or not sr:
+        return 0
+    if ver != 3:
+        sr >>= (1 if ver == 2 else 2)
+    return (144 if ver == 3 else 72) * br // sr + ((h2 >> 1) & 1)
+
+
+def skip_id3(d):
+    if len(d) >= 10 and d[0:3] == b"ID3" and d[3] in (2, 3, 4) and not (d[5] & 0x80):
+        return (((d[6] & 0x7f) << 21) | ((d[7] & 0x7f) << 14) |
+                ((d[8] & 0x7f) << 7) | (d[9] & 0x7f)) + 10
+    return 0
+
+
+def strip_mp3(name, d):
+    """Return (data, frame offsets) of the MPEG frame chain in d"""
+    pos = skip_id3(d)
+    # Find first header that is followed by another valid header
+    while pos < len(d):
+        fl = frame_len(d, pos)
+        if fl and (pos + fl == len(d) or frame_len(d, pos + fl)):
+            break
+        pos += 1
+    else:
+        sys.exit("%s: No MPEG audio frames found" % name)
+    start = pos
+    frames = []
+    while True:
+        fl = frame_len(d, pos)
+        if not fl or pos + fl > len(d):
+            break
+        frames.append(pos - start)
+        pos += fl
+    return d[start:pos], frames
+
+
+def build(srcdir):
+    sounds = []
+    for name in SOUNDS:
+        with open(os.path.join(srcdir, name), "rb") as f:
+            raw = f.read()
+        data, frames = strip_mp3(name, raw)
+        if len(frames) > 0xffff:
+            sys.exit("%s: Too many frames" % name)
+        idx = frames[::IDX_STEP]
+        sounds.append((name, data, frames, idx))
+        print("%-16s %7d -> %7d bytes, %5d frames" % (name, len(raw), len(data), len(frames)))
+
+    pos = struct.calcsize(HDR_FMT) + len(sounds) * struct.calcsize(ENT_FMT)
+    idxoffs = []
+    for s in sounds:
+        idxoffs.append(pos)
+        pos += len(s[3]) * 4
+    dataoffs = []
+    for s in sounds:
+        pos = (pos + 3) & ~3
+        dataoffs.append(pos)
+        pos += len(s[1]) + GUARD
+    size = pos
+
+    img = bytearray(size)
+    struct.pack_into(HDR_FMT, img, 0, MAGIC, VERSION, len(sounds), size, 0)
+    epos = struct.calcsize(HDR_FMT)
+    for i, (name, data, frames, idx) in enumerate(sounds):
+        struct.pack_into(ENT_FMT, img, epos, name.encode("ascii"),
+                         dataoffs[i], len(data), idxoffs[i], len(frames), len(idx))
+        epos += struct.calcsize(ENT_FMT)
+        struct.pack_into("<%dI" % len(idx), img, idxoffs[i], *idx)
+        img[dataoffs[i]:dataoffs[i] + len(data)] = data
+
+    return bytes(img)
+
+
+def check(fn):
+    """Walk all sounds in mmap()ed image; returns number of errors"""
+    errs = 0
+    with open(fn, "rb") as f:
+        img = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    t0 = time.perf_counter()
+    magic, ver, count, size, _ = struct.unpack_from(HDR_FMT, img, 0)
+    if magic != MAGIC or ver != VERSION or size != len(img):
+        sys.exit("%s: Bad header" % fn)
+    total = 0
+    for i in range(count):
+        name, off, length, idxoff, nframes, nidx = struct.unpack_from(
+            ENT_FMT, img, struct.calcsize(HDR_FMT) + i * struct.calcsize(ENT_FMT))
+        name = name.rstrip(b"\0").decode("ascii")
+        idx = struct.unpack_from("<%dI" % nidx, img, idxoff)
+        pos, n = off, 0
+        while pos < off + length:
+            if n % IDX_STEP == 0 and (n // IDX_STEP >= nidx or idx[n // IDX_STEP] != pos - off):
+                break
+            fl = frame_len(img, pos)
+            if not fl:
+                break
+            pos += fl
+            n += 1
+        if pos != off + length or n != nframes:
+            print("%s: Frame chain broken at frame %d" % (name, n))
+            errs += 1
+        elif img[pos:pos + GUARD] != bytes(GUARD):
+            print("%s: Guard bytes missing" % name)
+            errs += 1
+        total += length
+    t = time.perf_counter() - t0
+    print("%s: %d sounds, %d bytes of MPEG data walked in %.1fms, %d errors" %
+          (fn, count, total, t * 1000, errs))
+    img.close()
+    return errs
+
+
+def update_manifest(fn, outname, img):
+    line = "%s %d %08x\n" % (os.path.basename(outname), len(img), zlib.crc32(img) & 0xffffffff)
+    with open(fn, "r") as f:
+        lines = [l for l in f.readlines() if not l.startswith(os.path.basename(outname) + " ")]
+    if lines and not lines[-1].endswith("\n"):
+        lines[-1] += "\n"
+    lines.append(line)
+    with open(fn, "w") as f:
+        f.writelines(lines)
+
+
+def main():
+    args = sys.argv[1:]
+    outname = "fcsnd.bin"
+    manifest = None
+    checkname = None
+    srcdir = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "data")
+    while args:
+        a = args.pop(0)
+        if a == "-o" and args:
+            outname = args.pop(0)
+        elif a == "-m" and args:
+            manifest = args.pop(0)
+        elif a == "-c" and args:
+            checkname = args.pop(0)
+        elif a.startswith("-"):
+            sys.exit("Usage: mkfcbank.py [-o fcsnd.bin] [-m FC_def_snd.txt] [srcdir]\n"
+                     "       mkfcbank.py -c fcsnd.bin")
+        else:
+            srcdir = a
+
+    if checkname:
+        sys.exit(1 if check(checkname) else 0)
+
+    img = build(srcdir)
+
+    with open(outname, "wb") as f:
+        f.write(img)
+    print("%s: %d bytes" % (outname, len(img)))
+
+    if manifest:
+        update_manifest(manifest, outname, img)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,525 @@
+/*
+ * mqtttest - Host test of the MQTT client against a stand-in broker
+ *
+ * Builds src/mqtt.cpp with the host shims in shim/ and runs
+ * the client against a minimal broker on 127.0.0.1. The broker
+ * answers each connection as told by the test (CONNACK with a
+ * given return code, no answer at all, or no listener).
+ *
+ * Checks that
+ * - every connection attempt ends in a definite state, and
+ *   all failures, including CONNACK time-outs and refusals,
+ *   are reported as a state other than MQTT_CONNECTED.
+ *   mqttConnectResult() in fc_wifi.cpp relies on this to
+ *   back off;
+ * - QoS1 message ids are not re-used for new messages while
+ *   older ones are still unacknowledged after a reconnect;
+ * - a short write while flushing the queue closes the 
+ *   connection instead of leaving a partial packet;
+ * - slow and fragmented broker data (CONNACK byte by byte,
+ *   PUBLISH split across reads, a stalled remaining length
+ *   field) is reassembled correctly;
+ * - connect() and loop() never wait for the network: every
+ *   call returns within CALL_MAX_US.
+ *
+ * Usage: tools/mqtttest/mqtttest.sh
+ */
+
+#include <Arduino.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+
+#include "mqtt.h"
+
+HostSerial Serial;
+size_t WiFiClient::maxWrite = (size_t)-1;
+
+#define BRK_NONE    -1      // Do not answer CONNECT
+#define BRK_DEAD    -2      // No listener
+
+#define CALL_MAX_US 5000    // Longest connect()/loop() call
+
+static int failed = 0;
+
+#define CHECK(c, ...) do { if(!(c)) { printf("FAIL: " __VA_ARGS__); printf("\n"); failed++; } } while(0)
+
+/*
+ * Stand-in broker
+ */
+
+#define BRK_MAXPUB  16
+#define BRK_MAXTX   512
+
+static struct {
+    int       ls;           // Listening socket
+    uint16_t  port;
+    int       connack;      // CONNACK return code or BRK_NONE
+    pthread_t thread;
+    // Slow broker: CONNACK byte by byte, and tx[] sent after
+    // CONNACK, split at cut[], with pause ms between pieces.
+    // Set before brkStart(), cleared by brkStop().
+    bool      dripAck;
+    int       pause;
+    uint8_t   tx[BRK_MAXTX];
+    int       txLen;
+    int       cut[BRK_MAXTX];
+    int       ncut;
+    // Received QoS1 PUBLISH packets (never acknowledged)
+    pthread_mutex_t mux;
+    int       npub;
+    char      topic[BRK_MAXPUB][MQTT_TXQ_TLEN];
+    uint16_t  msgId[BRK_MAXPUB];
+    bool      dup[BRK_MAXPUB];
+    bool      garbage;      // Unparsable packet seen
+} broker;
+
+// Read one complete packet; returns its type or -1
+static int brkReadPacket(int s, uint8_t *buf, int bufSize, int *len)
+{
+    uint8_t hdr, d;
+    uint32_t rem = 0, mult = 1;
+
+    if(recv(s, &hdr, 1, MSG_WAITALL) != 1)
+        return -1;
+    do {
+        if(recv(s, &d, 1, MSG_WAITALL) != 1)
+            return -1;
+        rem += (d & 0x7f) * mult;
+        mult <<= 7;
+    } while(d & 0x80);
+    if((int)rem > bufSize)
+        return -1;
+    if(rem && recv(s, buf, rem, MSG_WAITALL) != (ssize_t)rem)
+        return -1;
+    *len = rem;
+
+    return hdr;
+}
+
+// Send buf in pieces ending at cut[], pausing in between
+static void brkSendPieces(int s, const uint8_t *buf, int len, const int *cut, int ncut)
+{
+    int pos = 0, end;
+
+    for(int i = 0; i <= ncut; i++) {
+        end = (i < ncut) ? cut[i] : len;
+        if(end > pos) {
+            send(s, buf + pos, end - pos, MSG_NOSIGNAL);
+            pos = end;
+        }
+        if(i < ncut) usleep(broker.pause * 1000);
+    }
+}
+
+static void *brkThread(void *arg)
+{
+    uint8_t buf[512];
+    int s, len, type, tl, one = 1;
+
+    (void)arg;
+
+    if((s = accept(broker.ls, NULL, NULL)) < 0)
+        return NULL;
+
+    // Every piece goes out in its own segment
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if((brkReadPacket(s, buf, sizeof(buf), &len) & 0xf0) == MQTTCONNECT) {
+        if(broker.connack != BRK_NONE) {
+            uint8_t ack[4] = { MQTTCONNACK, 2, 0, (uint8_t)broker.connack };
+            const int ackCut[3] = { 1, 2, 3 };
+            brkSendPieces(s, ack, 4, ackCut, broker.dripAck ? 3 : 0);
+        }
+        if(broker.txLen) {
+            brkSendPieces(s, broker.tx, broker.txLen, broker.cut, broker.ncut);
+        }
+    }
+
+    // Record what comes in until the client closes the connection
+    while((type = brkReadPacket(s, buf, sizeof(buf), &len)) >= 0) {
+        if((type & 0xf0) != MQTTPUBLISH)
+            continue;
+        tl = (buf[0] << 8) | buf[1];
+        pthread_mutex_lock(&broker.mux);
+        if(!(type & MQTTQOS1) || tl >= MQTT_TXQ_TLEN || 2 + tl + 2 > len) {
+            broker.garbage = true;
+        } else if(broker.npub < BRK_MAXPUB) {
+            memcpy(broker.topic[broker.npub], buf + 2, tl);
+            broker.topic[broker.npub][tl] = 0;
+            broker.msgId[broker.npub] = (buf[2 + tl] << 8) | buf[3 + tl];
+            broker.dup[broker.npub] = (type & 0x08) ? true : false;
+            broker.npub++;
+        }
+        pthread_mutex_unlock(&broker.mux);
+    }
+
+    close(s);
+
+    return NULL;
+}
+
+static void brkStart(int connack)
+{
+    struct sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+    int one = 1;
+
+    broker.ls = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(broker.ls, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(broker.ls, (struct sockaddr *)&addr, sizeof(addr));
+    listen(broker.ls, 1);
+    getsockname(broker.ls, (struct sockaddr *)&addr, &alen);
+    broker.port = ntohs(addr.sin_port);
+    broker.connack = connack;
+    broker.npub = 0;
+    broker.garbage = false;
+
+    pthread_create(&broker.thread, NULL, brkThread, NULL);
+}
+
+static int brkPublished()
+{
+    int n;
+    
+    pthread_mutex_lock(&broker.mux);
+    n = broker.npub;
+    pthread_mutex_unlock(&broker.mux);
+
+    return n;
+}
+
+static void brkStop()
+{
+    shutdown(broker.ls, SHUT_RDWR);
+    close(broker.ls);
+    pthread_join(broker.thread, NULL);
+
+    broker.dripAck = false;
+    broker.pause = 0;
+    broker.txLen = 0;
+    broker.ncut = 0;
+}
+
+// Queue a QoS0 PUBLISH for the broker to send after CONNACK
+static void brkPublish(const char *topic, const uint8_t *payload, int plen)
+{
+    int tl = strlen(topic), rem = 2 + tl + plen, n = 0;
+    uint8_t *p = broker.tx;
+
+    p[n++] = MQTTPUBLISH;
+    do {
+        p[n] = rem & 0x7f;
+        rem >>= 7;
+        if(rem) p[n] |= 0x80;
+        n++;
+    } while(rem);
+    p[n++] = tl >> 8;
+    p[n++] = tl & 0xff;
+    memcpy(p + n, topic, tl);
+    n += tl;
+    memcpy(p + n, payload, plen);
+    broker.txLen = n + plen;
+}
+
+// A port nobody listens on
+static uint16_t deadPort()
+{
+    struct sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(s, (struct sockaddr *)&addr, sizeof(addr));
+    getsockname(s, (struct sockaddr *)&addr, &alen);
+    close(s);
+
+    return ntohs(addr.sin_port);
+}
+
+/*
+ * Client side
+ */
+
+// Longest connect()/loop() call so far, us
+static unsigned long maxCallUs;
+
+static unsigned long usNow()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+static void callTime(unsigned long t0)
+{
+    unsigned long t = usNow() - t0;
+
+    if(t > maxCallUs) maxCallUs = t;
+}
+
+static bool timedLoop(PubSubClient& mqtt)
+{
+    unsigned long t0 = usNow();
+    bool r = mqtt.loop();
+
+    callTime(t0);
+
+    return r;
+}
+
+// Received messages
+static struct {
+    int      n;
+    char     topic[MQTT_TXQ_TLEN];
+    uint8_t  payload[MQTT_MAX_PACKET_SIZE];
+    unsigned len;
+} rx;
+
+static void rxCallback(char *topic, uint8_t *payload, unsigned int len)
+{
+    if(!rx.n++) {
+        snprintf(rx.topic, sizeof(rx.topic), "%s", topic);
+        rx.len = (len < sizeof(rx.payload)) ? len : sizeof(rx.payload);
+        memcpy(rx.payload, payload, rx.len);
+    }
+}
+
+// Drive loop() until the connect process is over
+static int runConnect(PubSubClient& mqtt, uint16_t port)
+{
+    unsigned long now = millis(), t0;
+
+    mqtt.setServer(IPAddress(127, 0, 0, 1), port);
+    t0 = usNow();
+    mqtt.connect("fctest");
+    callTime(t0);
+    while(mqtt.state() == MQTT_CONNECTING && millis() - now < 10000) {
+        timedLoop(mqtt);
+        usleep(1000);
+    }
+
+    return mqtt.state();
+}
+
+static void testConnect(const char *name, int connack, int expect)
+{
+    WiFiClient net;
+    PubSubClient mqtt(net);
+    int state;
+
+    maxCallUs = 0;
+    mqtt.setSocketTimeout(1);
+
+    if(connack == BRK_DEAD) {
+        state = runConnect(mqtt, deadPort());
+    } else {
+        brkStart(connack);
+        state = runConnect(mqtt, broker.port);
+        mqtt.disconnect();
+        brkStop();
+    }
+
+    printf("%-26s state %d, longest call %luus\n", name, state, maxCallUs);
+
+    CHECK(state == expect, "%s: state %d, expected %d", name, state, expect);
+    CHECK(state != MQTT_CONNECTING, "%s: still connecting", name);
+    if(connack != 0) {
+        CHECK(state != MQTT_CONNECTED, "%s: failure reported as connected", name);
+    }
+    CHECK(maxCallUs <= CALL_MAX_US, "%s: call took %luus", name, maxCallUs);
+}
+
+// Run loop() until the broker has n messages or ms have passed
+static void runLoop(PubSubClient& mqtt, int n, unsigned long ms)
+{
+    unsigned long now = millis();
+
+    while(brkPublished() < n && millis() - now < ms) {
+        timedLoop(mqtt);
+        usleep(1000);
+    }
+}
+
+// Run loop() until the client received a message or ms have passed
+static void runRx(PubSubClient& mqtt, unsigned long ms)
+{
+    unsigned long now = millis();
+
+    while(!rx.n && millis() - now < ms) {
+        timedLoop(mqtt);
+        usleep(1000);
+    }
+}
+
+static void testSlowConnack()
+{
+    WiFiClient net;
+    PubSubClient mqtt(net);
+    int state;
+
+    maxCallUs = 0;
+    broker.dripAck = true;
+    broker.pause = 50;
+    brkStart(0);
+    state = runConnect(mqtt, broker.port);
+    mqtt.disconnect();
+    brkStop();
+
+    printf("%-26s state %d, longest call %luus\n", "CONNACK byte by byte", state, maxCallUs);
+
+    CHECK(state == MQTT_CONNECTED, "slow CONNACK: state %d", state);
+    CHECK(maxCallUs <= CALL_MAX_US, "slow CONNACK: call took %luus", maxCallUs);
+}
+
+/*
+ * Broker sends a PUBLISH in pieces; cut[] are offsets into the
+ * packet, or NULL for byte by byte. The payload needs a two byte
+ * remaining length, so cut at 2 stalls inside that field.
+ */
+static void testSlowPublish(const char *name, const int *cut, int ncut, int pause)
+{
+    WiFiClient net;
+    PubSubClient mqtt(net);
+    uint8_t pl[200];
+    bool conn;
+
+    for(int i = 0; i < (int)sizeof(pl); i++) pl[i] = 'a' + i % 26;
+
+    maxCallUs = 0;
+    memset(&rx, 0, sizeof(rx));
+    brkPublish("fctest/slow", pl, sizeof(pl));
+    if(cut) {
+        memcpy(broker.cut, cut, ncut * sizeof(int));
+        broker.ncut = ncut;
+    } else {
+        for(broker.ncut = 0; broker.ncut < broker.txLen - 1; broker.ncut++) {
+            broker.cut[broker.ncut] = broker.ncut + 1;
+        }
+    }
+    broker.pause = pause;
+    brkStart(0);
+
+    mqtt.setCallback(rxCallback);
+    runConnect(mqtt, broker.port);
+    runRx(mqtt, 5000);
+    conn = mqtt.connected();
+
+    mqtt.disconnect();
+    brkStop();
+
+    printf("%-26s %d message(s), %u bytes, longest call %luus\n", name, rx.n, rx.len, maxCallUs);
+
+    CHECK(rx.n == 1, "%s: %d messages received", name, rx.n);
+    CHECK(!strcmp(rx.topic, "fctest/slow"), "%s: topic '%s'", name, rx.topic);
+    CHECK(rx.len == sizeof(pl) && !memcmp(rx.payload, pl, sizeof(pl)), "%s: payload mismatch", name);
+    CHECK(conn, "%s: connection closed", name);
+    CHECK(maxCallUs <= CALL_MAX_US, "%s: call took %luus", name, maxCallUs);
+}
+
+static void testMsgIds()
+{
+    WiFiClient net;
+    PubSubClient mqtt(net);
+    uint16_t idA, idB;
+    const uint8_t pl[] = "1";
+    int i;
+
+    // First session: Message a is sent but never acknowledged
+    brkStart(0);
+    runConnect(mqtt, broker.port);
+    mqtt.queue("fctest/a", pl, 1, false, 1);
+    runLoop(mqtt, 1, 2000);
+    CHECK(brkPublished() == 1, "msgid: first message not received");
+    idA = broker.msgId[0];
+    mqtt.disconnect();
+    brkStop();
+
+    // Second session: a is re-sent with its id, b must get another one
+    brkStart(0);
+    runConnect(mqtt, broker.port);
+    mqtt.queue("fctest/b", pl, 1, false, 1);
+    runLoop(mqtt, 2, 2000);
+    CHECK(brkPublished() == 2, "msgid: %d messages after reconnect, expected 2", brkPublished());
+    idB = 0;
+    for(i = 0; i < broker.npub; i++) {
+        if(!strcmp(broker.topic[i], "fctest/a")) {
+            CHECK(broker.msgId[i] == idA, "msgid: re-sent message has id %d, was %d", broker.msgId[i], idA);
+            CHECK(broker.dup[i], "msgid: re-sent message without DUP");
+        } else {
+            idB = broker.msgId[i];
+        }
+    }
+    mqtt.disconnect();
+    brkStop();
+
+    printf("%-26s ids %d, %d\n", "msgid across reconnect", idA, idB);
+
+    CHECK(idB && idB != idA, "msgid: new message re-uses in-flight id %d", idA);
+}
+
+static void testShortWrite()
+{
+    WiFiClient net;
+    PubSubClient mqtt(net);
+    const uint8_t pl[] = "1";
+    bool conn;
+    int state;
+
+    brkStart(0);
+    runConnect(mqtt, broker.port);
+
+    WiFiClient::maxWrite = 3;
+    mqtt.queue("fctest/short", pl, 1, false, 1);
+    mqtt.loop();
+    WiFiClient::maxWrite = (size_t)-1;
+    conn = mqtt.connected();
+    state = mqtt.state();
+
+    mqtt.disconnect();
+    brkStop();
+
+    printf("%-26s %s, state %d\n", "short write", conn ? "connected" : "closed", state);
+
+    CHECK(!conn, "short write: connection kept open");
+    CHECK(!broker.npub, "short write: broker received a message");
+}
+
+int main()
+{
+    pthread_mutex_init(&broker.mux, NULL);
+
+    testConnect("no listener",        BRK_DEAD, MQTT_CONNECT_FAILED);
+    testConnect("no CONNACK",         BRK_NONE, MQTT_CONNECTION_TIMEOUT);
+    testConnect("CONNACK accepted",          0, MQTT_CONNECTED);
+    testConnect("CONNACK bad protocol",      1, MQTT_CONNECT_BAD_PROTOCOL);
+    testConnect("CONNACK bad client id",     2, MQTT_CONNECT_BAD_CLIENT_ID);
+    testConnect("CONNACK unavailable",       3, MQTT_CONNECT_UNAVAILABLE);
+    testConnect("CONNACK bad credentials",   4, MQTT_CONNECT_BAD_CREDENTIALS);
+    testConnect("CONNACK unauthorized",      5, MQTT_CONNECT_UNAUTHORIZED);
+    testSlowConnack();
+    {
+        const int split[] = { 1, 4, 9, 60, 150 };
+        const int stall[] = { 2 };
+        testSlowPublish("PUBLISH split",        split, 5, 20);
+        testSlowPublish("PUBLISH byte by byte", NULL,  0, 1);
+        testSlowPublish("PUBLISH stalled length", stall, 1, 1000);
+    }
+    testMsgIds();
+    testShortWrite();
+
+    if(failed) {
+        printf("%d check(s) FAILED\n", failed);
+        return 1;
+    }
+    printf("OK\n");
+
+    return 0;
+}
@@ -0,0 +1,19 @@
+#!/bin/sh
+#
+# mqtttest.sh - Build and run the MQTT client host test
+#
+# Usage: tools/mqtttest/mqtttest.sh
+
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+SRC="$HERE/../../src"
+OUT=${MQTTTEST_OUT:-/tmp/mqtttest}
+CXX=${CXX:-c++}
+
+mkdir -p "$OUT"
+
+$CXX -std=gnu++11 -O1 -g -Wall -Wextra -I"$HERE/shim" -I"$SRC" \
+    -o "$OUT/mqtttest" "$SRC/mqtt.cpp" "$HERE/mqtttest.cpp" -lpthread
+
+"$OUT/mqtttest"
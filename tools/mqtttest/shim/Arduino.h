@@ -0,0 +1,28 @@
+/*
+ * Host stand-in for the parts of the Arduino core used by mqtt.cpp
+ */
+
+#ifndef _ARDUINO_SHIM_H
+#define _ARDUINO_SHIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+static inline unsigned long millis()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+struct HostSerial {
+    void println(const char *s) { printf("%s\n", s); }
+    template<typename... A> void printf(const char *f, A... a) { ::printf(f, a...); }
+};
+extern HostSerial Serial;
+
+#endif
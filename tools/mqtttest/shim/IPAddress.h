@@ -0,0 +1,16 @@
+#ifndef _IPADDRESS_SHIM_H
+#define _IPADDRESS_SHIM_H
+
+#include <stdint.h>
+
+class IPAddress {
+    public:
+        IPAddress() : _a(0) {}
+        IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) 
+            : _a(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+        operator uint32_t() const { return _a; }
+    private:
+        uint32_t _a;
+};
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * Host stand-in for WiFiClient on a POSIX socket
+ *
+ * maxWrite limits the bytes accepted per write() to
+ * simulate a short write.
+ */
+
+#ifndef _WIFICLIENT_SHIM_H
+#define _WIFICLIENT_SHIM_H
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+
+class WiFiClient {
+    public:
+        WiFiClient() : _fd(-1) {}
+        WiFiClient(int fd) : _fd(fd) {}
+        
+        uint8_t connected()
+        {
+            char c;
+            if(_fd < 0) return 0;
+            int r = recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+            return (r > 0 || (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))) ? 1 : 0;
+        }
+        int available()
+        {
+            int n = 0;
+            if(_fd < 0 || ioctl(_fd, FIONREAD, &n) < 0) return 0;
+            return n;
+        }
+        int read()
+        {
+            uint8_t c;
+            return (read(&c, 1) == 1) ? c : -1;
+        }
+        int read(uint8_t *buf, size_t len)
+        {
+            return (_fd < 0) ? -1 : (int)recv(_fd, buf, len, 0);
+        }
+        size_t write(const uint8_t *buf, size_t len)
+        {
+            if(_fd < 0) return 0;
+            if(len > maxWrite) len = maxWrite;
+            ssize_t r = send(_fd, buf, len, MSG_NOSIGNAL);
+            return (r < 0) ? 0 : (size_t)r;
+        }
+        void flush() {}
+        void stop()
+        {
+            if(_fd >= 0) close(_fd);
+            _fd = -1;
+        }
+
+        static size_t maxWrite;
+        
+    private:
+        int _fd;
+};
+
+#endif
@@ -0,0 +1 @@
+#define FC_HAVEMQTT
@@ -0,0 +1 @@
+#include "sockets.h"
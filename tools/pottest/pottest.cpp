@@ -0,0 +1,203 @@
+/*
+ * pottest - Host test of the pot input filter (FCPot)
+ *
+ * Builds src/input.cpp with the host shim in shim/ and feeds
+ * synthetic noisy ADC traces through FCPot's median/IIR/
+ * hysteresis filter. Time is simulated; scan() is called every
+ * millisecond like from the main loop.
+ *
+ * ADC model (9 bit, as POT_RESOLUTION): pot level plus gaussian
+ * noise, plus random spikes (WiFi/audio bursts), clipped to
+ * 0..POT_MAX. Traces:
+ *   quiet   sigma 0.5 LSB, no spikes
+ *   noisy   sigma 1.0 LSB (8 LSB at 12 bits), 1% spikes of
+ *           +/-20..60 LSB
+ *
+ * Checks that
+ * - at rest, the value does not change at all (60s per level,
+ *   including levels between two LSBs and the end stops), and
+ *   stays within hysteresis of the pot level,
+ * - after a step, the value gets within hysteresis of the new
+ *   level within STEP_MAX ms, and exactly reaches end stops,
+ * - after a pause in scanning, during which the pot was moved,
+ *   the first scan() reports the new position right away.
+ *
+ * Usage: tools/pottest/pottest.sh
+ */
+
+#include <Arduino.h>
+#include <math.h>
+
+#include "input.h"
+
+#define POT_PIN     1
+#define HYST        2           // FCPot default
+#define STEP_MAX    100         // ms
+
+unsigned long hostMillis = 1000;
+uint16_t (*hostAnalogRead)(uint8_t pin);
+
+static int failed = 0;
+
+#define CHECK(c, ...) do { if(!(c)) { printf("FAIL: " __VA_ARGS__); printf("\n"); failed++; } } while(0)
+
+/*
+ * ADC model
+ */
+
+static struct {
+    const char *name;
+    double sigma;
+    double spikeRate;
+} traces[] = {
+    { "quiet", 0.5, 0.0  },
+    { "noisy", 1.0, 0.01 }
+};
+
+static double   potLevel;
+static int      trace;
+static uint32_t rng = 1;
+
+static double urand()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return (rng >> 8) / 16777216.0;
+}
+
+// Irwin-Hall approximation, sigma 1
+static double grand()
+{
+    double s = 0.0;
+
+    for(int i = 0; i < 12; i++) s += urand();
+    return s - 6.0;
+}
+
+static uint16_t adcRead(uint8_t pin)
+{
+    double v = potLevel + grand() * traces[trace].sigma;
+
+    (void)pin;
+
+    if(urand() < traces[trace].spikeRate) {
+        v += (urand() < 0.5 ? -1.0 : 1.0) * (20.0 + urand() * 40.0);
+    }
+    v = floor(v + 0.5);
+    if(v < 0) v = 0;
+    if(v > POT_MAX) v = POT_MAX;
+
+    return (uint16_t)v;
+}
+
+/*
+ * Tests
+ */
+
+// Call scan() every ms for ms; returns number of reported changes
+static int run(FCPot& pot, unsigned long ms)
+{
+    int changes = 0;
+
+    while(ms--) {
+        hostMillis++;
+        if(pot.scan()) changes++;
+    }
+
+    return changes;
+}
+
+static void testRest(double level)
+{
+    FCPot pot(POT_PIN);
+    int changes, dev;
+
+    potLevel = level;
+    pot.begin();
+    run(pot, 2000);
+    changes = run(pot, 60000);
+    dev = abs((int)pot.value() - (int)floor(level + 0.5));
+
+    printf("%-6s rest %6.1f   value %3d, %d changes\n", traces[trace].name, level, pot.value(), changes);
+
+    CHECK(!changes, "%s: rest at %.1f: value flickers (%d changes)", traces[trace].name, level, changes);
+    CHECK(dev <= HYST, "%s: rest at %.1f: value %d", traces[trace].name, level, pot.value());
+}
+
+static void testStep(double from, double to)
+{
+    FCPot pot(POT_PIN);
+    unsigned long t0, lat = 0;
+    int target = (int)floor(to + 0.5);
+    bool endStop = (target == 0 || target == POT_MAX);
+
+    potLevel = from;
+    pot.begin();
+    run(pot, 2000);
+
+    potLevel = to;
+    t0 = hostMillis;
+    while(hostMillis - t0 < 2000) {
+        run(pot, 1);
+        if(endStop ? (pot.value() == target) : (abs((int)pot.value() - target) <= HYST)) {
+            lat = hostMillis - t0;
+            break;
+        }
+    }
+
+    printf("%-6s step %3.0f->%3.0f  %4lums\n", traces[trace].name, from, to, lat);
+
+    CHECK(lat && lat <= STEP_MAX, "%s: step %.0f->%.0f: %s after %lums", traces[trace].name,
+        from, to, lat ? "settled" : "not settled", lat ? lat : hostMillis - t0);
+}
+
+static void testPause(double from, double to)
+{
+    FCPot pot(POT_PIN);
+    bool changed;
+
+    potLevel = from;
+    pot.begin();
+    run(pot, 2000);
+
+    // Not scanned for a second, pot moved meanwhile
+    potLevel = to;
+    hostMillis += 1000;
+
+    // First scan after pause
+    hostMillis++;
+    changed = pot.scan();
+
+    printf("%-6s pause %3.0f->%3.0f value %3d%s\n", traces[trace].name, from, to, pot.value(),
+        changed ? ", reported" : "");
+
+    CHECK(changed, "%s: pause %.0f->%.0f: change not reported", traces[trace].name, from, to);
+    CHECK(abs((int)pot.value() - (int)to) <= HYST + 1, "%s: pause %.0f->%.0f: value %d",
+        traces[trace].name, from, to, pot.value());
+}
+
+int main()
+{
+    const double rest[] = { 0, 1, 100, 200.5, 255, 300.5, POT_MAX - 1, POT_MAX };
+    const double steps[][2] = {
+        { 100, 400 }, { 400, 100 }, { 200, 210 }, { 300, POT_MAX }, { 200, 0 }
+    };
+
+    hostAnalogRead = adcRead;
+
+    for(trace = 0; trace < (int)(sizeof(traces) / sizeof(traces[0])); trace++) {
+        for(double l : rest) testRest(l);
+        for(auto& s : steps) testStep(s[0], s[1]);
+        testPause(100, 400);
+        testPause(400, 20);
+    }
+
+    if(failed) {
+        printf("%d check(s) FAILED\n", failed);
+        return 1;
+    }
+    printf("OK\n");
+
+    return 0;
+}
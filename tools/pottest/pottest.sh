@@ -0,0 +1,19 @@
+#!/bin/sh
+#
+# pottest.sh - Build and run the pot input filter host test
+#
+# Usage: tools/pottest/pottest.sh
+
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+SRC="$HERE/../../src"
+OUT=${POTTEST_OUT:-/tmp/pottest}
+CXX=${CXX:-c++}
+
+mkdir -p "$OUT"
+
+$CXX -std=gnu++11 -O1 -g -Wall -Wextra -I"$HERE/shim" -I"$SRC" \
+    -o "$OUT/pottest" "$SRC/input.cpp" "$HERE/pottest.cpp" -lm
+
+"$OUT/pottest"
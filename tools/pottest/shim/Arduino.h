@@ -0,0 +1,43 @@
+/*
+ * Host stand-in for the parts of the Arduino core used by input.cpp
+ *
+ * Time and the ADC are driven by the test: millis() returns
+ * hostMillis, analogRead() calls hostAnalogRead.
+ */
+
+#ifndef _ARDUINO_SHIM_H
+#define _ARDUINO_SHIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef bool boolean;
+
+#define IRAM_ATTR
+#define INPUT           0x01
+#define INPUT_PULLUP    0x05
+#define LOW             0
+#define HIGH            1
+
+extern unsigned long hostMillis;
+extern uint16_t (*hostAnalogRead)(uint8_t pin);
+
+static inline unsigned long millis() { return hostMillis; }
+static inline unsigned long micros() { return hostMillis * 1000; }
+
+static inline void pinMode(uint8_t, uint8_t) { }
+static inline int  digitalRead(uint8_t) { return HIGH; }
+
+static inline uint16_t analogRead(uint8_t pin) { return hostAnalogRead(pin); }
+static inline void analogReadResolution(uint8_t) { }
+static inline void analogSetWidth(uint8_t) { }
+
+typedef struct hw_timer_s hw_timer_t;
+static inline hw_timer_t *timerBegin(uint8_t, uint16_t, bool) { return NULL; }
+static inline void timerAttachInterrupt(hw_timer_t *, void (*)(), bool) { }
+static inline void timerAlarmWrite(hw_timer_t *, uint64_t, bool) { }
+static inline void timerAlarmEnable(hw_timer_t *) { }
+
+#endif
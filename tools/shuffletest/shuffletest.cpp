@@ -0,0 +1,161 @@
+/*
+ * shuffletest - Host test of the music player's shuffle
+ *
+ * Builds src/fc_shuffle.cpp, which holds the permutation the
+ * music player uses (mp_initShuffle(), mp_idxToTrack() and
+ * mp_trackToIdx() in fc_audio.cpp are thin wrappers).
+ * The GOLDEN orders below were produced by the firmware's
+ * code; if the permutation changes, shuffled positions saved
+ * by earlier versions no longer resume correctly.
+ *
+ * Checks that
+ * - for every number of tracks (1 to 1000) and a number of
+ *   seeds, shuffleIdxToTrack is a bijection of [0, maxIdx]
+ *   and shuffleTrackToIdx is its inverse,
+ * - a seed always yields the same order (GOLDEN),
+ * - over all seeds, every track is equally likely at every
+ *   play list position, and as the successor of every other
+ *   track (chi-square).
+ *
+ * Usage: tools/shuffletest/shuffletest.sh
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fc_shuffle.h"
+
+static int failed = 0;
+
+#define CHECK(c, ...) do { if(!(c)) { printf("FAIL: " __VA_ARGS__); printf("\n"); failed++; } } while(0)
+
+// maxIdx, seed, first positions of the shuffled order
+static const struct {
+    int      maxIdx;
+    uint16_t seed;
+    int      num;
+    int      order[16];
+} golden[] = {
+    {   2,     7,  3, { 2, 0, 1 } },
+    {   4, 65535,  5, { 3, 2, 1, 4, 0 } },
+    {   9,     1, 10, { 2, 1, 6, 7, 8, 3, 4, 5, 0, 9 } },
+    {   9,  4660, 10, { 8, 3, 9, 6, 1, 2, 5, 4, 0, 7 } },
+    {  99, 48879, 16, { 34, 96, 82, 57, 25, 73, 70, 24, 77, 31, 40, 39, 20, 0, 51, 84 } },
+    { 999, 12345, 16, { 618, 680, 673, 702, 50, 445, 692, 190, 270, 392, 388, 914, 211, 858, 341, 731 } }
+};
+
+static void testBijection()
+{
+    const uint16_t seeds[] = { 1, 2, 0x1234, 0xbeef, 0xffff };
+    static int seen[1000];
+    FCShuffle sh;
+    int t, bad;
+
+    for(int maxIdx = 0; maxIdx < 1000; maxIdx++) {
+        for(uint16_t seed : seeds) {
+            shuffleInit(&sh, seed, maxIdx);
+            memset(seen, 0, sizeof(seen));
+            bad = 0;
+            for(int i = 0; i <= maxIdx && !bad; i++) {
+                t = shuffleIdxToTrack(&sh, i);
+                if(t < 0 || t > maxIdx || seen[t]++) {
+                    CHECK(false, "maxIdx %d, seed %d: not a permutation", maxIdx, seed);
+                    bad = 1;
+                } else if(shuffleTrackToIdx(&sh, t) != i) {
+                    CHECK(false, "maxIdx %d, seed %d: trackToIdx(%d) != %d", maxIdx, seed, t, i);
+                    bad = 1;
+                }
+            }
+        }
+    }
+
+    printf("bijection      maxIdx 0-999, %d seeds each\n", (int)(sizeof(seeds) / sizeof(seeds[0])));
+}
+
+static void testGolden()
+{
+    FCShuffle sh;
+    int n = sizeof(golden) / sizeof(golden[0]), t;
+
+    for(int g = 0; g < n; g++) {
+        shuffleInit(&sh, golden[g].seed, golden[g].maxIdx);
+        for(int i = 0; i < golden[g].num; i++) {
+            t = shuffleIdxToTrack(&sh, i);
+            if(t != golden[g].order[i]) {
+                CHECK(false, "maxIdx %d, seed %d: position %d is %d, expected %d",
+                    golden[g].maxIdx, golden[g].seed, i, t, golden[g].order[i]);
+                break;
+            }
+        }
+    }
+
+    printf("reproducible   %d orders\n", n);
+}
+
+// Chi-square of counts against equal distribution; fails beyond
+// 5 standard deviations (dof degrees of freedom)
+static void chi2(const char *name, int n, const int *counts, int num, int dof)
+{
+    double sum = 0, exp, x = 0, lim;
+
+    for(int i = 0; i < num; i++) sum += counts[i];
+    exp = sum / num;
+    for(int i = 0; i < num; i++) x += (counts[i] - exp) * (counts[i] - exp) / exp;
+    lim = dof + 5 * sqrt(2.0 * dof);
+
+    printf("%s/%-*d chi2 %.1f, dof %d, limit %.1f\n", name, 13 - (int)strlen(name), n, x, dof, lim);
+
+    CHECK(x <= lim, "%s/%d: not uniform (chi2 %.1f > %.1f)", name, n, x, lim);
+}
+
+static void testUniform(int maxIdx)
+{
+    int n = maxIdx + 1, order[64], k;
+    int *pos = (int *)calloc(n * n, sizeof(int));
+    int *succ = (int *)calloc(n * n, sizeof(int));
+    int *succ2 = (int *)calloc(n * n, sizeof(int));
+    FCShuffle sh;
+
+    for(int seed = 1; seed < 0x10000; seed++) {
+        shuffleInit(&sh, seed, maxIdx);
+        for(int i = 0; i < n; i++) {
+            order[i] = shuffleIdxToTrack(&sh, i);
+            pos[i * n + order[i]]++;
+        }
+        for(int i = 0; i < n - 1; i++) {
+            succ[order[i] * n + order[i + 1]]++;
+        }
+    }
+    chi2("position", n, pos, n * n, (n - 1) * (n - 1));
+
+    // A track never follows itself
+    k = 0;
+    for(int a = 0; a < n; a++) {
+        for(int b = 0; b < n; b++) {
+            if(a != b) succ2[k++] = succ[a * n + b];
+        }
+    }
+    chi2("successor", n, succ2, k, n * (n - 1) - 1);
+
+    free(pos);
+    free(succ);
+    free(succ2);
+}
+
+int main()
+{
+    testBijection();
+    testGolden();
+    testUniform(6);
+    testUniform(12);
+
+    if(failed) {
+        printf("%d check(s) FAILED\n", failed);
+        return 1;
+    }
+    printf("OK\n");
+
+    return 0;
+}
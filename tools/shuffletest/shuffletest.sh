@@ -0,0 +1,19 @@
+#!/bin/sh
+#
+# shuffletest.sh - Build and run the music player shuffle host test
+#
+# Usage: tools/shuffletest/shuffletest.sh
+
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+SRC="$HERE/../../src"
+OUT=${SHUFFLETEST_OUT:-/tmp/shuffletest}
+CXX=${CXX:-c++}
+
+mkdir -p "$OUT"
+
+$CXX -std=gnu++11 -O2 -g -Wall -Wextra -I"$SRC" \
+    -o "$OUT/shuffletest" "$SRC/fc_shuffle.cpp" "$HERE/shuffletest.cpp" -lm
+
+"$OUT/shuffletest"